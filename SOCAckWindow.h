@@ -0,0 +1,88 @@
+// Cumulative acknowledgement of the frames pushed by a peer.
+//
+// Instead of one ACK per frame, the receiver notes every frame it takes
+// and acknowledges them all at once with the sequence number of the last
+// one. The ACK rides on the next frame the receiver sends anyway, when
+// there is one; it is sent on its own only once "window" frames are
+// waiting for it, or the oldest of them has waited "max_delay" ms, so
+// that the peer can bound what it keeps for retransmission.
+//
+// Used under the lock of the connection; the counters can be read from
+// any thread.
+//
+
+#ifndef _SOCACKWINDOW_H
+#define _SOCACKWINDOW_H
+
+#include <atomic>
+#include <chrono>
+#include <stdio.h>
+#include <stdint.h>
+
+// **************************************************************************
+class SOCAckWindow
+	{
+	public:
+		SOCAckWindow (unsigned int window, unsigned int max_delay_ms)
+			: window(window > 0 ? window : 1), max_delay(max_delay_ms), last(0), unacked(0),
+			  frames(0), acks(0), piggybacked(0)
+		{
+		}
+
+		// Start over on a new connection
+		void Reset ()
+		{
+			last = 0;
+			unacked = 0;
+		}
+
+		// Frame "seq" was taken
+		void Received (uint32_t seq)
+		{
+			if (unacked == 0)
+				first_at = std::chrono::steady_clock::now();
+			last = seq;
+			unacked++;
+			frames.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		// Frames are waiting for an ACK
+		bool Pending () const { return unacked > 0; }
+
+		// An ACK must be sent now, on its own if nothing else goes out
+		bool Due () const
+		{
+			return unacked >= window || (unacked > 0 &&
+				std::chrono::steady_clock::now() - first_at >= std::chrono::milliseconds(max_delay));
+		}
+
+		// Sequence number to acknowledge; every frame taken so far is
+		// then acknowledged. "piggyback": the ACK rides on another frame.
+		uint32_t Take (bool piggyback)
+		{
+			unacked = 0;
+			(piggyback ? piggybacked : acks).fetch_add(1, std::memory_order_relaxed);
+			return last;
+		}
+
+		void Print (const char* name) const
+		{
+			uint32_t f = frames.load(std::memory_order_relaxed);
+			uint32_t a = acks.load(std::memory_order_relaxed);
+			uint32_t p = piggybacked.load(std::memory_order_relaxed);
+			printf("%s: %u quadros, %u ACKs proprios e %u em outros quadros (%.2f quadros por ACK)\n",
+				name, f, a, p, (a + p) > 0 ? (double) f / (a + p) : 0.0);
+		}
+
+	private:
+		unsigned int window;
+		unsigned int max_delay;		// ms
+		uint32_t last;				// last frame taken
+		unsigned int unacked;		// frames taken since the last ACK
+		std::chrono::steady_clock::time_point first_at;	// first of them
+		std::atomic<uint32_t> frames;
+		std::atomic<uint32_t> acks;
+		std::atomic<uint32_t> piggybacked;
+	};
+
+#endif // _SOCACKWINDOW_H
@@ -0,0 +1,62 @@
+// Polling interval that follows the activity of what is polled.
+//
+// After each poll the caller tells whether the polled value changed. A
+// change drops the interval to its minimum, so motion is followed closely
+// from the first poll that sees it; every poll without a change multiplies
+// it by "factor", up to the maximum, so a value that stays put is polled
+// less and less often. The interval is read without locking by the thread
+// printing metrics.
+//
+
+#ifndef _SOCADAPTIVEPOLL_H
+#define _SOCADAPTIVEPOLL_H
+
+#include <atomic>
+#include <stdio.h>
+#include <stdint.h>
+
+// **************************************************************************
+class SOCAdaptivePoll
+	{
+	public:
+		SOCAdaptivePoll (unsigned int min_ms, unsigned int max_ms, double factor = 2.0)
+			: min_ms(min_ms > 0 ? min_ms : 1), max_ms(max_ms > min_ms ? max_ms : min_ms),
+			  factor(factor > 1.0 ? factor : 2.0), interval(this->min_ms), polls(0), changes(0)
+		{
+		}
+
+		// Interval to wait before the next poll, in ms
+		unsigned int Update (bool changed)
+		{
+			unsigned int next = min_ms;
+			if (!changed){
+				double longer = interval.load(std::memory_order_relaxed) * factor;
+				next = (longer < max_ms) ? (unsigned int) longer : max_ms;
+			}
+			else
+				changes.fetch_add(1, std::memory_order_relaxed);
+			polls.fetch_add(1, std::memory_order_relaxed);
+			interval.store(next, std::memory_order_relaxed);
+			return next;
+		}
+
+		unsigned int Interval () const { return interval.load(std::memory_order_relaxed); }
+		double Rate () const { return 1000.0 / Interval(); }		// polls per second
+
+		void Print (const char* name) const
+		{
+			printf("%s: intervalo %u ms (%.2f por s, entre %u e %u ms), %u consultas, %u com mudanca\n",
+				name, Interval(), Rate(), min_ms, max_ms,
+				polls.load(std::memory_order_relaxed), changes.load(std::memory_order_relaxed));
+		}
+
+	private:
+		unsigned int min_ms;
+		unsigned int max_ms;
+		double factor;
+		std::atomic<unsigned int> interval;
+		std::atomic<uint32_t> polls;
+		std::atomic<uint32_t> changes;
+	};
+
+#endif // _SOCADAPTIVEPOLL_H
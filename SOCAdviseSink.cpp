@@ -10,18 +10,36 @@
 //
 
 #include <stdio.h>
-#include <assert.h>
 #include "opcda.h"
 #include "SOCAdviseSink.h"
+#include "SOCItemRegistry.h"
+#include "SOCStreamParser.h"
+#include "SOCSampleLog.h"
+#include "SOCVarTraits.h"
 #include "SOCWrapperFunctions.h"
 
 extern UINT OPC_DATA_TIME;
 
-// Constructor: initializes the reference count to 0.
-SOCAdviseSink::SOCAdviseSink () : m_cRef (0)
+// Constructor: initializes the reference count to 0. Decoded values are
+// stored into "registry"; since the registry takes a single writer, the
+// sink must not be advised while SOCDataCallback is.
+SOCAdviseSink::SOCAdviseSink (SOCItemRegistry* registry)
+	: registry (registry), log (NULL), malformed_items (0), m_cRef (0)
 	{
 	}
 
+// Optional log of a sample of the decoded values (NULL for none)
+void SOCAdviseSink::SetLog (SOCSampleLog* log)
+{
+	this->log = log;
+}
+
+// Items skipped because their header or value did not fit in the stream
+ULONG SOCAdviseSink::MalformedItems () const
+{
+	return malformed_items;
+}
+
 // IUnknown methods
 HRESULT STDMETHODCALLTYPE SOCAdviseSink::QueryInterface (REFIID riid, LPVOID *ppv)
 {
@@ -68,18 +86,8 @@ void STDMETHODCALLTYPE SOCAdviseSink::OnDataChange(
 	   FORMATETC *pFormatEtc,
 	   STGMEDIUM *pMedium)
 {
-	HRESULT hr;
-	IStream *pStream = NULL;
-	LARGE_INTEGER dlibMove;
-	OPCGROUPHEADER groupheader;
-	OPCITEMHEADER1 itemheader;
-	VARIANT vtVal;
-	FILETIME lft;
-	SYSTEMTIME st;
-    char szLocalDate[255], szLocalTime[255];
-	bool status;
-	char buffer[100];
-	WORD quality;
+	const BYTE* pData;
+	Opc_stream_item item;
 
 	// Check for valid pointers.  Return if invalid:
 	if ((pFormatEtc == NULL) || (pMedium == NULL)) {
@@ -94,42 +102,6 @@ void STDMETHODCALLTYPE SOCAdviseSink::OnDataChange(
 		return;
 	}
 
-	// Although this is not strictly necessary, KEPWAREs sample client
-	// treats the storage medium as a stream object. So, it first
-	// obtains an IStream instance from the global memory handle.
-	//
-	// We recall that OPC data are passed as a structure that begins with an OPC
-	// group header followed by an array of OPC item headers (one for each OPC item
-	// passed), and then the OPC items of VARIANT data type. So, to properly parse
-	// the OPC data passed, one first must point to the OPC group header and extract
-	// the "dwItemCount" item count from it, and then walk the structure along the
-	// each OPC item header. Each of these, in turn, contains a "dwValueOffset" field
-	// which indicates the actual location of the OPC item value;
-	//
-	hr = CreateStreamOnHGlobal (pMedium->hGlobal,	// global memory handle
-								TRUE,				// delete memory when stream is release
-								&pStream);			// put the stream here
-
-	// Make sure we succeeded.  Release stream and return if not:
-	if (hr != S_OK){
-		printf("IAdviseSink::OnDataChange: Failed to create stream object. Error = %x\n", hr);
-		pStream->Release ();
-		return;
-	}
-
-	// Seek to the beginning of the stream.
-	dlibMove.LowPart = dlibMove.HighPart = 0;
-	hr = pStream->Seek (dlibMove,			// relative offset set to
-					    STREAM_SEEK_SET,	// beginning of the stream
-						NULL);				// don't care about the new seek pointer
-
-	// Make sure we succeeded.  Release stream and return if not:
-	if (hr != S_OK){
-		printf("IAdviseSink::OnDataChange: Seek failed on object stream. Error = %x\n", hr);
-		pStream->Release ();
-		return;
-	}
-
 	// Check the event that generated the callback. In this example, only data passed
 	// with time stamp is supported.
 	if (pFormatEtc->cfFormat != OPC_DATA_TIME){
@@ -137,184 +109,66 @@ void STDMETHODCALLTYPE SOCAdviseSink::OnDataChange(
 		return;
 	}
 
-	// Read the OPC group header:
-	hr = pStream->Read (&groupheader,				// where to put the stream data
-						sizeof (OPCGROUPHEADER),	// how much to read
-						NULL);						// don't care about how many bytes are read
-
-	// Release stream and return if read failed:
-	if (hr != S_OK){
-		printf("IAdviseSink::OnDataChange: Failed to read stream object. Error = %x\n", hr);
-		pStream->Release ();
+	// We recall that OPC data are passed as a structure that begins with an OPC
+	// group header followed by an array of OPC item headers (one for each OPC item
+	// passed), and then the OPC items of VARIANT data type. Instead of reading
+	// it through an IStream (several COM calls per item), the global memory is
+	// locked once and walked in place by SOCStreamParser, which checks every
+	// offset against the size of the block. The medium belongs to the caller,
+	// so it is only unlocked, never freed, here.
+	pData = (const BYTE*) GlobalLock (pMedium->hGlobal);
+	if (pData == NULL){
+		printf("IAdviseSink::OnDataChange: Failed to lock global memory. Error = %x\n", GetLastError());
 		return;
 	}
-
-	// Initialize a variant to place a data value in:
-	VariantInit (&vtVal);
-
-	// Loop over OPC item headers in the stream:
-	for (DWORD dwItem = 0; dwItem < groupheader.dwItemCount; dwItem++)
-	{
-		// Compute offset of next item:
-		dlibMove.HighPart = 0;
-		dlibMove.LowPart = sizeof (OPCGROUPHEADER) + (dwItem * sizeof (OPCITEMHEADER1));
-		// Seek to next item:
-		hr = pStream->Seek (dlibMove, STREAM_SEEK_SET, NULL);
-		if (hr != S_OK){
-			printf("IAdviseSink::OnDataChange: Seek next item failed. Error = %x\n", hr);
-		pStream->Release ();
+	SOCStreamParser parser (pData, GlobalSize (pMedium->hGlobal));
+	if (!parser.Valid ()){
+		printf("IAdviseSink::OnDataChange: Invalid group header\n");
+		GlobalUnlock (pMedium->hGlobal);
 		return;
-		}
-
-		// Read the item header:
-		hr = pStream->Read (&itemheader, sizeof (OPCITEMHEADER1), NULL);
-		if (hr != S_OK){
-			printf("IAdviseSink::OnDataChange: Read Item Header failed. Error = %x\n", hr);
-			pStream->Release ();
-			return;
-		}
+	}
 
-		// Seek to beginning of the OPC utem value:
-		dlibMove.LowPart = itemheader.dwValueOffset;	
-		hr = pStream->Seek (dlibMove, STREAM_SEEK_SET, NULL);
-		if (hr != S_OK){
-			printf("IAdviseSink::OnDataChange: Failed to seek data. Error = %x\n", hr);
-			pStream->Release ();
-			return;
+	// Decode straight into the registry, as a single batch. Arrays are
+	// copied from the stream into the registry's array arena, once; strings
+	// are not kept by the registry. Rendering values for people is left to
+	// the optional sampled log, which runs on its own thread.
+	registry->BeginUpdate ();
+	for (DWORD dwItem = 0; dwItem < parser.Count (); dwItem++)
+	{
+		if (!parser.Item (dwItem, item)){
+			malformed_items++;
+			continue;
 		}
-
-		// Read the variant data:
-		hr = pStream->Read (&vtVal, sizeof (VARIANT), NULL);
-		if (hr != S_OK){
-			printf("IAdviseSink::OnDataChange: Read variant failed. Error = %x\n", hr);
-			pStream->Release ();
-			return;
+		if (item.value.vt & VT_ARRAY){
+			StoreArray (item);
+			continue;
 		}
+		registry->Store (item.client_handle, item.value, item.quality,
+						 FileTimeToEpoch (item.timestamp));
+		if (log != NULL)
+			log->Log (item.client_handle, item.value, item.quality, item.timestamp);
+	}
+	registry->EndUpdate ();
+	GlobalUnlock (pMedium->hGlobal);
+}
 
-		// A little more work for strings and arrays:
-		switch (vtVal.vt)
-		{
-			case VT_BSTR:
-				// For VT_BSTR items, the data is passed as the VARIANT value
-				// (whose value "bstrval" is just a pointer to the string)
-				// immediately followed by a DWORD byte count, and then the
-				// MULL-terminated string itself. So, one must first allocate memory
-				// for copying the string, then store its new pointer in the
-				// VARIANT "bstrval" field, and the copy the string to its new position.
-				// Note that the OPC Spec states that "any pointers in the SAFEARRAY and
-				// VARIANT unions need to be recreated by the receiver when the data
-				// is unmarshalled and stored locally", and this is why the initial
-				// "bstrval" passed to the client is overwritten with a new valid pointer.
-				{
-				DWORD dwLength = 0;
-				// Read string length:
-				hr = pStream->Read (&dwLength, sizeof (DWORD), NULL);
-				if (hr != S_OK){
-					printf("IAdviseSink::OnDataChange: Read string size. Error = %x\n", hr);
-					pStream->Release ();
-					return;
-				}
-				if (dwLength == 0)
-					vtVal.bstrVal = NULL;
-				else{ 
-					// Allocate memory for string.  We will free this once we copy
-					// the contents of the string into the item object:
-					vtVal.bstrVal = SysAllocStringLen (NULL, dwLength);
-					if (vtVal.bstrVal != NULL){
-						// Read string data:
-						hr = pStream->Read (vtVal.bstrVal, (dwLength + 1) * sizeof (OLECHAR), NULL);
-						if (hr != S_OK){
-							printf("IAdviseSink::OnDataChange: VT_BSTR: Failed to create stream object. Error = %x\n", hr);
-							SysFreeString (vtVal.bstrVal);						
-							pStream->Release ();
-							return;
-						}
-					}
-				}
-				}
-				break;
-			case VT_UI1	| VT_ARRAY:
-			case VT_I1	| VT_ARRAY:
-			case VT_UI2	| VT_ARRAY:
-			case VT_I2	| VT_ARRAY:
-			case VT_UI4	| VT_ARRAY:
-			case VT_I4	| VT_ARRAY:
-			case VT_R4	| VT_ARRAY:
-			case VT_R8	| VT_ARRAY:
-				// For VT_ARRAY items, the data is passed as the VARIANT value
-				// followed by a SAFEARRAY structure, and then the data items
-				// themselves. As in the VT_BSTR case, one must create a new
-				// array descriptor (by means of the SafeArrayCreate function),
-				// copy its pointer to the VARIANT "parray" field, and finally
-				// copy the original array data into this new array descriptor.
-				{
-				// Read array parameters:
-				SAFEARRAY sa;
-				DWORD cdwElements;
-				pStream->Read (&sa, sizeof (SAFEARRAY), NULL);
-				// 2-D array:
-				if (sa.cDims != 1){
-					// Read array parameters for second dimension:
-					// (Note that ASSERT is a MFC function that here is replaced
-					// by the standard CRT function assert'
-					//ASSERT (sa.cDims == 2);
-					assert (sa.cDims == 2);
-					SAFEARRAYBOUND sab [2];
-					sab [0] = sa.rgsabound [0];
-					pStream->Read (&sab [1], sizeof (SAFEARRAYBOUND), NULL);
-					// Compute array size:
-					cdwElements = sa.rgsabound [0].cElements * sab [1].cElements;
-					// Allocate array (specify basic, i.e. non-array, data type):
-					vtVal.parray = SafeArrayCreate (vtVal.vt & ~VT_ARRAY, sa.cDims, sab);
-				}
-				// 1-D array
-				else {
-					// Compute array size:
-					cdwElements = sa.rgsabound [0].cElements;
-					// Allocate array (specify basic, i.e. non-array, data type):
-					vtVal.parray = SafeArrayCreate (vtVal.vt & ~VT_ARRAY, sa.cDims, sa.rgsabound);
-				}
-				// Read array data:
-				pStream->Read (vtVal.parray->pvData, sa.cbElements * cdwElements, NULL);
-				}
-				break;
-			case VT_BSTR | VT_BYREF:
-				//ASSERT (FALSE);
-				assert (false);
-				break;
-		}
+// Copy an array item from the stream into the registry
+void SOCAdviseSink::StoreArray (const Opc_stream_item& item)
+{
+	Opc_array_view view;
 
-		// Print the item value, quality and time stamp. In this version, only
-		// a few OPC data types are supported.
-		status = VarToStr(vtVal, buffer);
-		if (status){
-			printf("Data Advise: Value = %s", buffer);
-			if (vtVal.vt == VT_BSTR)
-				SysFreeString (vtVal.bstrVal);	
-			quality = itemheader.wQuality & OPC_QUALITY_MASK;
-			if (quality == OPC_QUALITY_GOOD)
-				printf(" Quality: good");
-			else
-			    printf(" Quality: not good");
-			// Code below extracted from the Microsoft KB:
-			//     http://support.microsoft.com/kb/188768
-			// Note that in order for it to work, the Visual Studio C++ must
-			// be configured so that the "character set" property is "not set"
-			// (Project->Project Properties->Configuration Properties->General).
-			// Otherwise, if defined e.g. as "use Unicode" (as it seems to be
-			// the default when a new project is created), there will be
-			// compilation errors.
-			FileTimeToLocalFileTime(&itemheader.ftTimeStampItem,&lft);
-			FileTimeToSystemTime(&lft, &st);
-			GetDateFormat(LOCALE_SYSTEM_DEFAULT, DATE_SHORTDATE, &st, NULL, szLocalDate, 255);
-			GetTimeFormat(LOCALE_SYSTEM_DEFAULT, 0, &st, NULL, szLocalTime, 255);
-			printf(" Time: %s %s\n", szLocalDate, szLocalTime);
-		}
-		else printf ("Data Advise: Unsupported item type\n");
-		
-		// Clear variant for reuse:
-		VariantClear (&vtVal);
-	}
-	// Release our stream on exit:
-	pStream->Release();
-}
\ No newline at end of file
+	if (VtSize (item.value.vt & VT_TYPEMASK) != item.element_size)
+		return;
+	view.info.vt = item.value.vt & VT_TYPEMASK;
+	view.info.dims = item.dims;
+	view.info.element_size = item.element_size;
+	view.info.elements = item.elements;
+	view.info.bounds[0] = item.bounds[0];
+	view.info.bounds[1] = item.bounds[1];
+	view.data = item.data;
+
+	uint32_t version = registry->Arrays ()->Put (item.client_handle, view);
+	if (version != 0)
+		registry->StoreArray (item.client_handle, view.info.vt, version, item.quality,
+							  FileTimeToEpoch (item.timestamp));
+}
@@ -9,10 +9,18 @@
 // Class definition
 #ifndef _SOCADVISESINK_H
 #define _SOCADVISESINK_H
+
+class SOCItemRegistry;
+class SOCSampleLog;
+struct Opc_stream_item;
+
 class SOCAdviseSink : public IAdviseSink
 	{
 	public:
-		SOCAdviseSink ();
+		SOCAdviseSink (SOCItemRegistry* registry);
+
+		void SetLog (SOCSampleLog* log);
+		ULONG MalformedItems () const;
 
 		// IUnknown Methods
 		HRESULT STDMETHODCALLTYPE QueryInterface (REFIID riid, LPVOID *ppv);
@@ -27,6 +35,11 @@ class SOCAdviseSink : public IAdviseSink
 		void STDMETHODCALLTYPE OnClose () {/*Not implemented*/};
 
 	private: 
+		void StoreArray (const Opc_stream_item& item);
+
+		SOCItemRegistry* registry;
+		SOCSampleLog* log;
+		ULONG malformed_items;
 
 	protected:
 		ULONG m_cRef; 
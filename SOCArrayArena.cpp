@@ -0,0 +1,142 @@
+//
+// C++ class holding the last value of each array-valued item in a pool of
+// preallocated blocks.
+//
+// Block data are kept as 32-bit atomic words, like the records of
+// SOCSeqlock.h, so that a reader copying a block while the writer
+// overwrites it is well defined; the block's sequence counter decides
+// whether the copy is kept.
+//
+
+#include <string.h>
+#include "SOCArrayArena.h"
+#include "SOCVarTraits.h"
+
+bool ViewSafeArray (VARTYPE vt, SAFEARRAY* psa, void* data, Opc_array_view& view)
+{
+	if (psa == NULL || data == NULL || psa->cDims < 1 || psa->cDims > 2)
+		return false;
+	if (VtSize(vt) == 0 || VtSize(vt) != psa->cbElements)
+		return false;
+
+	memset(&view, 0, sizeof(view));
+	view.info.vt = vt;
+	view.info.dims = psa->cDims;
+	view.info.element_size = psa->cbElements;
+	view.info.elements = 1;
+	for (USHORT d = 0; d < psa->cDims; d++){
+		view.info.bounds[d] = psa->rgsabound[d];
+		view.info.elements *= psa->rgsabound[d].cElements;
+	}
+	view.data = data;
+	return true;
+}
+
+void MakeSafeArray (const Opc_array_info& info, void* data, Opc_safearray& out)
+{
+	memset(&out, 0, sizeof(out));
+	out.sa.cDims = info.dims;
+	out.sa.fFeatures = FADF_STATIC | FADF_FIXEDSIZE;
+	out.sa.cbElements = info.element_size;
+	out.sa.pvData = data;
+	out.sa.rgsabound[0] = info.bounds[0];
+	if (info.dims == 2)
+		out.extra_bound = info.bounds[1];
+}
+
+//	Constructor. All the memory is allocated here.
+SOCArrayArena::SOCArrayArena (uint32_t items, uint32_t blocks, uint32_t block_size)
+	: items(items), blocks(blocks), next_block(0), rejected(0)
+{
+	block_words = (block_size + sizeof(uint32_t) - 1) / sizeof(uint32_t);
+	item_block.reset(new std::atomic<uint32_t>[items]);
+	for (uint32_t i = 0; i < items; i++)
+		item_block[i].store(0, std::memory_order_relaxed);
+	block_seq.reset(new SeqCounter[blocks]);
+	block_info.reset(new SeqWords<Opc_array_info>[blocks]);
+	words.reset(new std::atomic<uint32_t>[(size_t) blocks * block_words]);
+}
+
+uint32_t SOCArrayArena::Put (OPCHANDLE client_handle, const Opc_array_view& array)
+{
+	size_t bytes = (size_t) array.info.elements * array.info.element_size;
+
+	if (client_handle >= items || bytes > (size_t) block_words * sizeof(uint32_t)){
+		rejected.fetch_add(1, std::memory_order_relaxed);
+		return 0;
+	}
+
+	uint32_t block = item_block[client_handle].load(std::memory_order_relaxed);
+	if (block == 0){
+		uint32_t next = next_block.load(std::memory_order_relaxed);
+		if (next >= blocks){
+			rejected.fetch_add(1, std::memory_order_relaxed);
+			return 0;
+		}
+		next_block.store(next + 1, std::memory_order_relaxed);
+		block = next + 1;
+		item_block[client_handle].store(block, std::memory_order_release);
+	}
+	block--;
+
+	std::atomic<uint32_t>* w = &words[(size_t) block * block_words];
+	const BYTE* src = (const BYTE*) array.data;
+
+	block_seq[block].BeginWrite();
+	block_info[block].Put(array.info);
+	for (size_t k = 0; k * sizeof(uint32_t) < bytes; k++){
+		uint32_t word = 0;
+		size_t n = bytes - k * sizeof(uint32_t);
+		memcpy(&word, src + k * sizeof(uint32_t), n < sizeof(uint32_t) ? n : sizeof(uint32_t));
+		w[k].store(word, std::memory_order_relaxed);
+	}
+	block_seq[block].EndWrite();
+
+	return block_seq[block].Version();
+}
+
+bool SOCArrayArena::Get (OPCHANDLE client_handle, Opc_array_info& info, void* data, size_t size) const
+{
+	if (client_handle >= items)
+		return false;
+	uint32_t block = item_block[client_handle].load(std::memory_order_acquire);
+	if (block == 0)
+		return false;
+	block--;
+
+	const std::atomic<uint32_t>* w = &words[(size_t) block * block_words];
+	BYTE* dst = (BYTE*) data;
+	uint32_t s;
+
+	do {
+		s = block_seq[block].BeginRead();
+		info = block_info[block].Get();
+		size_t bytes = (size_t) info.elements * info.element_size;
+		if (bytes > size || bytes > (size_t) block_words * sizeof(uint32_t)){
+			if (block_seq[block].ReadValid(s))
+				return false;
+			continue;
+		}
+		for (size_t k = 0; k * sizeof(uint32_t) < bytes; k++){
+			uint32_t word = w[k].load(std::memory_order_relaxed);
+			size_t n = bytes - k * sizeof(uint32_t);
+			memcpy(dst + k * sizeof(uint32_t), &word, n < sizeof(uint32_t) ? n : sizeof(uint32_t));
+		}
+	} while (!block_seq[block].ReadValid(s));
+	return true;
+}
+
+uint32_t SOCArrayArena::BlockSize () const
+{
+	return block_words * sizeof(uint32_t);
+}
+
+uint32_t SOCArrayArena::BlocksUsed () const
+{
+	return next_block.load(std::memory_order_relaxed);
+}
+
+uint32_t SOCArrayArena::Rejected () const
+{
+	return rejected.load(std::memory_order_relaxed);
+}
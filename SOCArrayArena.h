@@ -0,0 +1,91 @@
+// Storage for the last value of array-valued OPC items (waveforms,
+// vectors).
+//
+// An array only lives as long as the callback that delivers it (the
+// SAFEARRAY of IOPCDataCallback, the stream of IAdviseSink), so it has to
+// be copied once to outlive it. The copy goes into a pool of fixed-size
+// blocks allocated once at startup: the first array of an item takes the
+// next free block, which then belongs to that item for good and is
+// overwritten by each new array. There is no allocation on the data path
+// and nothing to free.
+//
+// Each block is guarded by its own sequence lock (see SOCSeqlock.h): the
+// callback thread writes without waiting, and readers copy the array out
+// and retry if it was overwritten meanwhile.
+//
+
+#include "opcda.h"
+
+#ifndef _SOCARRAYARENA_H
+#define _SOCARRAYARENA_H
+
+#include <atomic>
+#include <memory>
+#include "SOCSeqlock.h"
+
+// Shape of an array value. "vt" is the element type, without VT_ARRAY.
+struct Opc_array_info {
+	VARTYPE vt;
+	USHORT dims;				// 1 or 2
+	ULONG element_size;
+	ULONG elements;				// total number of elements
+	SAFEARRAYBOUND bounds[2];	// one per dimension
+};
+
+// An array that is not owned: a span over the source buffer (a locked
+// SAFEARRAY, the advise stream, a caller buffer).
+struct Opc_array_view {
+	Opc_array_info info;
+	const void* data;
+};
+
+// SAFEARRAY descriptor over a caller buffer, to pass an array to code
+// expecting a VARIANT. The second bound follows rgsabound[0] in memory, as
+// in a descriptor made by SafeArrayCreate(). It must not be destroyed,
+// resized or used after the buffer goes away.
+struct Opc_safearray {
+	SAFEARRAY sa;
+	SAFEARRAYBOUND extra_bound;
+};
+void MakeSafeArray (const Opc_array_info& info, void* data, Opc_safearray& out);
+
+// Array view of a SAFEARRAY of scalars with one or two dimensions. The
+// caller must keep the array locked (SafeArrayAccessData()) while the
+// view is used. Returns false for other arrays.
+bool ViewSafeArray (VARTYPE vt, SAFEARRAY* psa, void* data, Opc_array_view& view);
+
+// **************************************************************************
+class SOCArrayArena
+	{
+	public:
+		// "items" is the number of client handles; "blocks" blocks of
+		// "block_size" bytes are shared among the items holding arrays.
+		SOCArrayArena (uint32_t items, uint32_t blocks, uint32_t block_size);
+
+		// Copy an array into the block of client_handle. Returns the number
+		// of arrays stored for the item so far, or 0 if the array is larger
+		// than a block or no block is left. One writer thread only.
+		uint32_t Put (OPCHANDLE client_handle, const Opc_array_view& array);
+
+		// Consistent copy of the last array of client_handle. "data" must
+		// hold "size" bytes. Returns false if the item has no array or if
+		// it does not fit.
+		bool Get (OPCHANDLE client_handle, Opc_array_info& info, void* data, size_t size) const;
+
+		uint32_t BlockSize () const;
+		uint32_t BlocksUsed () const;
+		uint32_t Rejected () const;		// arrays too large or without a block
+
+	private:
+		uint32_t items;
+		uint32_t blocks;
+		uint32_t block_words;
+		std::unique_ptr<std::atomic<uint32_t>[]> item_block;	// block + 1, 0: none
+		std::unique_ptr<SeqCounter[]> block_seq;
+		std::unique_ptr<SeqWords<Opc_array_info>[]> block_info;
+		std::unique_ptr<std::atomic<uint32_t>[]> words;
+		std::atomic<uint32_t> next_block;
+		std::atomic<uint32_t> rejected;
+	};
+
+#endif // _SOCARRAYARENA_H
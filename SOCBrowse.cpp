@@ -0,0 +1,613 @@
+//
+// C++ class to build and keep a cached index of the OPC server address
+// space (item IDs, data types and access rights).
+//
+// The index file is a small binary file: a header followed by one record
+// per branch and one per item, each sorted by ID. Since sibling items
+// share long prefixes (e.g. "Bucket Brigade."), each ID is stored as the
+// number of characters it shares with the previous one plus the remaining
+// suffix.
+//
+
+#include <stdio.h>
+#include <time.h>
+#include <algorithm>
+#include "opcerror.h"
+#include "SOCBrowse.h"
+
+#define OPC_INDEX_MAGIC 0x5844494F	// "OIDX"
+#define OPC_INDEX_VERSION 2
+
+// Number of elements requested from the server per browse call
+#define BROWSE_CHUNK 256
+
+// Properties read for every item
+static DWORD BrowsePropertyIDs[2] = { OPC_PROPERTY_DATATYPE, OPC_PROPERTY_ACCESS_RIGHTS };
+
+//	Constructor. The index starts empty; call Load() and/or Refresh().
+SOCBrowseIndex::SOCBrowseIndex (const wchar_t* server_name, const char* index_path)
+{
+	this->server_name = server_name;
+	this->index_path = index_path;
+	built_at = 0;
+}
+
+/////////////////////////////////////////////////////////////////////////
+// Index file I/O
+//
+// Header: magic, version, server name, time of the last full walk. Then
+// the branches and the items, each sorted by ID; an item records the
+// position of its branch in the branch table.
+//
+static bool WriteWord (FILE* f, WORD w)   { return fwrite(&w, sizeof(w), 1, f) == 1; }
+static bool WriteDword (FILE* f, DWORD d) { return fwrite(&d, sizeof(d), 1, f) == 1; }
+static bool ReadWord (FILE* f, WORD& w)   { return fread(&w, sizeof(w), 1, f) == 1; }
+static bool ReadDword (FILE* f, DWORD& d) { return fread(&d, sizeof(d), 1, f) == 1; }
+
+// "id" as the length of the prefix it shares with "previous", the length
+// of the rest and the rest
+static bool WriteId (FILE* f, const std::wstring* previous, const std::wstring& id)
+{
+	size_t shared = 0;
+	if (previous != NULL)
+		while (shared < previous->size() && shared < id.size() &&
+			   (*previous)[shared] == id[shared] && shared < 0xFFFF)
+			shared++;
+	size_t suffix = id.size() - shared;
+
+	return WriteWord(f, (WORD) shared) &&
+		   WriteWord(f, (WORD) suffix) &&
+		   fwrite(id.data() + shared, sizeof(wchar_t), suffix, f) == suffix;
+}
+
+static bool ReadId (FILE* f, const std::wstring& previous, std::wstring& id)
+{
+	WORD shared, suffix;
+	if (!ReadWord(f, shared) || !ReadWord(f, suffix) || shared > previous.size())
+		return false;
+	id.assign(previous, 0, shared);
+	id.resize(shared + suffix);
+	return fread(&id[shared], sizeof(wchar_t), suffix, f) == suffix;
+}
+
+bool SOCBrowseIndex::Save () const
+{
+	FILE* f = fopen(index_path.c_str(), "wb");
+	if (f == NULL){
+		printf("SOCBrowseIndex: cannot write %s\n", index_path.c_str());
+		return false;
+	}
+
+	bool ok = WriteDword(f, OPC_INDEX_MAGIC) &&
+			  WriteDword(f, OPC_INDEX_VERSION) &&
+			  WriteWord(f, (WORD) server_name.size()) &&
+			  fwrite(server_name.data(), sizeof(wchar_t), server_name.size(), f) == server_name.size() &&
+			  WriteDword(f, (DWORD) built_at) &&
+			  WriteDword(f, (DWORD) (built_at >> 32)) &&
+			  WriteDword(f, (DWORD) branches.size());
+
+	for (size_t i = 0; ok && i < branches.size(); i++)
+		ok = WriteId(f, i > 0 ? &branches[i - 1] : NULL, branches[i]);
+
+	ok = ok && WriteDword(f, (DWORD) items.size());
+	for (size_t i = 0; ok && i < items.size(); i++){
+		DWORD branch = (DWORD) (std::lower_bound(branches.begin(), branches.end(), items[i].branch) -
+			branches.begin());
+		ok = WriteWord(f, items[i].type) &&
+			 WriteWord(f, (WORD) items[i].access_rights) &&
+			 WriteDword(f, branch) &&
+			 WriteId(f, i > 0 ? &items[i - 1].item_id : NULL, items[i].item_id);
+	}
+
+	fclose(f);
+	if (!ok) printf("SOCBrowseIndex: failed to write %s\n", index_path.c_str());
+	return ok;
+}
+
+bool SOCBrowseIndex::Load ()
+{
+	DWORD magic, version, count, built_low, built_high;
+	WORD name_length;
+
+	FILE* f = fopen(index_path.c_str(), "rb");
+	if (f == NULL)
+		return false;
+
+	// An index of an older version is rebuilt by a full walk
+	if (!ReadDword(f, magic) || magic != OPC_INDEX_MAGIC ||
+		!ReadDword(f, version) || version != OPC_INDEX_VERSION ||
+		!ReadWord(f, name_length)){
+		fclose(f);
+		return false;
+	}
+
+	// Reject an index built for another server
+	std::wstring name(name_length, L'\0');
+	if (fread(&name[0], sizeof(wchar_t), name_length, f) != name_length ||
+		name != server_name || !ReadDword(f, built_low) || !ReadDword(f, built_high) ||
+		!ReadDword(f, count)){
+		fclose(f);
+		return false;
+	}
+
+	std::vector<std::wstring> loaded_branches;
+	std::wstring previous;
+	bool ok = true;
+	for (DWORD i = 0; ok && i < count; i++){
+		std::wstring branch;
+		ok = ReadId(f, previous, branch);
+		previous = branch;
+		loaded_branches.push_back(branch);
+	}
+
+	std::vector<Opc_browse_item> loaded;
+	ok = ok && ReadDword(f, count);
+	previous.clear();
+	for (DWORD i = 0; ok && i < count; i++){
+		WORD type, rights;
+		DWORD branch;
+		Opc_browse_item item;
+		ok = ReadWord(f, type) && ReadWord(f, rights) && ReadDword(f, branch) &&
+			 branch < loaded_branches.size() && ReadId(f, previous, item.item_id);
+		if (!ok) break;
+
+		item.branch = loaded_branches[branch];
+		item.type = type;
+		item.access_rights = rights;
+		previous = item.item_id;
+		loaded.push_back(item);
+	}
+	fclose(f);
+
+	if (!ok){
+		printf("SOCBrowseIndex: %s is corrupted, ignoring it\n", index_path.c_str());
+		return false;
+	}
+	items.swap(loaded);
+	branches.swap(loaded_branches);
+	built_at = ((ULONGLONG) built_high << 32) | built_low;
+	return true;
+}
+
+/////////////////////////////////////////////////////////////////////////
+// Browsing, one branch at a time. Only item IDs are collected here;
+// properties are read later, and only for the items that need them.
+//
+
+// Drain an IEnumString in chunks, passing each string to "use" and
+// freeing it afterwards.
+template <class F>
+static void DrainEnumString (IEnumString* pEnum, F use)
+{
+	LPOLESTR names[BROWSE_CHUNK];
+	ULONG fetched = 0;
+	HRESULT hr;
+
+	do {
+		hr = pEnum->Next(BROWSE_CHUNK, names, &fetched);
+		for (ULONG i = 0; i < fetched; i++){
+			use(names[i]);
+			CoTaskMemFree(names[i]);
+		}
+	} while (hr == S_OK);
+}
+
+// **************************************************************************
+// The browse interface of a server: OPC DA 3.0 IOPCBrowse when it has it,
+// IOPCBrowseServerAddressSpace otherwise.
+class SOCBrowser
+	{
+	public:
+		SOCBrowser () : pIOPCBrowse(NULL), pIBrowse(NULL), flat(false) {}
+		~SOCBrowser ()
+		{
+			if (pIOPCBrowse != NULL) pIOPCBrowse->Release();
+			if (pIBrowse != NULL) pIBrowse->Release();
+		}
+
+		bool Open (IOPCServer* pIOPCServer)
+		{
+			HRESULT hr;
+
+			// Prefer the OPC DA 3.0 interface, fall back on the DA 2.0 one.
+			hr = pIOPCServer->QueryInterface(__uuidof(pIOPCBrowse), (void**) &pIOPCBrowse);
+			if (hr == S_OK)
+				return true;
+			pIOPCBrowse = NULL;
+
+			hr = pIOPCServer->QueryInterface(__uuidof(pIBrowse), (void**) &pIBrowse);
+			if (hr != S_OK){
+				printf("Could not obtain a pointer to IOPCBrowseServerAddressSpace. Error = %x\n", hr);
+				pIBrowse = NULL;
+				return false;
+			}
+			OPCNAMESPACETYPE nameSpaceType;
+			hr = pIBrowse->QueryOrganization(&nameSpaceType);
+			flat = (hr == S_OK && nameSpaceType == OPC_NS_FLAT);
+			return true;
+		}
+
+		// The items and sub-branches directly under "branch" ("" for the
+		// root). Returns false if the branch cannot be browsed.
+		bool Branch (const std::wstring& branch, std::vector<std::wstring>& leaves,
+					 std::vector<std::wstring>& sub_branches)
+		{
+			if (pIOPCBrowse != NULL)
+				return Branch3(branch, leaves, sub_branches);
+			return Branch2(branch, leaves, sub_branches);
+		}
+
+		IOPCBrowse* Browse3 () const { return pIOPCBrowse; }
+
+	private:
+		// OPC DA 3.0: IOPCBrowse::Browse(), following the continuation
+		// points of large branches.
+		bool Branch3 (const std::wstring& branch, std::vector<std::wstring>& leaves,
+					  std::vector<std::wstring>& sub_branches)
+		{
+			HRESULT hr;
+			LPWSTR szContinuationPoint = NULL;
+			BOOL bMoreElements = FALSE;
+			DWORD dwMaxElements = BROWSE_CHUNK;
+			size_t first_leaf = leaves.size();
+			size_t first_branch = sub_branches.size();
+			bool retry;
+
+			do {
+				DWORD dwCount = 0;
+				OPCBROWSEELEMENT* pElements = NULL;
+
+				hr = pIOPCBrowse->Browse((LPWSTR) branch.c_str(), &szContinuationPoint,
+					dwMaxElements, OPC_BROWSE_FILTER_ALL, L"", L"",
+					/*bReturnAllProperties*/ FALSE, /*bReturnPropertyValues*/ FALSE,
+					0, NULL, &bMoreElements, &dwCount, &pElements);
+				if (FAILED(hr)){
+					printf("Failed call to IOPCBrowse::Browse. Error = %x\n", hr);
+					CoTaskMemFree(szContinuationPoint);
+					return false;
+				}
+
+				for (DWORD i = 0; i < dwCount; i++){
+					if (pElements[i].dwFlagValue & OPC_BROWSE_ISITEM)
+						leaves.push_back(pElements[i].szItemID);
+					if (pElements[i].dwFlagValue & OPC_BROWSE_HASCHILDREN)
+						sub_branches.push_back(pElements[i].szItemID);
+
+					// release memory allocated by the server:
+					CoTaskMemFree(pElements[i].szName);
+					CoTaskMemFree(pElements[i].szItemID);
+					CoTaskMemFree(pElements[i].ItemProperties.pItemProperties);
+				}
+				CoTaskMemFree(pElements);
+
+				// A server that does not support continuation points only
+				// tells that elements were left out; browse the branch again
+				// without a limit, dropping what the first call returned.
+				bool has_continuation = szContinuationPoint != NULL && *szContinuationPoint != L'\0';
+				retry = bMoreElements && !has_continuation && dwMaxElements != 0;
+				if (retry){
+					dwMaxElements = 0;
+					leaves.resize(first_leaf);
+					sub_branches.resize(first_branch);
+				}
+				if (has_continuation) retry = true;
+			} while (retry);
+			CoTaskMemFree(szContinuationPoint);
+			return true;
+		}
+
+		// OPC DA 2.0: move the server-side browse position to the branch
+		// and list it. Branches are addressed by their item ID
+		// (GetItemID()), so that any of them can be browsed again alone.
+		bool Branch2 (const std::wstring& branch, std::vector<std::wstring>& leaves,
+					  std::vector<std::wstring>& sub_branches)
+		{
+			HRESULT hr;
+			IEnumString* pEnum = NULL;
+			std::vector<std::wstring> names;
+
+			if (flat){
+				// A flat namespace lists the fully qualified item IDs directly
+				hr = pIBrowse->BrowseOPCItemIDs(OPC_FLAT, L"", VT_EMPTY, 0, &pEnum);
+				if (FAILED(hr)){
+					printf("Failed call to BrowseOPCItemIDs. Error = %x\n", hr);
+					return false;
+				}
+				if (pEnum != NULL){
+					DrainEnumString(pEnum, [&](LPOLESTR name) { leaves.push_back(name); });
+					pEnum->Release();
+				}
+				return true;
+			}
+
+			hr = pIBrowse->ChangeBrowsePosition(OPC_BROWSE_TO, branch.c_str());
+			if (FAILED(hr)){
+				printf("Failed call to ChangeBrowsePosition. Error = %x\n", hr);
+				return false;
+			}
+
+			// Collect the names first: the browse position must not change
+			// while an enumerator is in use.
+			for (int pass = 0; pass < 2; pass++){
+				OPCBROWSETYPE type = (pass == 0) ? OPC_LEAF : OPC_BRANCH;
+				std::vector<std::wstring>& ids = (pass == 0) ? leaves : sub_branches;
+
+				names.clear();
+				pEnum = NULL;
+				hr = pIBrowse->BrowseOPCItemIDs(type, L"", VT_EMPTY, 0, &pEnum);
+				if (FAILED(hr)){
+					printf("Failed call to BrowseOPCItemIDs. Error = %x\n", hr);
+					return false;
+				}
+				if (pEnum != NULL){
+					DrainEnumString(pEnum, [&](LPOLESTR name) { names.push_back(name); });
+					pEnum->Release();
+				}
+				for (size_t i = 0; i < names.size(); i++){
+					LPWSTR szItemID = NULL;
+					if (pIBrowse->GetItemID((LPWSTR) names[i].c_str(), &szItemID) == S_OK){
+						ids.push_back(szItemID);
+						CoTaskMemFree(szItemID);
+					}
+				}
+			}
+			return true;
+		}
+
+		IOPCBrowse* pIOPCBrowse;
+		IOPCBrowseServerAddressSpace* pIBrowse;
+		bool flat;
+	};
+
+// Every item and branch under "root", which is included
+static bool BrowseTree (SOCBrowser& browser, const std::wstring& root,
+						std::vector<Opc_browse_item>& found, std::vector<std::wstring>& found_branches)
+{
+	std::vector<std::wstring> pending(1, root);
+
+	while (!pending.empty()){
+		std::wstring branch = pending.back();
+		std::vector<std::wstring> leaves, sub_branches;
+		pending.pop_back();
+
+		if (!browser.Branch(branch, leaves, sub_branches))
+			return false;
+		found_branches.push_back(branch);
+		for (size_t i = 0; i < leaves.size(); i++){
+			Opc_browse_item item;
+			item.item_id = leaves[i];
+			item.branch = branch;
+			item.type = VT_EMPTY;
+			item.access_rights = 0;
+			found.push_back(item);
+		}
+		pending.insert(pending.end(), sub_branches.begin(), sub_branches.end());
+	}
+	return true;
+}
+
+// Read data type and access rights of the given items. OPC DA 3.0 servers
+// answer for all the items in one call; older ones item by item. On
+// return, known[i] is false if the server does not know items[i] (any
+// more). Returns false if the properties could not be read at all.
+static bool FetchProperties (IOPCServer* pIOPCServer, IOPCBrowse* pIOPCBrowse,
+							 std::vector<Opc_browse_item>& items, std::vector<bool>& known)
+{
+	HRESULT hr;
+
+	known.assign(items.size(), true);
+	if (items.empty()) return true;
+
+	if (pIOPCBrowse != NULL){
+		std::vector<LPWSTR> pszItemIDs(items.size());
+		for (size_t i = 0; i < items.size(); i++)
+			pszItemIDs[i] = (LPWSTR) items[i].item_id.c_str();
+
+		OPCITEMPROPERTIES* pItemProperties = NULL;
+		hr = pIOPCBrowse->GetProperties((DWORD) items.size(), pszItemIDs.data(), TRUE,
+			2, BrowsePropertyIDs, &pItemProperties);
+		if (FAILED(hr)){
+			printf("Failed call to IOPCBrowse::GetProperties. Error = %x\n", hr);
+			return false;
+		}
+		for (size_t i = 0; i < items.size(); i++){
+			OPCITEMPROPERTIES& props = pItemProperties[i];
+			if (props.hrErrorID == OPC_E_UNKNOWNITEMID || props.hrErrorID == OPC_E_INVALIDITEMID)
+				known[i] = false;
+			for (DWORD p = 0; p < props.dwNumProperties; p++){
+				OPCITEMPROPERTY& prop = props.pItemProperties[p];
+				if (SUCCEEDED(prop.hrErrorID)){
+					if (prop.dwPropertyID == OPC_PROPERTY_DATATYPE)
+						items[i].type = prop.vValue.iVal;
+					else if (prop.dwPropertyID == OPC_PROPERTY_ACCESS_RIGHTS)
+						items[i].access_rights = prop.vValue.lVal;
+				}
+				// release memory allocated by the server:
+				CoTaskMemFree(prop.szItemID);
+				CoTaskMemFree(prop.szDescription);
+				VariantClear(&prop.vValue);
+			}
+			CoTaskMemFree(props.pItemProperties);
+		}
+		CoTaskMemFree(pItemProperties);
+		return true;
+	}
+
+	IOPCItemProperties* pIOPCItemProperties = NULL;
+	hr = pIOPCServer->QueryInterface(__uuidof(pIOPCItemProperties), (void**) &pIOPCItemProperties);
+	if (hr != S_OK){
+		printf("Could not obtain a pointer to IOPCItemProperties. Error = %x\n", hr);
+		return false;
+	}
+	for (size_t i = 0; i < items.size(); i++){
+		VARIANT* pvData = NULL;
+		HRESULT* pErrors = NULL;
+		hr = pIOPCItemProperties->GetItemProperties((LPWSTR) items[i].item_id.c_str(), 2,
+			BrowsePropertyIDs, &pvData, &pErrors);
+		if (hr == OPC_E_UNKNOWNITEMID || hr == OPC_E_INVALIDITEMID)
+			known[i] = false;
+		if (FAILED(hr)) continue;
+		if (SUCCEEDED(pErrors[0])) items[i].type = pvData[0].iVal;
+		if (SUCCEEDED(pErrors[1])) items[i].access_rights = pvData[1].lVal;
+		VariantClear(&pvData[0]);
+		VariantClear(&pvData[1]);
+		CoTaskMemFree(pvData);
+		CoTaskMemFree(pErrors);
+	}
+	pIOPCItemProperties->Release();
+	return true;
+}
+
+static bool ItemLess (const Opc_browse_item& a, const Opc_browse_item& b)
+{
+	return a.item_id < b.item_id;
+}
+
+// Sort by item ID and drop duplicates (an item listed by two branches)
+static void SortItems (std::vector<Opc_browse_item>& items)
+{
+	std::stable_sort(items.begin(), items.end(), ItemLess);
+	items.erase(std::unique(items.begin(), items.end(),
+		[](const Opc_browse_item& a, const Opc_browse_item& b) { return a.item_id == b.item_id; }),
+		items.end());
+}
+
+static void SortBranches (std::vector<std::wstring>& branches)
+{
+	std::sort(branches.begin(), branches.end());
+	branches.erase(std::unique(branches.begin(), branches.end()), branches.end());
+}
+
+bool SOCBrowseIndex::Refresh (IOPCServer* pIOPCServer, bool full)
+{
+	SOCBrowser browser;
+
+	if (!browser.Open(pIOPCServer))
+		return false;
+
+	ULONGLONG now = (ULONGLONG) time(NULL);
+	if (full || branches.empty() || now - built_at > OPC_INDEX_MAX_AGE)
+		return Walk(browser, pIOPCServer);
+	return Revalidate(browser, pIOPCServer);
+}
+
+// Walk the whole namespace and read the properties of every item
+bool SOCBrowseIndex::Walk (SOCBrowser& browser, IOPCServer* pIOPCServer)
+{
+	std::vector<Opc_browse_item> found;
+	std::vector<std::wstring> found_branches;
+	std::vector<bool> known;
+
+	if (!BrowseTree(browser, L"", found, found_branches))
+		return false;
+	SortItems(found);
+	SortBranches(found_branches);
+	if (!FetchProperties(pIOPCServer, browser.Browse3(), found, known))
+		return false;
+
+	size_t added = 0;
+	for (size_t i = 0; i < found.size(); i++)
+		if (Find(found[i].item_id.c_str()) == NULL) added++;
+	printf("Indice OPC: %u itens (%u novos, %u removidos), %u ramos percorridos\n",
+		   (unsigned) found.size(), (unsigned) added, (unsigned) (items.size() + added - found.size()),
+		   (unsigned) found_branches.size());
+	items.swap(found);
+	branches.swap(found_branches);
+	built_at = (ULONGLONG) time(NULL);
+	return true;
+}
+
+// Read the properties of the cached items in bulk, which also tells which
+// ones are gone, and browse again only the branches that lost items. New
+// branches found there are walked whole.
+bool SOCBrowseIndex::Revalidate (SOCBrowser& browser, IOPCServer* pIOPCServer)
+{
+	std::vector<Opc_browse_item> checked(items);
+	std::vector<bool> known;
+
+	if (!FetchProperties(pIOPCServer, browser.Browse3(), checked, known))
+		return false;
+
+	std::vector<std::wstring> changed;
+	for (size_t i = 0; i < checked.size(); i++)
+		if (!known[i]) changed.push_back(checked[i].branch);
+	SortBranches(changed);
+
+	// Items of the unchanged branches stand as checked
+	std::vector<Opc_browse_item> merged;
+	std::vector<std::wstring> merged_branches;
+	for (size_t i = 0; i < checked.size(); i++)
+		if (!std::binary_search(changed.begin(), changed.end(), checked[i].branch))
+			merged.push_back(checked[i]);
+	for (size_t i = 0; i < branches.size(); i++)
+		if (!std::binary_search(changed.begin(), changed.end(), branches[i]))
+			merged_branches.push_back(branches[i]);
+
+	// The changed branches as they are now. A branch that can no longer
+	// be browsed is gone, with its items.
+	std::vector<Opc_browse_item> found;
+	for (size_t b = 0; b < changed.size(); b++){
+		std::vector<std::wstring> leaves, sub_branches;
+		if (!browser.Branch(changed[b], leaves, sub_branches))
+			continue;
+		merged_branches.push_back(changed[b]);
+
+		for (size_t i = 0; i < leaves.size(); i++){
+			Opc_browse_item item;
+			item.item_id = leaves[i];
+			item.branch = changed[b];
+			item.type = VT_EMPTY;
+			item.access_rights = 0;
+			found.push_back(item);
+		}
+		for (size_t i = 0; i < sub_branches.size(); i++){
+			if (std::binary_search(branches.begin(), branches.end(), sub_branches[i]))
+				continue;
+			if (!BrowseTree(browser, sub_branches[i], found, merged_branches))
+				return false;
+		}
+	}
+
+	// Properties of what the changed branches hold: kept for the items
+	// still known, read for the new ones
+	std::vector<Opc_browse_item> unknown;
+	for (size_t i = 0; i < found.size(); i++){
+		std::vector<Opc_browse_item>::const_iterator it = std::lower_bound(
+			checked.begin(), checked.end(), found[i], ItemLess);
+		if (it != checked.end() && it->item_id == found[i].item_id && known[it - checked.begin()])
+			merged.push_back(*it);
+		else
+			unknown.push_back(found[i]);
+	}
+	if (!FetchProperties(pIOPCServer, browser.Browse3(), unknown, known))
+		return false;
+	merged.insert(merged.end(), unknown.begin(), unknown.end());
+	SortItems(merged);
+	SortBranches(merged_branches);
+
+	size_t added = 0;
+	for (size_t i = 0; i < merged.size(); i++)
+		if (Find(merged[i].item_id.c_str()) == NULL) added++;
+	printf("Indice OPC: %u itens (%u novos, %u removidos), %u de %u ramos relidos\n",
+		   (unsigned) merged.size(), (unsigned) added, (unsigned) (items.size() + added - merged.size()),
+		   (unsigned) changed.size(), (unsigned) branches.size());
+	items.swap(merged);
+	branches.swap(merged_branches);
+	return true;
+}
+
+const std::vector<Opc_browse_item>& SOCBrowseIndex::Items () const
+{
+	return items;
+}
+
+const Opc_browse_item* SOCBrowseIndex::Find (const wchar_t* item_id) const
+{
+	Opc_browse_item key;
+	key.item_id = item_id;
+	std::vector<Opc_browse_item>::const_iterator it =
+		std::lower_bound(items.begin(), items.end(), key, ItemLess);
+	if (it == items.end() || it->item_id != key.item_id)
+		return NULL;
+	return &*it;
+}
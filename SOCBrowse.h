@@ -0,0 +1,68 @@
+// Class for keeping a cached index of the OPC server address space.
+//
+// The server namespace is walked through the OPC DA 3.0 IOPCBrowse
+// interface, or through IOPCBrowseServerAddressSpace on older servers, and
+// the item IDs found are kept together with the branch they were found in,
+// their canonical data type and their access rights. The index is saved to
+// disk, so that later startups do not walk the namespace again: the cached
+// items are revalidated by reading their properties in bulk, and only the
+// branches that lost items are browsed again. Items added to a branch
+// that lost none are only found by a full walk, which is done when the
+// saved index is older than OPC_INDEX_MAX_AGE.
+//
+
+#include "opcda.h"
+
+#ifndef _SOCBROWSE_H
+#define _SOCBROWSE_H
+
+#include <string>
+#include <vector>
+
+#define OPC_INDEX_FILE "opc_index.bin"
+#define OPC_INDEX_MAX_AGE (24 * 3600)	// s; an older index is rebuilt by a full walk
+
+struct Opc_browse_item {
+	std::wstring item_id;
+	std::wstring branch;	// item ID of the branch holding it ("" for the root)
+	VARTYPE type;			// canonical data type (OPC_PROPERTY_DATATYPE)
+	DWORD access_rights;	// OPC_READABLE | OPC_WRITEABLE (OPC_PROPERTY_ACCESS_RIGHTS)
+};
+
+class SOCBrowser;
+
+// **************************************************************************
+class SOCBrowseIndex
+	{
+	public:
+		SOCBrowseIndex (const wchar_t* server_name, const char* index_path);
+
+		// Read the index saved by a previous run. Returns false if there is
+		// none, or if it was built for another server.
+		bool Load ();
+		bool Save () const;
+
+		// Bring the index up to date with the server. A loaded index is
+		// revalidated and only the branches that changed are browsed
+		// again; with "full" set, with no index, or with one older than
+		// OPC_INDEX_MAX_AGE, the whole namespace is walked and every
+		// property read again. Returns false if the server could not be
+		// browsed; the index is then left untouched.
+		bool Refresh (IOPCServer* pIOPCServer, bool full = false);
+
+		// Items sorted by item ID
+		const std::vector<Opc_browse_item>& Items () const;
+		const Opc_browse_item* Find (const wchar_t* item_id) const;
+
+	private:
+		bool Walk (SOCBrowser& browser, IOPCServer* pIOPCServer);
+		bool Revalidate (SOCBrowser& browser, IOPCServer* pIOPCServer);
+
+		std::wstring server_name;
+		std::string index_path;
+		std::vector<Opc_browse_item> items;
+		std::vector<std::wstring> branches;	// every branch walked, sorted
+		ULONGLONG built_at;					// time() of the last full walk
+	};
+
+#endif // _SOCBROWSE_H
@@ -0,0 +1,77 @@
+// Cycle-time statistics of a periodic loop.
+//
+// For every cycle run on schedule the monitor records the start jitter
+// (how late the cycle started after its deadline) and the execution time,
+// each in a lock-free SOCHistogram, so the loop thread records with a few
+// atomic increments while any other thread prints. Deadlines the loop was
+// too late to run at all are counted as overruns, and runs out of
+// schedule (on demand) only record their execution time.
+//
+// All times are in microseconds.
+//
+
+#ifndef _SOCCYCLEMONITOR_H
+#define _SOCCYCLEMONITOR_H
+
+#include <atomic>
+#include <stdio.h>
+#include <stdint.h>
+#include "SOCHistogram.h"
+
+// **************************************************************************
+class SOCCycleMonitor
+	{
+	public:
+		SOCCycleMonitor (const char* name = "") : name(name), cycles(0), extra_runs(0), overruns(0) {}
+
+		void SetName (const char* name) { this->name = name; }
+		const char* Name () const { return name; }
+
+		// A cycle run on schedule
+		void Cycle (int64_t jitter, int64_t exec)
+		{
+			start_jitter.Record(jitter);
+			exec_time.Record(exec);
+			cycles.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		// A run out of schedule
+		void Extra (int64_t exec)
+		{
+			exec_time.Record(exec);
+			extra_runs.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		// Deadlines skipped because the loop was late
+		void Missed (uint32_t n)
+		{
+			overruns.fetch_add(n, std::memory_order_relaxed);
+		}
+
+		uint32_t Cycles () const { return cycles.load(std::memory_order_relaxed); }
+		uint32_t ExtraRuns () const { return extra_runs.load(std::memory_order_relaxed); }
+		uint32_t Overruns () const { return overruns.load(std::memory_order_relaxed); }
+		const SOCHistogram& Jitter () const { return start_jitter; }
+		const SOCHistogram& ExecTime () const { return exec_time; }
+
+		void Print () const
+		{
+			char title[128];
+			printf("Ciclo %s: %u ciclos, %u execucoes extras, %u periodos perdidos\n",
+				name, Cycles(), ExtraRuns(), Overruns());
+			snprintf(title, sizeof(title), "  %s atraso de inicio", name);
+			start_jitter.Print(title);
+			snprintf(title, sizeof(title), "  %s tempo de execucao", name);
+			exec_time.Print(title);
+		}
+
+	private:
+		const char* name;
+		SOCHistogram start_jitter;
+		SOCHistogram exec_time;
+		std::atomic<uint32_t> cycles;
+		std::atomic<uint32_t> extra_runs;
+		std::atomic<uint32_t> overruns;
+	};
+
+#endif // _SOCCYCLEMONITOR_H
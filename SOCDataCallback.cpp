@@ -8,31 +8,28 @@
 //
 
 #include <stdio.h>
+#include <vector>
+#include <algorithm>
 #include "SOCDataCallback.h"
+#include "SOCItemRegistry.h"
 #include "SOCWrapperFunctions.h"
 
 extern UINT OPC_DATA_TIME;
 
 //	Constructor.  Reference count is initialized to zero.
-SOCDataCallback::SOCDataCallback (
-	Opc_item* taxa_rec_real,
-	Opc_item* potencia,
-	Opc_item* temp_transl,
-	Opc_item* temp_roda,
-	Status_rec* status,
-	std::mutex * opc_mutex
-) {
+SOCDataCallback::SOCDataCallback (SOCItemRegistry* registry, SOCSampleRing* ring) {
 	m_cnRef = 0;
-	this->taxa_rec_real = taxa_rec_real;
-	this->potencia = potencia;
-	this->temp_transl = temp_transl;
-	this->temp_roda = temp_roda;
-	this->status = status; 
-	this->opc_mutex = opc_mutex;
+	this->registry = registry;
+	this->ring = ring;
+	this->last_callback_tick = GetTickCount64();
+	worker_running = false;
+	samples_event = CreateEvent(NULL, FALSE, FALSE, NULL);
 }
 
 //	Destructor
 SOCDataCallback::~SOCDataCallback (){
+	StopWorker();
+	CloseHandle(samples_event);
 }
 
 // IUnknown methods
@@ -110,20 +107,19 @@ HRESULT STDMETHODCALLTYPE SOCDataCallback::OnDataChange(
 	FILETIME *pftTimeStamps,
 	HRESULT *pErrors)
 {
-	FILETIME lft;
-	SYSTEMTIME st;
-    char szLocalDate[255], szLocalTime[255];
-	bool status;
-	char buffer[100];
-	WORD quality;
+	// Any call, data or not, proves the server is still alive.
+	last_callback_tick = GetTickCount64();
+
+	// A keep-alive notification (see SetGroupKeepAlive()) carries no items.
+	if (dwCount == 0)
+		return (S_OK);
 
 	// Validate arguments.  Return with "invalid argument" error code 
 	// if any are invalid. KEPWARE�s original code checks also if the
 	// "hgroup" parameter (the client�s handle for the group) was also
 	// NULL, but we dropped this check since the Simple OPC Client
 	// sets the client handle to 0 ...
-	if (dwCount					== 0	||
-		phClientItems			== NULL	||
+	if (phClientItems			== NULL	||
 		pvValues				== NULL	||
 		pwQualities				== NULL	||
 		pftTimeStamps			== NULL	||
@@ -131,39 +127,170 @@ HRESULT STDMETHODCALLTYPE SOCDataCallback::OnDataChange(
 		printf("IOPCDataCallback::ONDataChange: invalid arguments.\n");
 		return (E_INVALIDARG);
 	}
-	int a=0;
-	
-	// Loop over items:
-	if(opc_mutex->try_lock())
+	// Copy the samples into the ring and return. Sorting, storing and
+	// fanning out happen on the worker thread (see WorkerLoop()), so the
+	// server's RPC thread is held only for the copy. Arrays are copied once,
+	// into the registry's array arena, and the ring only carries the
+	// version of the copy. Strings cannot be kept past this call and are
+	// not queued.
+	for (DWORD i = 0; i < dwCount; i++)
 	{
-		for (DWORD i = 0; i < dwCount; i++)
-		{
-			// Check which item handler the data corresponds to
-			if( phClientItems[i] == this->taxa_rec_real->id )
-			{
-				this->status->taxa_rec_real = pvValues[i].uintVal;
-			}
-			else if( phClientItems[i] == this->potencia->id )
-			{
-				this->status->potencia = pvValues[i].fltVal;
-			}
-			else if( phClientItems[i] == this->temp_transl->id )
-			{
-				this->status->temp_transl = pvValues[i].fltVal;
-			}
-			else if( phClientItems[i] == this->temp_roda->id )
-			{
-				this->status->temp_roda = pvValues[i].fltVal;
-			}
+		if (FAILED(pErrors[i])) continue;
+		VARTYPE vt = pvValues[i].vt;
+
+		Opc_ring_entry entry;
+		entry.client_handle = phClientItems[i];
+		entry.vt = vt;
+		entry.quality = pwQualities[i];
+		entry.value = pvValues[i].llVal;
+		entry.timestamp = pftTimeStamps[i];
+
+		if ((vt & VT_ARRAY) && !(vt & VT_BYREF)){
+			entry.value = QueueArray(phClientItems[i], vt & VT_TYPEMASK, pvValues[i].parray);
+			if (entry.value == 0) continue;
+		}
+		else if (vt == VT_DECIMAL){
+			// A DECIMAL fills the whole VARIANT, "vt" included, so llVal
+			// is not its value: it is queued as a double instead.
+			VARIANT r8;
+			VariantInit(&r8);
+			if (FAILED(VariantChangeType(&r8, &pvValues[i], 0, VT_R8))) continue;
+			entry.vt = VT_R8;
+			entry.value = r8.llVal;
 		}
-		opc_mutex->unlock();
+		else if ((vt & VT_BYREF) || vt == VT_BSTR ||
+			vt == VT_VARIANT || vt == VT_UNKNOWN || vt == VT_DISPATCH)
+			continue;
+
+		ring->Push(entry);
 	}
+	SetEvent(samples_event);
 
 	// Return "success" code.  Note this does not mean that there were no 
 	// errors reported by the OPC Server, only that we successfully processed
 	// the callback.
 	return (S_OK);
 }
+
+void SOCDataCallback::SetSampleHandler(Opc_sample_handler handler)
+{
+	this->sample_handler = handler;
+}
+
+// Copy an array into the registry's arena. Returns its version there, or
+// 0 if the array was not kept.
+uint32_t SOCDataCallback::QueueArray(OPCHANDLE client_handle, VARTYPE vt, SAFEARRAY* psa)
+{
+	void* data;
+	Opc_array_view view;
+	uint32_t version = 0;
+
+	if (psa == NULL || FAILED(SafeArrayAccessData(psa, &data)))
+		return 0;
+	if (ViewSafeArray(vt, psa, data, view))
+		version = registry->Arrays()->Put(client_handle, view);
+	SafeArrayUnaccessData(psa);
+	return version;
+}
+
+void SOCDataCallback::StartWorker()
+{
+	if (worker_running) return;
+	worker_running = true;
+	worker = std::thread(&SOCDataCallback::WorkerLoop, this);
+}
+
+void SOCDataCallback::StopWorker()
+{
+	if (!worker_running) return;
+	worker_running = false;
+	SetEvent(samples_event);
+	worker.join();
+}
+
+Opc_ring_stats SOCDataCallback::RingStats() const
+{
+	return ring->Stats();
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Consumer side of the sample ring. Samples are taken in chunks; each chunk
+// is sorted by source timestamp (with item buffering the server may deliver
+// several samples of an item, unsorted) and stored into the registry as a
+// single batch, so each item's slot ends up holding the newest value. A
+// stable sort keeps the arrival order for samples sharing a timestamp.
+//
+void SOCDataCallback::WorkerLoop()
+{
+	const uint32_t chunk = 256;
+	std::vector<Opc_ring_entry> entries(chunk);
+	std::vector<uint32_t> order(chunk);
+	std::vector<BYTE> array_buffer(registry->Arrays()->BlockSize());
+
+	while (worker_running)
+	{
+		uint32_t n = ring->Pop(entries.data(), chunk);
+		if (n == 0){
+			// The timeout only bounds the delay of a missed wake-up
+			WaitForSingleObject(samples_event, 100);
+			continue;
+		}
+
+		for (uint32_t i = 0; i < n; i++) order[i] = i;
+		std::stable_sort(order.begin(), order.begin() + n,
+			[&entries](uint32_t a, uint32_t b) {
+				return CompareFileTime(&entries[a].timestamp, &entries[b].timestamp) < 0;
+			});
+
+		// The worker is the only writer of the registry slots.
+		registry->BeginUpdate();
+		for (uint32_t k = 0; k < n; k++)
+		{
+			const Opc_ring_entry& e = entries[order[k]];
+			LONGLONG timestamp = FileTimeToEpoch(e.timestamp);
+			if (e.vt & VT_ARRAY){
+				registry->StoreArray(e.client_handle, e.vt & VT_TYPEMASK, (uint32_t) e.value,
+					e.quality, timestamp);
+				continue;
+			}
+			VARIANT value;
+			value.vt = e.vt;
+			value.llVal = e.value;
+			registry->Store(e.client_handle, value, e.quality, timestamp);
+		}
+		registry->EndUpdate();
+
+		// Pass every sample downstream, oldest first. An array is passed as
+		// the item's latest array, which may already be newer than the
+		// sample.
+		if (sample_handler)
+		{
+			for (uint32_t k = 0; k < n; k++)
+			{
+				const Opc_ring_entry& e = entries[order[k]];
+				VARIANT value;
+				Opc_safearray descriptor;
+				value.vt = e.vt;
+				value.llVal = e.value;
+				if (e.vt & VT_ARRAY){
+					Opc_array_info info;
+					if (!registry->CopyArray(e.client_handle, info, array_buffer.data(), array_buffer.size()))
+						continue;
+					MakeSafeArray(info, array_buffer.data(), descriptor);
+					value.parray = &descriptor.sa;
+				}
+				Opc_sample sample = { e.client_handle, &value, e.quality, e.timestamp };
+				sample_handler(sample);
+			}
+		}
+	}
+}
+
+ULONGLONG SOCDataCallback::LastCallbackTick() const
+{
+	return last_callback_tick;
+}
+
 // The remaining methods of IOPCDataCallback are not implemented here, so
 // we just use dummy functions that simply return S_OK.
 HRESULT STDMETHODCALLTYPE SOCDataCallback::OnReadComplete(
@@ -13,7 +13,10 @@
 #ifndef _SOCDATACALLBACK_H
 #define _SOCDATACALLBACK_H
 
-#include <mutex>
+#include <functional>
+#include <atomic>
+#include <thread>
+#include "SOCSampleRing.h"
 
 struct Posicao { 
 	float vel_transl; 
@@ -24,33 +27,54 @@ struct Posicao {
 };
 typedef struct Posicao Posicao;
 
+// A position with the times (epoch us) of the stages it went through on
+// its way from the web server to the OPC server
+struct Posicao_sample {
+	Posicao posicao;
+	uint32_t version;		// 1 for the first position received, 0: none
+	LONGLONG requested_at;	// "33" request sent
+	LONGLONG received_at;	// position frame received
+	LONGLONG parsed_at;		// position frame decoded
+};
+
 struct Status_rec {
 	unsigned int taxa_rec_real;
 	float potencia;
 	float temp_transl;
 	float temp_roda;
+	WORD quality;			// worst quality of the four values
+	LONGLONG timestamp;		// oldest source timestamp, epoch microseconds
 };
 typedef struct Status_rec Status_rec;
 
 struct Opc_item {
-	OPCHANDLE item_handle;
+	OPCHANDLE item_handle;		// 0 while not in the group
 	wchar_t *item_id;
 	int type;
 	int id;
 };
 
+// A single value delivered by the server. When item buffering is enabled
+// (see SetItemSampling()) one OnDataChange call may carry several samples
+// for the same client handle.
+struct Opc_sample {
+	OPCHANDLE client_handle;
+	VARIANT *value;
+	WORD quality;
+	FILETIME timestamp;
+};
+typedef std::function<void (const Opc_sample&)> Opc_sample_handler;
+
+class SOCItemRegistry;
+
 // **************************************************************************
+// OnDataChange() only copies the samples into "ring"; a worker thread
+// started with StartWorker() stores them into the registry and passes them
+// to the sample handler.
 class SOCDataCallback : public IOPCDataCallback
 	{
 	public:
-		SOCDataCallback::SOCDataCallback (
-			Opc_item* taxa_rec_real,
-			Opc_item* potencia,
-			Opc_item* temp_transl,
-			Opc_item* temp_roda,
-			Status_rec* status,
-			std::mutex * opc_mutex
-		);
+		SOCDataCallback::SOCDataCallback (SOCItemRegistry* registry, SOCSampleRing* ring);
 		~SOCDataCallback ();
 
 		// IUnknown Methods
@@ -95,14 +119,32 @@ class SOCDataCallback : public IOPCDataCallback
 			DWORD dwTransID,			// Transaction ID provided by the client when the read/write/refresh was initiated
 			OPCHANDLE hGroup);
 
+		// Optional consumer that receives every sample, in timestamp order,
+		// after it has been stored in the item registry. Called on the
+		// worker thread; set it before StartWorker().
+		void SetSampleHandler(Opc_sample_handler handler);
+
+		void StartWorker();
+		void StopWorker();
+		Opc_ring_stats RingStats() const;
+
+		// GetTickCount64() value of the last OnDataChange call, including
+		// the empty keep-alive calls. Used by the session watchdog.
+		ULONGLONG LastCallbackTick() const;
+
 	private:
+		void WorkerLoop();
+		uint32_t QueueArray(OPCHANDLE client_handle, VARTYPE vt, SAFEARRAY* psa);
+
 		DWORD m_cnRef;
-		Opc_item * taxa_rec_real;
-		Opc_item* potencia;
-		Opc_item* temp_transl;
-		Opc_item* temp_roda;
-		Status_rec * status;
-		std::mutex * opc_mutex;
+		SOCItemRegistry* registry;
+		SOCSampleRing* ring;
+		Opc_sample_handler sample_handler;
+		std::atomic<ULONGLONG> last_callback_tick;
+
+		std::thread worker;
+		std::atomic<bool> worker_running;
+		HANDLE samples_event;		// signaled by OnDataChange()
 	};
 
 
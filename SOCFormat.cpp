@@ -0,0 +1,239 @@
+//
+// Bounds-checked conversion of OPC values to text.
+//
+// Scalars are read through the type traits of SOCVarTraits.h, from the
+// VARIANT data union (whose members all start at the same address, so a
+// scalar and an array element are read by the same code).
+//
+
+#include <string.h>
+#include <math.h>
+#include <charconv>
+#include "SOCFormat.h"
+#include "SOCVarTraits.h"
+
+const Opc_format_profile OPC_FORMAT_TEXT	= { 0, -1, 0.0, 0.0, 0, 0 };
+const Opc_format_profile OPC_FORMAT_INT6	= { 6, -1, 0.0, 999999.0, 0, 999999 };
+const Opc_format_profile OPC_FORMAT_FLOAT6	= { 6, 1, 0.0, 9999.0, 0, 9999 };
+const Opc_format_profile OPC_FORMAT_EPOCH16	= { 16, -1, 0.0, 9999999999999999.0, 0, 9999999999999999LL };
+
+// A scalar of any type, widened
+struct Opc_number {
+	enum { SIGNED, UNSIGNED, REAL } kind;
+	LONGLONG i;
+	ULONGLONG u;
+	double d;
+};
+
+// Element of type "vt" at "p". Returns false for types without a
+// numeric value.
+static bool ReadNumber (VARTYPE vt, const void* p, Opc_number& n)
+{
+	n.kind = Opc_number::SIGNED;
+	n.i = 0;
+	n.u = 0;
+	n.d = 0.0;
+
+	// Currency is a scaled integer, not one of the plain scalar types
+	if (vt == VT_CY){
+		LONGLONG v;
+		memcpy(&v, p, sizeof(v));
+		n.kind = Opc_number::REAL;
+		n.d = v / 10000.0;
+		return true;
+	}
+
+	return VtDispatch(vt, [p, &n](auto traits) {
+		typedef decltype(traits) Tr;
+		auto v = Tr::Value(Tr::Decode(p));
+		if constexpr (std::is_floating_point<decltype(v)>::value){
+			n.kind = Opc_number::REAL;
+			n.d = v;
+		}
+		else if constexpr (std::is_signed<decltype(v)>::value)
+			n.i = v;
+		else {
+			n.kind = Opc_number::UNSIGNED;
+			n.u = v;
+		}
+	});
+}
+
+// Size in bytes of an array element of type "vt", 0 if not supported
+static size_t ElementSize (VARTYPE vt)
+{
+	return (vt == VT_CY) ? sizeof(CY) : VtSize(vt);
+}
+
+// Copy "digits" to "out", after the sign and the zero padding
+static size_t Emit (const char* digits, size_t n, bool negative, unsigned int width,
+					char* out, size_t size)
+{
+	size_t length = n + (negative ? 1 : 0);
+	size_t pad = (width > length) ? width - length : 0;
+
+	if (length + pad + 1 > size){
+		if (size > 0) out[0] = '\0';
+		return 0;
+	}
+	char* p = out;
+	if (negative) *p++ = '-';
+	memset(p, '0', pad);
+	p += pad;
+	memcpy(p, digits, n);
+	p += n;
+	*p = '\0';
+	return p - out;
+}
+
+// Result of std::to_chars into "tmp", split into sign and digits
+static size_t EmitChars (const char* tmp, const char* end, unsigned int width,
+						 char* out, size_t size)
+{
+	bool negative = (tmp < end && tmp[0] == '-');
+	if (negative) tmp++;
+	return Emit(tmp, end - tmp, negative, width, out, size);
+}
+
+size_t FormatDouble (double value, char* out, size_t size, const Opc_format_profile& profile)
+{
+	char tmp[400];		// DBL_MAX in fixed notation has 309 digits
+	std::to_chars_result r;
+
+	if (profile.min < profile.max){
+		if (value < profile.min) value = profile.min;
+		if (value > profile.max) value = profile.max;
+	}
+	if (!isfinite(value)){
+		r = std::to_chars(tmp, tmp + sizeof(tmp), value);
+		return Emit(tmp, r.ptr - tmp, false, 0, out, size);
+	}
+
+	if (profile.precision < 0)
+		r = std::to_chars(tmp, tmp + sizeof(tmp), value);
+	else
+		r = std::to_chars(tmp, tmp + sizeof(tmp), value, std::chars_format::fixed, profile.precision);
+	if (r.ec != std::errc()){
+		if (size > 0) out[0] = '\0';
+		return 0;
+	}
+	return EmitChars(tmp, r.ptr, profile.width, out, size);
+}
+
+size_t FormatInteger (LONGLONG value, char* out, size_t size, const Opc_format_profile& profile)
+{
+	char tmp[24];
+
+	if (profile.precision >= 0)
+		return FormatDouble((double) value, out, size, profile);
+	if (profile.int_min < profile.int_max){
+		if (value < profile.int_min) value = profile.int_min;
+		if (value > profile.int_max) value = profile.int_max;
+	}
+	std::to_chars_result r = std::to_chars(tmp, tmp + sizeof(tmp), value);
+	return EmitChars(tmp, r.ptr, profile.width, out, size);
+}
+
+static size_t FormatUnsigned (ULONGLONG value, char* out, size_t size, const Opc_format_profile& profile)
+{
+	char tmp[24];
+
+	if (profile.precision >= 0)
+		return FormatDouble((double) value, out, size, profile);
+	if (profile.int_min < profile.int_max){
+		if (profile.int_min > 0 && value < (ULONGLONG) profile.int_min) value = profile.int_min;
+		if (profile.int_max > 0 && value > (ULONGLONG) profile.int_max) value = profile.int_max;
+	}
+	std::to_chars_result r = std::to_chars(tmp, tmp + sizeof(tmp), value);
+	return EmitChars(tmp, r.ptr, profile.width, out, size);
+}
+
+static size_t FormatNumber (const Opc_number& n, char* out, size_t size, const Opc_format_profile& profile)
+{
+	switch (n.kind)
+	{
+		case Opc_number::SIGNED:	return FormatInteger(n.i, out, size, profile);
+		case Opc_number::UNSIGNED:	return FormatUnsigned(n.u, out, size, profile);
+		default:					return FormatDouble(n.d, out, size, profile);
+	}
+}
+
+size_t FormatArray (VARTYPE vt, const void* data, ULONG count, char* out, size_t size,
+					const Opc_format_profile& profile, ULONG* fitted)
+{
+	size_t element_size = ElementSize(vt);
+	size_t length = 0;
+	ULONG k;
+	Opc_number n;
+
+	if (fitted != NULL) *fitted = 0;
+	if (size > 0) out[0] = '\0';
+	if (element_size == 0 || (data == NULL && count > 0))
+		return 0;
+
+	for (k = 0; k < count; k++){
+		size_t start = length;
+		if (k > 0){
+			if (length + 2 > size)
+				break;
+			out[length++] = ',';
+		}
+		ReadNumber(vt, (const BYTE*) data + k * element_size, n);
+		size_t written = FormatNumber(n, out + length, size - length, profile);
+		if (written == 0){
+			length = start;
+			break;
+		}
+		length += written;
+	}
+	if (k < count && fitted == NULL)
+		length = 0;
+	if (fitted != NULL) *fitted = k;
+	if (length < size) out[length] = '\0';
+	return length;
+}
+
+size_t FormatVariant (const VARIANT& value, char* out, size_t size, const Opc_format_profile& profile)
+{
+	Opc_number n;
+
+	if (size == 0)
+		return 0;
+	out[0] = '\0';
+
+	if (value.vt & VT_ARRAY){
+		SAFEARRAY* psa = value.parray;
+		void* data;
+		if (psa == NULL || psa->cDims != 1 || (value.vt & VT_BYREF))
+			return 0;
+		if (FAILED(SafeArrayAccessData(psa, &data)))
+			return 0;
+		size_t length = FormatArray(value.vt & VT_TYPEMASK, data, psa->rgsabound[0].cElements,
+			out, size, profile);
+		SafeArrayUnaccessData(psa);
+		return length;
+	}
+
+	switch (value.vt)
+	{
+		case VT_EMPTY:
+		case VT_NULL:
+			return 0;
+		case VT_BSTR:
+		{
+			if (value.bstrVal == NULL)
+				return 0;
+			int chars = (int) wcslen(value.bstrVal);
+			if (chars == 0)
+				return 0;
+			int bytes = WideCharToMultiByte(CP_UTF8, 0, value.bstrVal, chars,
+				out, (int) size - 1, NULL, NULL);
+			out[bytes] = '\0';
+			return bytes;
+		}
+		default:
+			if (!ReadNumber(value.vt, &value.llVal, n))
+				return 0;
+			return FormatNumber(n, out, size, profile);
+	}
+}
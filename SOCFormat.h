@@ -0,0 +1,52 @@
+// Conversion of OPC values to text, for the console and for the frames
+// sent to the web server.
+//
+// Every function writes into a caller buffer of a given size, never past
+// it, and returns the length written (without the terminating NUL, which
+// is always added), or 0 if the value does not fit or has no text form.
+// Numbers are converted with std::to_chars, which does not depend on the
+// locale and does not parse a format string.
+//
+// A profile describes a fixed-width field of the wire format: the value is
+// clamped to [min, max], printed with "precision" decimals and padded with
+// leading zeros to "width" characters.
+//
+
+#include "opcda.h"
+
+#ifndef _SOCFORMAT_H
+#define _SOCFORMAT_H
+
+#include <stddef.h>
+
+struct Opc_format_profile {
+	unsigned int width;		// minimum width, zero padded (0: none)
+	int precision;			// decimals; -1 prints integers as such and
+							// floating point values in their shortest form
+	double min;				// values are clamped to [min, max] when
+	double max;				// min < max
+	LONGLONG int_min;		// and integers to [int_min, int_max] when
+	LONGLONG int_max;		// int_min < int_max (a double bound such as
+							// 9999999999999999.0 is not exact)
+};
+
+extern const Opc_format_profile OPC_FORMAT_TEXT;	// free format, for people
+extern const Opc_format_profile OPC_FORMAT_INT6;	// "000042", 0 to 999999
+extern const Opc_format_profile OPC_FORMAT_FLOAT6;	// "0042.5", 0.0 to 9999.0
+extern const Opc_format_profile OPC_FORMAT_EPOCH16;	// 16-digit epoch microseconds
+
+// Any scalar VARIANT, a VT_BSTR (as UTF-8) or a 1-D array of scalars
+// (elements separated by ',').
+size_t FormatVariant (const VARIANT& value, char* out, size_t size,
+					  const Opc_format_profile& profile = OPC_FORMAT_TEXT);
+
+// "count" elements of type "vt" (without VT_ARRAY) stored at "data". If
+// "fitted" is not NULL, an array that does not fit is cut after the last
+// element that does, and *fitted receives the number of elements written.
+size_t FormatArray (VARTYPE vt, const void* data, ULONG count, char* out, size_t size,
+					const Opc_format_profile& profile = OPC_FORMAT_TEXT, ULONG* fitted = NULL);
+
+size_t FormatInteger (LONGLONG value, char* out, size_t size, const Opc_format_profile& profile);
+size_t FormatDouble (double value, char* out, size_t size, const Opc_format_profile& profile);
+
+#endif // _SOCFORMAT_H
@@ -0,0 +1,127 @@
+//
+// C++ class splitting the byte stream from the web server into frames.
+//
+
+#include <string.h>
+#include "SOCFrameReader.h"
+
+//	Constructor
+SOCFrameReader::SOCFrameReader (size_t capacity)
+	: buffer(capacity > 1 ? capacity : 2), used(0), delimited(false), oversized(0)
+{
+}
+
+void SOCFrameReader::Reset (bool delimited)
+{
+	this->delimited = delimited;
+	used = 0;
+}
+
+bool SOCFrameReader::Delimited () const
+{
+	return delimited;
+}
+
+int SOCFrameReader::Next (SOCKET s, char* out, size_t size)
+{
+	if (size == 0)
+		return SOCKET_ERROR;
+
+	// One recv() is one frame
+	if (!delimited){
+		int n = recv(s, out, (int) size - 1, 0);
+		if (n <= 0)
+			return n;
+		out[n] = '\0';
+		return n;
+	}
+
+	while (!Pop(out, size)){
+		// Make room: a frame longer than the buffer cannot be completed
+		if (used == buffer.size()){
+			used = 0;
+			oversized++;
+		}
+		int n = recv(s, &buffer[used], (int) (buffer.size() - used), 0);
+		if (n <= 0)
+			return n;
+		used += n;
+	}
+	return (int) strlen(out);
+}
+
+int SOCFrameReader::Poll (SOCKET s, bool& closed)
+{
+	closed = false;
+	if (!delimited)
+		return 0;
+
+	int total = 0;
+	for (;;){
+		fd_set readable;
+		timeval no_wait = { 0, 0 };
+		FD_ZERO(&readable);
+		FD_SET(s, &readable);
+		if (select((int) s + 1, &readable, NULL, NULL, &no_wait) <= 0)
+			return total;
+
+		if (used == buffer.size()){
+			// Only frames left incomplete by the buffer size get here
+			used = 0;
+			oversized++;
+		}
+		int n = recv(s, &buffer[used], (int) (buffer.size() - used), 0);
+		if (n <= 0){
+			closed = true;
+			return total;
+		}
+		used += n;
+		total += n;
+	}
+}
+
+bool SOCFrameReader::Pop (char* out, size_t size)
+{
+	if (!delimited || used == 0)
+		return false;
+
+	char* end = (char*) memchr(&buffer[0], '\n', used);
+	if (end == NULL)
+		return false;
+
+	size_t length = end - &buffer[0];
+	size_t consumed = length + 1;
+	if (length > 0 && buffer[length - 1] == '\r')
+		length--;
+	if (length >= size){
+		oversized++;
+		length = 0;
+	}
+	memcpy(out, &buffer[0], length);
+	out[length] = '\0';
+	memmove(&buffer[0], &buffer[consumed], used - consumed);
+	used -= consumed;
+	return true;
+}
+
+bool SOCFrameReader::Buffered () const
+{
+	return delimited && used > 0 && memchr(&buffer[0], '\n', used) != NULL;
+}
+
+bool SOCFrameReader::Unread (const char* data, size_t length)
+{
+	if (!delimited || length > buffer.size() - used)
+		return false;
+	if (length == 0)
+		return true;
+	memmove(&buffer[length], &buffer[0], used);
+	memcpy(&buffer[0], data, length);
+	used += length;
+	return true;
+}
+
+unsigned int SOCFrameReader::Oversized () const
+{
+	return oversized;
+}
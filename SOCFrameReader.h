@@ -0,0 +1,65 @@
+// Reader of the frames sent by the web server.
+//
+// The original protocol has no delimiter: every frame is the reply to a
+// request, so one recv() returns one frame. Once the server pushes frames
+// of its own (see position subscriptions in SimpleOPCClient_v3.cpp),
+// several of them may arrive in one recv(), or one may be split across
+// two, so in that mode every frame ends with '\n' and the reader keeps the
+// bytes received past the end of a frame for the next one.
+//
+// Poll() takes what the socket holds without blocking, so that pushed
+// frames can be picked up between requests.
+//
+
+#include <winsock2.h>
+
+#ifndef _SOCFRAMEREADER_H
+#define _SOCFRAMEREADER_H
+
+#include <vector>
+
+// **************************************************************************
+class SOCFrameReader
+	{
+	public:
+		// "capacity" bounds the length of a frame
+		SOCFrameReader (size_t capacity);
+
+		// Start over on a new connection, or after the mode changed, losing
+		// any buffered bytes. "delimited": frames end with '\n'.
+		void Reset (bool delimited);
+		bool Delimited () const;
+
+		// Next frame, NUL terminated, without its delimiter. Blocks until a
+		// whole frame is there. Returns its length, 0 if the connection was
+		// closed and SOCKET_ERROR on a socket error (WSAGetLastError()).
+		int Next (SOCKET s, char* out, size_t size);
+
+		// Read whatever the socket holds without blocking (delimited mode
+		// only). Returns the number of bytes read, 0 if none, or 0 and
+		// "closed" set if the connection was closed or failed.
+		int Poll (SOCKET s, bool& closed);
+
+		// Take a complete buffered frame, if any (delimited mode only)
+		bool Pop (char* out, size_t size);
+
+		// A complete frame is buffered: Next() returns it without reading
+		// the socket
+		bool Buffered () const;
+
+		// Put bytes already received back in front of the buffer, to be
+		// split into frames like the ones still to come (delimited mode
+		// only). Returns false if they do not fit.
+		bool Unread (const char* data, size_t length);
+
+		// Frames dropped because they did not fit in the buffer
+		unsigned int Oversized () const;
+
+	private:
+		std::vector<char> buffer;
+		size_t used;
+		bool delimited;
+		unsigned int oversized;
+	};
+
+#endif // _SOCFRAMEREADER_H
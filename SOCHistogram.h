@@ -0,0 +1,94 @@
+// Lock-free histogram of durations, in microseconds.
+//
+// Bucket 0 counts zero, and bucket i (i > 0) counts values in
+// [2^(i-1), 2^i) us, so recording is a bit scan and one atomic increment
+// and any thread may record while another one reads. Percentiles are
+// reported as the upper bound of their bucket, i.e. with less than a
+// factor of two of overestimation, which is enough to tell 1 ms from
+// 10 ms from 100 ms.
+//
+
+#ifndef _SOCHISTOGRAM_H
+#define _SOCHISTOGRAM_H
+
+#include <atomic>
+#include <stdio.h>
+#include <stdint.h>
+
+// **************************************************************************
+class SOCHistogram
+	{
+	public:
+		enum { buckets = 40 };		// up to 2^39 us (about 6 days)
+
+		SOCHistogram ()
+		{
+			for (int i = 0; i < buckets; i++)
+				counts[i].store(0, std::memory_order_relaxed);
+			count.store(0, std::memory_order_relaxed);
+			max.store(0, std::memory_order_relaxed);
+		}
+
+		// Negative values (clock steps) are recorded as zero.
+		void Record (int64_t value)
+		{
+			uint64_t v = (value > 0) ? (uint64_t) value : 0;
+			int i = 0;
+			while (v >> i && i < buckets - 1) i++;
+			counts[i].fetch_add(1, std::memory_order_relaxed);
+			count.fetch_add(1, std::memory_order_relaxed);
+
+			uint64_t m = max.load(std::memory_order_relaxed);
+			while (v > m && !max.compare_exchange_weak(m, v, std::memory_order_relaxed))
+				;
+		}
+
+		uint32_t Count () const
+		{
+			return count.load(std::memory_order_relaxed);
+		}
+
+		uint64_t Max () const
+		{
+			return max.load(std::memory_order_relaxed);
+		}
+
+		// Upper bound of the bucket holding the p-th percentile (0 < p <= 100)
+		uint64_t Percentile (double p) const
+		{
+			uint32_t snapshot[buckets];
+			uint64_t total = 0;
+			for (int i = 0; i < buckets; i++){
+				snapshot[i] = counts[i].load(std::memory_order_relaxed);
+				total += snapshot[i];
+			}
+			if (total == 0)
+				return 0;
+
+			uint64_t rank = (uint64_t) (total * p / 100.0 + 0.5);
+			if (rank == 0) rank = 1;
+			uint64_t seen = 0;
+			for (int i = 0; i < buckets; i++){
+				seen += snapshot[i];
+				if (seen >= rank){
+					uint64_t bound = (i == 0) ? 0 : ((uint64_t) 1 << i) - 1;
+					return (bound < Max()) ? bound : Max();
+				}
+			}
+			return Max();
+		}
+
+		void Print (const char* name) const
+		{
+			printf("%s: %u amostras, p50 %llu us, p90 %llu us, p99 %llu us, max %llu us\n",
+				name, Count(), (unsigned long long) Percentile(50), (unsigned long long) Percentile(90),
+				(unsigned long long) Percentile(99), (unsigned long long) Max());
+		}
+
+	private:
+		std::atomic<uint32_t> counts[buckets];
+		std::atomic<uint32_t> count;
+		std::atomic<uint64_t> max;
+	};
+
+#endif // _SOCHISTOGRAM_H
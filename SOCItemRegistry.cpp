@@ -0,0 +1,253 @@
+//
+// C++ class that keeps the OPC items of the client in a dense table
+// indexed by client handle.
+//
+// Registration is done by a single thread (at startup), while the callback
+// thread may be reading the table at the same time. Entries are written
+// before the item count is published, and are never moved or removed, so
+// readers need no lock. Slots are guarded by a single sequence counter.
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include "SOCItemRegistry.h"
+#include "SOCVarTraits.h"
+
+//	Constructor. The table is allocated once with its final capacity.
+SOCItemRegistry::SOCItemRegistry (size_t capacity, uint32_t array_blocks, uint32_t array_block_size)
+	: entries(capacity, (Opc_item*) NULL), slots(new SeqWords<Opc_slot>[capacity]),
+	  arrays((uint32_t) capacity, array_blocks, array_block_size), count(0)
+{
+	Opc_slot empty = { VT_EMPTY, OPC_QUALITY_BAD, 0, 0 };
+	for (size_t i = 0; i < capacity; i++)
+		slots[i].Put(empty);
+}
+
+bool SOCItemRegistry::Register (Opc_item* item)
+{
+	size_t n = count.load(std::memory_order_relaxed);
+	if (n >= entries.size()){
+		printf("SOCItemRegistry: table full, %S not registered\n", item->item_id);
+		return false;
+	}
+	if (by_id.find(item->item_id) != by_id.end())
+		return false;
+
+	item->id = (int) n;
+	entries[n] = item;
+	by_id[item->item_id] = (OPCHANDLE) n;
+
+	// Publish the entry only after it is completely written
+	count.store(n + 1, std::memory_order_release);
+	return true;
+}
+
+// Create an item owned by the registry for an entry of the browse index.
+Opc_item* SOCItemRegistry::Own (const Opc_browse_item& browse_item)
+{
+	owned_ids.push_back(browse_item.item_id);
+
+	Opc_item item = { 0, &owned_ids.back()[0], browse_item.type, 0 };
+	owned_items.push_back(item);
+	return &owned_items.back();
+}
+
+std::vector<Opc_item*> SOCItemRegistry::Subscribe (const SOCBrowseIndex& index,
+												   const wchar_t* pattern)
+{
+	std::vector<Opc_item*> added;
+	const std::vector<Opc_browse_item>& items = index.Items();
+	std::vector<Opc_browse_item>::const_iterator first = items.begin();
+	std::vector<Opc_browse_item>::const_iterator last = items.end();
+
+	// The index is sorted by item ID, so the candidates for a pattern
+	// starting with a literal prefix form a contiguous range.
+	size_t prefix_length = wcscspn(pattern, L"*?");
+	if (prefix_length > 0){
+		std::wstring prefix(pattern, prefix_length);
+		Opc_browse_item key;
+		key.item_id = prefix;
+		first = std::lower_bound(items.begin(), items.end(), key,
+			[](const Opc_browse_item& a, const Opc_browse_item& b) { return a.item_id < b.item_id; });
+		for (last = first; last != items.end(); ++last)
+			if (last->item_id.compare(0, prefix_length, prefix) != 0)
+				break;
+	}
+
+	// A pattern that is just a prefix followed by '*' matches the whole
+	// range; anything else is checked item by item.
+	bool prefix_only = (pattern[prefix_length] == L'*' && pattern[prefix_length + 1] == L'\0');
+
+	for (std::vector<Opc_browse_item>::const_iterator it = first; it != last; ++it){
+		if (!prefix_only && !MatchItemPattern(pattern, it->item_id.c_str()))
+			continue;
+		if (by_id.find(it->item_id) != by_id.end())
+			continue;
+
+		Opc_item* item = Own(*it);
+		if (!Register(item))
+			break;
+		added.push_back(item);
+	}
+
+	if (added.empty())
+		printf("Padrao %S: nenhum item novo encontrado\n", pattern);
+	return added;
+}
+
+Opc_item* SOCItemRegistry::Find (OPCHANDLE client_handle) const
+{
+	if (client_handle >= count.load(std::memory_order_acquire))
+		return NULL;
+	return entries[client_handle];
+}
+
+Opc_item* SOCItemRegistry::Find (const wchar_t* item_id) const
+{
+	std::map<std::wstring, OPCHANDLE>::const_iterator it = by_id.find(item_id);
+	if (it == by_id.end())
+		return NULL;
+	return entries[it->second];
+}
+
+size_t SOCItemRegistry::Size () const
+{
+	return count.load(std::memory_order_acquire);
+}
+
+void SOCItemRegistry::BeginUpdate ()
+{
+	slots_seq.BeginWrite();
+}
+
+void SOCItemRegistry::EndUpdate ()
+{
+	slots_seq.EndWrite();
+	if (update_handler)
+		update_handler();
+}
+
+bool SOCItemRegistry::Store (OPCHANDLE client_handle, const VARIANT& value,
+							 WORD quality, LONGLONG timestamp)
+{
+	if (client_handle >= count.load(std::memory_order_acquire))
+		return false;
+
+	// Pointers in the VARIANT (BSTR, SAFEARRAY, BYREF) belong to the caller
+	// and do not outlive the callback. A DECIMAL does not fit in the 8
+	// bytes of the slot (SOCDataCallback converts it to VT_R8).
+	if ((value.vt & (VT_ARRAY | VT_BYREF)) || value.vt == VT_BSTR || value.vt == VT_DECIMAL ||
+		value.vt == VT_VARIANT || value.vt == VT_UNKNOWN || value.vt == VT_DISPATCH)
+		return false;
+
+	Opc_slot slot = { value.vt, quality, value.llVal, timestamp };
+	slots[client_handle].Put(slot);
+	return true;
+}
+
+SOCArrayArena* SOCItemRegistry::Arrays ()
+{
+	return &arrays;
+}
+
+bool SOCItemRegistry::StoreArray (OPCHANDLE client_handle, VARTYPE vt, uint32_t version,
+								  WORD quality, LONGLONG timestamp)
+{
+	if (client_handle >= count.load(std::memory_order_acquire) || version == 0)
+		return false;
+
+	Opc_slot slot = { (VARTYPE) (vt | VT_ARRAY), quality, version, timestamp };
+	slots[client_handle].Put(slot);
+	return true;
+}
+
+bool SOCItemRegistry::CopyArray (OPCHANDLE client_handle, Opc_array_info& info,
+								 void* data, size_t size) const
+{
+	if (client_handle >= count.load(std::memory_order_acquire))
+		return false;
+	return arrays.Get(client_handle, info, data, size);
+}
+
+Opc_slot SOCItemRegistry::Slot (OPCHANDLE client_handle) const
+{
+	Opc_slot slot;
+	Snapshot(&client_handle, 1, &slot);
+	return slot;
+}
+
+void SOCItemRegistry::Snapshot (const OPCHANDLE* client_handles, size_t n, Opc_slot* out) const
+{
+	Opc_slot empty = { VT_EMPTY, OPC_QUALITY_BAD, 0, 0 };
+	size_t known = count.load(std::memory_order_acquire);
+	uint32_t s;
+
+	do {
+		s = slots_seq.BeginRead();
+		for (size_t i = 0; i < n; i++)
+			out[i] = (client_handles[i] < known) ? slots[client_handles[i]].Get() : empty;
+	} while (!slots_seq.ReadValid(s));
+}
+
+uint32_t SOCItemRegistry::Generation () const
+{
+	return slots_seq.Version();
+}
+
+void SOCItemRegistry::SetUpdateHandler (std::function<void()> handler)
+{
+	update_handler = handler;
+}
+
+double SlotToDouble (const Opc_slot& slot)
+{
+	double value = 0.0;
+	VtDecode(slot.vt, &slot.value, value);
+	return value;
+}
+
+// 116444736000000000 is 1970-01-01 in FILETIME units (100 ns since 1601)
+LONGLONG FileTimeToEpoch (const FILETIME& ft)
+{
+	ULONGLONG t = ((ULONGLONG) ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+	if (t == 0)
+		return 0;
+	return ((LONGLONG) t - 116444736000000000LL) / 10;
+}
+
+LONGLONG EpochNow ()
+{
+	FILETIME ft;
+	GetSystemTimePreciseAsFileTime(&ft);
+	return FileTimeToEpoch(ft);
+}
+
+/////////////////////////////////////////////////////////////////////////
+// Iterative glob matcher: on a mismatch, backtrack to the last '*' and let
+// it absorb one more character.
+//
+bool MatchItemPattern (const wchar_t* pattern, const wchar_t* item_id)
+{
+	const wchar_t* star = NULL;
+	const wchar_t* resume = NULL;
+
+	while (*item_id != L'\0'){
+		if (*pattern == L'*'){
+			star = pattern++;
+			resume = item_id;
+		}
+		else if (*pattern == L'?' || *pattern == *item_id){
+			pattern++;
+			item_id++;
+		}
+		else if (star != NULL){
+			pattern = star + 1;
+			item_id = ++resume;
+		}
+		else
+			return false;
+	}
+	while (*pattern == L'*') pattern++;
+	return *pattern == L'\0';
+}
@@ -0,0 +1,135 @@
+// Class for keeping every OPC item of the client in one dense table.
+//
+// The client handle given to the server for an item is its index in the
+// table, so that anything receiving a client handle back from the server
+// can reach the item, and the slot holding its last value, with a single
+// indexed load. The table is allocated once with a fixed capacity: entries
+// never move, and items may be added while the callback thread is reading
+// the table.
+//
+// Items come either from the fixed Opc_item globals of the client or from
+// subscription patterns resolved against the server address space.
+//
+// The value slots are written by a single thread (the sample worker of
+// SOCDataCallback) in batches, under a sequence lock (see SOCSeqlock.h):
+// the writer never blocks, and readers get a set of slots that all belong
+// to the same batch, without taking any lock.
+//
+
+#include "opcda.h"
+
+#ifndef _SOCITEMREGISTRY_H
+#define _SOCITEMREGISTRY_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <atomic>
+#include <memory>
+#include <functional>
+#include "SOCDataCallback.h"
+#include "SOCSeqlock.h"
+#include "SOCBrowse.h"
+#include "SOCArrayArena.h"
+
+#define OPC_REGISTRY_CAPACITY 4096
+#define OPC_ARRAY_BLOCKS 64			// array-valued items
+#define OPC_ARRAY_BLOCK_SIZE 8192	// bytes per array
+
+// Last value received for an item. The 8 bytes of the VARIANT data union
+// are copied as they are and interpreted according to "vt", so storing a
+// scalar of any type is a single copy. Strings are not kept. For arrays
+// "vt" includes VT_ARRAY, the array itself is in the registry's array
+// arena and "value" is its version there (see StoreArray()).
+// "timestamp" is the server's source timestamp in epoch microseconds (see
+// FileTimeToEpoch()), 0 if the item never received a value.
+struct Opc_slot {
+	VARTYPE vt;
+	WORD quality;
+	LONGLONG value;
+	LONGLONG timestamp;
+};
+
+// Slot value converted to double (0.0 for empty or unsupported slots)
+double SlotToDouble (const Opc_slot& slot);
+
+// FILETIME (100 ns since 1601) to microseconds since 1970-01-01 UTC, the
+// timestamp format used from the registry onwards. A zero FILETIME gives 0.
+LONGLONG FileTimeToEpoch (const FILETIME& ft);
+
+// Current system time in epoch microseconds
+LONGLONG EpochNow ();
+
+// **************************************************************************
+class SOCItemRegistry
+	{
+	public:
+		SOCItemRegistry (size_t capacity = OPC_REGISTRY_CAPACITY,
+						 uint32_t array_blocks = OPC_ARRAY_BLOCKS,
+						 uint32_t array_block_size = OPC_ARRAY_BLOCK_SIZE);
+
+		// Register an item owned by the caller. Its "id" field is set to the
+		// client handle. Returns false if the table is full or the item ID
+		// is already registered.
+		bool Register (Opc_item* item);
+
+		// Register every item of the index matching "pattern", which is
+		// either a plain item ID, a prefix ending in '*' ("Random.*") or a
+		// glob with '*' and '?' anywhere. Items already registered are
+		// skipped. Returns the newly registered items.
+		std::vector<Opc_item*> Subscribe (const SOCBrowseIndex& index, const wchar_t* pattern);
+
+		// Item for a client handle, or NULL if the handle is unknown.
+		Opc_item* Find (OPCHANDLE client_handle) const;
+		Opc_item* Find (const wchar_t* item_id) const;
+		size_t Size () const;
+
+		// Store a value received for client_handle in its slot, with its
+		// quality and source timestamp (epoch us). Returns false for unknown
+		// handles and for non-scalar values. Must be called between
+		// BeginUpdate() and EndUpdate(), by one thread only.
+		void BeginUpdate ();
+		bool Store (OPCHANDLE client_handle, const VARIANT& value, WORD quality, LONGLONG timestamp);
+		void EndUpdate ();
+
+		// Arrays take two steps, since they must be copied before the
+		// callback returns: the callback thread puts the array in Arrays(),
+		// and the slot writer then records the version Put() returned.
+		SOCArrayArena* Arrays ();
+		bool StoreArray (OPCHANDLE client_handle, VARTYPE vt, uint32_t version,
+						 WORD quality, LONGLONG timestamp);
+
+		// Copy of the last array of an item (see SOCArrayArena::Get())
+		bool CopyArray (OPCHANDLE client_handle, Opc_array_info& info, void* data, size_t size) const;
+
+		// Consistent copy of one slot, or of the slots of several items
+		Opc_slot Slot (OPCHANDLE client_handle) const;
+		void Snapshot (const OPCHANDLE* client_handles, size_t n, Opc_slot* out) const;
+
+		// Number of completed updates, for change detection
+		uint32_t Generation () const;
+
+		// Called by the writer thread after every update, to notify readers
+		// instead of having them poll Generation(). It must return quickly.
+		// To be set before the first update.
+		void SetUpdateHandler (std::function<void()> handler);
+
+	private:
+		Opc_item* Own (const Opc_browse_item& browse_item);
+
+		std::vector<Opc_item*> entries;			// indexed by client handle
+		std::unique_ptr<SeqWords<Opc_slot>[]> slots;	// indexed by client handle
+		SeqCounter slots_seq;
+		SOCArrayArena arrays;
+		std::function<void()> update_handler;
+		std::atomic<size_t> count;
+		std::map<std::wstring, OPCHANDLE> by_id;
+		std::deque<Opc_item> owned_items;		// items created from patterns
+		std::deque<std::wstring> owned_ids;
+	};
+
+// Glob match with '*' (any sequence) and '?' (any character)
+bool MatchItemPattern (const wchar_t* pattern, const wchar_t* item_id);
+
+#endif // _SOCITEMREGISTRY_H
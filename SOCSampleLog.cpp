@@ -0,0 +1,101 @@
+//
+// C++ class that prints a sample of the values received from the OPC
+// server on a thread of its own.
+//
+
+#include <stdio.h>
+#include "SOCSampleLog.h"
+#include "SOCFormat.h"
+
+//	Constructor. "sample_every" = 1 logs every sample.
+SOCSampleLog::SOCSampleLog (const char* prefix, uint32_t sample_every, uint32_t capacity)
+	: ring(capacity, 0, OPC_OVERFLOW_DROP_OLDEST)
+{
+	this->prefix = prefix;
+	this->sample_every = (sample_every > 0) ? sample_every : 1;
+	seen = 0;
+	running = false;
+	log_event = CreateEvent(NULL, FALSE, FALSE, NULL);
+}
+
+//	Destructor
+SOCSampleLog::~SOCSampleLog ()
+{
+	Stop();
+	CloseHandle(log_event);
+}
+
+void SOCSampleLog::Start ()
+{
+	if (running) return;
+	running = true;
+	worker = std::thread(&SOCSampleLog::WorkerLoop, this);
+}
+
+void SOCSampleLog::Stop ()
+{
+	if (!running) return;
+	running = false;
+	SetEvent(log_event);
+	worker.join();
+}
+
+void SOCSampleLog::Log (OPCHANDLE client_handle, const VARIANT& value, WORD quality,
+						const FILETIME& timestamp)
+{
+	if (!running || seen++ % sample_every != 0)
+		return;
+
+	Opc_ring_entry entry;
+	entry.client_handle = client_handle;
+	entry.vt = value.vt;
+	entry.quality = quality;
+	entry.value = value.llVal;
+	entry.timestamp = timestamp;
+	ring.Push(entry);
+	SetEvent(log_event);
+}
+
+void SOCSampleLog::WorkerLoop ()
+{
+	Opc_ring_entry entries[32];
+
+	while (running){
+		uint32_t n = ring.Pop(entries, 32);
+		if (n == 0){
+			WaitForSingleObject(log_event, INFINITE);
+			continue;
+		}
+		for (uint32_t i = 0; i < n; i++)
+			Print(entries[i]);
+	}
+}
+
+// Print the item value, quality and time stamp
+void SOCSampleLog::Print (const Opc_ring_entry& entry)
+{
+	VARIANT value;
+	FILETIME lft;
+	SYSTEMTIME st;
+	char szLocalDate[255], szLocalTime[255];
+	char buffer[100];
+
+	value.vt = entry.vt;
+	value.llVal = entry.value;
+	bool scalar = !((entry.vt & (VT_ARRAY | VT_BYREF)) || entry.vt == VT_BSTR);
+	if (!scalar || FormatVariant(value, buffer, sizeof(buffer)) == 0){
+		printf("%s: item %lu: unsupported item type %x\n", prefix, entry.client_handle, entry.vt);
+		return;
+	}
+
+	// Code below extracted from the Microsoft KB:
+	//     http://support.microsoft.com/kb/188768
+	FileTimeToLocalFileTime(&entry.timestamp, &lft);
+	FileTimeToSystemTime(&lft, &st);
+	GetDateFormat(LOCALE_SYSTEM_DEFAULT, DATE_SHORTDATE, &st, NULL, szLocalDate, 255);
+	GetTimeFormat(LOCALE_SYSTEM_DEFAULT, 0, &st, NULL, szLocalTime, 255);
+
+	printf("%s: item %lu Value = %s Quality: %s Time: %s %s\n", prefix, entry.client_handle,
+		buffer, ((entry.quality & OPC_QUALITY_MASK) == OPC_QUALITY_GOOD) ? "good" : "not good",
+		szLocalDate, szLocalTime);
+}
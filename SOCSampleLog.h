@@ -0,0 +1,48 @@
+// Sampled, asynchronous console log of OPC samples.
+//
+// Formatting a value, converting its timestamp to local time and writing
+// to the console take far longer than decoding it, so the callbacks never
+// do it themselves. They hand one sample out of every "sample_every" to
+// this class, which queues it in a small drop-oldest SOCSampleRing, and a
+// thread of its own prints it. When the console falls behind, old lines
+// are dropped rather than the callback being slowed down.
+//
+
+#include "opcda.h"
+
+#ifndef _SOCSAMPLELOG_H
+#define _SOCSAMPLELOG_H
+
+#include <atomic>
+#include <thread>
+#include "SOCSampleRing.h"
+
+// **************************************************************************
+class SOCSampleLog
+	{
+	public:
+		SOCSampleLog (const char* prefix, uint32_t sample_every, uint32_t capacity = 256);
+		~SOCSampleLog ();
+
+		void Start ();
+		void Stop ();
+
+		// Called from one callback thread only. Non-scalar values are
+		// logged by type only.
+		void Log (OPCHANDLE client_handle, const VARIANT& value, WORD quality,
+				  const FILETIME& timestamp);
+
+	private:
+		void WorkerLoop ();
+		void Print (const Opc_ring_entry& entry);
+
+		const char* prefix;
+		uint32_t sample_every;
+		uint32_t seen;				// producer only
+		SOCSampleRing ring;
+		std::thread worker;
+		std::atomic<bool> running;
+		HANDLE log_event;
+	};
+
+#endif // _SOCSAMPLELOG_H
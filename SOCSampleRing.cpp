@@ -0,0 +1,167 @@
+//
+// C++ class implementing the sample ring between the OPC callback thread
+// (producer) and the sample worker thread (consumer).
+//
+// Positions are free-running 32-bit counters; a slot is at position & mask.
+// Each slot records the position it was last written for twice, before
+// and after the copy, so that with the drop-oldest policy the consumer can
+// tell a slot being overwritten under it and skip it.
+//
+
+#include "SOCSampleRing.h"
+
+//	Constructor. Everything is allocated here; Push() never allocates.
+SOCSampleRing::SOCSampleRing (uint32_t capacity, uint32_t items, Opc_overflow_policy policy)
+	: policy(policy), write_pos(0), read_pos(0), push_count(0), items(items), pending_count(0),
+	  max_depth(0), dropped(0), coalesced(0)
+{
+	uint32_t size = 1;
+	while (size < capacity) size <<= 1;
+	mask = size - 1;
+
+	slots.reset(new Slot[size]);
+	for (uint32_t i = 0; i < size; i++){
+		// No position maps to this slot yet
+		slots[i].begin.store(i - size, std::memory_order_relaxed);
+		slots[i].end.store(i - size, std::memory_order_relaxed);
+	}
+
+	latest.reset(new SOCSeqlock<Opc_ring_entry>[items]);
+	pending.reset(new std::atomic<uint8_t>[items]);
+	delivered.reset(new uint32_t[items]);
+	for (uint32_t i = 0; i < items; i++){
+		pending[i].store(0, std::memory_order_relaxed);
+		delivered[i] = 0;
+	}
+}
+
+void SOCSampleRing::Push (const Opc_ring_entry& sample)
+{
+	Opc_ring_entry entry = sample;
+	entry.sequence = ++push_count;
+
+	uint32_t pos = write_pos.load(std::memory_order_relaxed);
+	uint32_t depth = pos - read_pos.load(std::memory_order_acquire);
+
+	if (policy == OPC_OVERFLOW_COALESCE){
+		OPCHANDLE h = entry.client_handle;
+		bool is_pending = (h < items) && pending[h].load(std::memory_order_acquire);
+
+		// While an item has a value waiting in its cell, its newer values
+		// go there too, so that the consumer never sees them out of order.
+		if (depth > mask || is_pending){
+			if (h >= items){
+				dropped.fetch_add(1, std::memory_order_relaxed);
+				return;
+			}
+			latest[h].Store(entry);
+			if (pending[h].exchange(1, std::memory_order_acq_rel) == 0)
+				pending_count.fetch_add(1, std::memory_order_release);
+			else
+				coalesced.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+	}
+
+	Slot& slot = slots[pos & mask];
+	slot.begin.store(pos, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	slot.data.Put(entry);
+	slot.end.store(pos, std::memory_order_release);
+	write_pos.store(pos + 1, std::memory_order_release);
+
+	if (depth + 1 > max_depth.load(std::memory_order_relaxed))
+		max_depth.store(depth + 1 > mask + 1 ? mask + 1 : depth + 1, std::memory_order_relaxed);
+}
+
+uint32_t SOCSampleRing::Pop (Opc_ring_entry* out, uint32_t max)
+{
+	uint32_t r = read_pos.load(std::memory_order_relaxed);
+	uint32_t n = 0;
+
+	while (n < max){
+		uint32_t w = write_pos.load(std::memory_order_acquire);
+		if (w == r)
+			break;
+
+		// Overwritten while we were behind: skip to the oldest sample left
+		if (w - r > mask + 1){
+			dropped.fetch_add(w - r - (mask + 1), std::memory_order_relaxed);
+			r = w - (mask + 1);
+		}
+
+		Slot& slot = slots[r & mask];
+		uint32_t end = slot.end.load(std::memory_order_acquire);
+		Opc_ring_entry entry = slot.data.Get();
+		std::atomic_thread_fence(std::memory_order_acquire);
+		uint32_t begin = slot.begin.load(std::memory_order_relaxed);
+
+		r++;
+		read_pos.store(r, std::memory_order_release);
+
+		if (end != r - 1 || begin != r - 1)
+			// The producer has lapped us on this slot
+			dropped.fetch_add(1, std::memory_order_relaxed);
+		else if (Deliver(entry))
+			out[n++] = entry;
+	}
+
+	// Coalesced values are newer than what the ring held when they were
+	// stored, so they are only handed out once the ring is empty.
+	if (n < max && write_pos.load(std::memory_order_acquire) == r)
+		n += PopCoalesced(out + n, max - n);
+	return n;
+}
+
+// A ring sample may still be older than a coalesced value of the same item
+// already handed out, when the producer raced with PopCoalesced(). Such a
+// sample was superseded and is counted as coalesced.
+bool SOCSampleRing::Deliver (const Opc_ring_entry& entry)
+{
+	OPCHANDLE h = entry.client_handle;
+	if (policy != OPC_OVERFLOW_COALESCE || h >= items)
+		return true;
+
+	if ((int32_t) (entry.sequence - delivered[h]) <= 0){
+		coalesced.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+	delivered[h] = entry.sequence;
+	return true;
+}
+
+uint32_t SOCSampleRing::PopCoalesced (Opc_ring_entry* out, uint32_t max)
+{
+	uint32_t n = 0;
+
+	if (pending_count.load(std::memory_order_acquire) == 0)
+		return 0;
+
+	for (uint32_t h = 0; h < items && n < max; h++){
+		if (pending[h].load(std::memory_order_relaxed) == 0)
+			continue;
+		// Clear the flag before reading the cell: a value stored meanwhile
+		// sets it again and is delivered on the next call.
+		pending[h].store(0, std::memory_order_seq_cst);
+		pending_count.fetch_sub(1, std::memory_order_relaxed);
+		Opc_ring_entry entry = latest[h].Load();
+		if (Deliver(entry))
+			out[n++] = entry;
+	}
+	return n;
+}
+
+Opc_ring_stats SOCSampleRing::Stats () const
+{
+	Opc_ring_stats stats;
+	uint32_t w = write_pos.load(std::memory_order_acquire);
+	uint32_t depth = w - read_pos.load(std::memory_order_acquire);
+
+	stats.depth = (depth > mask + 1) ? mask + 1 : depth;
+	stats.depth += pending_count.load(std::memory_order_relaxed);
+	stats.max_depth = max_depth.load(std::memory_order_relaxed);
+	stats.pushed = w;
+	stats.dropped = dropped.load(std::memory_order_relaxed);
+	stats.coalesced = coalesced.load(std::memory_order_relaxed);
+	return stats;
+}
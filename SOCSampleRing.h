@@ -0,0 +1,98 @@
+// Lock-free single-producer/single-consumer ring of OPC samples.
+//
+// SOCDataCallback::OnDataChange runs on the OPC server's COM RPC thread,
+// and anything it does delays the delivery of data to every client of the
+// server. So the callback only copies each sample (client handle, scalar
+// value, quality and timestamp) into this preallocated ring, and a worker
+// thread does the rest.
+//
+// The producer never waits. When the ring is full one of two overflow
+// policies applies:
+//   - OPC_OVERFLOW_DROP_OLDEST: the oldest sample is overwritten, and the
+//     consumer counts it as dropped when it notices;
+//   - OPC_OVERFLOW_COALESCE: the sample goes to a per-item cell holding
+//     only the latest value of each item, which the consumer drains after
+//     the ring. Intermediate values are lost but every item keeps its
+//     newest one.
+//
+
+#include "opcda.h"
+
+#ifndef _SOCSAMPLERING_H
+#define _SOCSAMPLERING_H
+
+#include <atomic>
+#include <memory>
+#include "SOCSeqlock.h"
+
+enum Opc_overflow_policy {
+	OPC_OVERFLOW_DROP_OLDEST,
+	OPC_OVERFLOW_COALESCE
+};
+
+// One sample as copied by the callback. Only the 8-byte VARIANT payload is
+// kept, so "value" is meaningful for scalar types only.
+struct Opc_ring_entry {
+	OPCHANDLE client_handle;
+	VARTYPE vt;
+	WORD quality;
+	LONGLONG value;
+	FILETIME timestamp;
+	uint32_t sequence;		// set by Push()
+};
+
+struct Opc_ring_stats {
+	uint32_t depth;			// samples waiting in the ring
+	uint32_t max_depth;
+	uint32_t pushed;		// samples written into the ring
+	uint32_t dropped;		// overwritten before being consumed
+	uint32_t coalesced;		// replaced by a newer value of the same item
+};
+
+// **************************************************************************
+class SOCSampleRing
+	{
+	public:
+		// "capacity" is rounded up to a power of two. "items" is the number
+		// of client handles that may be coalesced.
+		SOCSampleRing (uint32_t capacity, uint32_t items, Opc_overflow_policy policy);
+
+		// Producer side (callback thread)
+		void Push (const Opc_ring_entry& entry);
+
+		// Consumer side (worker thread). Copies up to "max" samples into
+		// "out" and returns how many were copied.
+		uint32_t Pop (Opc_ring_entry* out, uint32_t max);
+
+		Opc_ring_stats Stats () const;
+
+	private:
+		struct Slot {
+			std::atomic<uint32_t> begin;	// position being written
+			std::atomic<uint32_t> end;		// position completely written
+			SeqWords<Opc_ring_entry> data;
+		};
+
+		uint32_t PopCoalesced (Opc_ring_entry* out, uint32_t max);
+		bool Deliver (const Opc_ring_entry& entry);
+
+		uint32_t mask;
+		Opc_overflow_policy policy;
+		std::unique_ptr<Slot[]> slots;
+		std::atomic<uint32_t> write_pos;
+		std::atomic<uint32_t> read_pos;
+		uint32_t push_count;			// producer only
+
+		// Coalescing cells, indexed by client handle
+		uint32_t items;
+		std::unique_ptr<SOCSeqlock<Opc_ring_entry>[]> latest;
+		std::unique_ptr<std::atomic<uint8_t>[]> pending;
+		std::atomic<uint32_t> pending_count;
+		std::unique_ptr<uint32_t[]> delivered;	// consumer only
+
+		std::atomic<uint32_t> max_depth;
+		std::atomic<uint32_t> dropped;
+		std::atomic<uint32_t> coalesced;
+	};
+
+#endif // _SOCSAMPLERING_H
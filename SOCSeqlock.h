@@ -0,0 +1,141 @@
+// Sequence lock ("seqlock") for sharing small records between one writer
+// thread and any number of reader threads without locks.
+//
+// The writer bumps a sequence counter to an odd value, copies the record
+// and bumps the counter to the next even value. A reader copies the record
+// between two reads of the counter and retries if the counter was odd or
+// changed meanwhile. So the writer never blocks or drops a value, and a
+// reader never returns a record made of two different writes.
+//
+// The record is kept as an array of 32-bit atomic words, which are lock-free
+// on every target of this project (including Win32), so a copy racing with
+// the writer is well defined; the counter decides whether it is used.
+//
+
+#ifndef _SOCSEQLOCK_H
+#define _SOCSEQLOCK_H
+
+#include <atomic>
+#include <thread>
+#include <string.h>
+#include <stdint.h>
+
+// **************************************************************************
+// Storage for a trivially copyable record as atomic words.
+template <class T>
+struct SeqWords
+	{
+		enum { count = (sizeof(T) + sizeof(uint32_t) - 1) / sizeof(uint32_t) };
+
+		void Put (const T& value)
+		{
+			uint32_t tmp[count] = { 0 };
+			memcpy(tmp, &value, sizeof(T));
+			for (int i = 0; i < count; i++)
+				w[i].store(tmp[i], std::memory_order_relaxed);
+		}
+
+		T Get () const
+		{
+			uint32_t tmp[count];
+			T value;
+			for (int i = 0; i < count; i++)
+				tmp[i] = w[i].load(std::memory_order_relaxed);
+			memcpy(&value, tmp, sizeof(T));
+			return value;
+		}
+
+		std::atomic<uint32_t> w[count];
+	};
+
+// **************************************************************************
+// Sequence counter shared by one or more SeqWords. Only one thread may
+// write at a time.
+class SeqCounter
+	{
+	public:
+		SeqCounter () : seq(0) {}
+
+		void BeginWrite ()
+		{
+			seq.store(seq.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_release);
+		}
+
+		void EndWrite ()
+		{
+			seq.store(seq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+		}
+
+		// Returns the counter value to pass to ReadValid(), waiting while a
+		// write is in progress.
+		uint32_t BeginRead () const
+		{
+			uint32_t s;
+			while ((s = seq.load(std::memory_order_acquire)) & 1)
+				std::this_thread::yield();
+			return s;
+		}
+
+		// True if nothing was written since BeginRead() returned "s".
+		bool ReadValid (uint32_t s) const
+		{
+			std::atomic_thread_fence(std::memory_order_acquire);
+			return seq.load(std::memory_order_relaxed) == s;
+		}
+
+		// Number of completed writes
+		uint32_t Version () const
+		{
+			return seq.load(std::memory_order_acquire) / 2;
+		}
+
+	private:
+		std::atomic<uint32_t> seq;
+	};
+
+// **************************************************************************
+// A single record guarded by its own sequence counter.
+template <class T>
+class SOCSeqlock
+	{
+	public:
+		SOCSeqlock ()
+		{
+			data.Put(T());
+		}
+
+		SOCSeqlock (const T& initial)
+		{
+			data.Put(initial);
+		}
+
+		void Store (const T& value)
+		{
+			counter.BeginWrite();
+			data.Put(value);
+			counter.EndWrite();
+		}
+
+		T Load () const
+		{
+			T value;
+			uint32_t s;
+			do {
+				s = counter.BeginRead();
+				value = data.Get();
+			} while (!counter.ReadValid(s));
+			return value;
+		}
+
+		uint32_t Version () const
+		{
+			return counter.Version();
+		}
+
+	private:
+		SeqCounter counter;
+		SeqWords<T> data;
+	};
+
+#endif // _SOCSEQLOCK_H
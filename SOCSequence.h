@@ -0,0 +1,165 @@
+// Sequence numbers of the frames of one connection.
+//
+// SOCSequence hands out the numbers of the frames sent. Any thread may
+// take one; numbers run from 1 to modulus - 1 and start over at 1, so
+// that they fit the fixed-width field of the text frames (modulus
+// 1000000 for 6 digits). A modulus of 0 uses all 32 bits, for frames
+// carrying the number in binary. Reset() starts a new connection at 1.
+//
+// SOCSequenceCheck follows the numbers of the frames received from a peer
+// numbering them one by one, and counts what the peer's numbering tells
+// about their delivery:
+//   - a number ahead of the next one expected leaves a gap, whose frames
+//     are counted as lost;
+//   - a number behind it that falls in a gap arrived out of order: it is
+//     counted as reordered and no longer as lost;
+//   - a number already received is a duplicate, as is one too far behind
+//     to tell (more than 64 frames).
+// Numbers are compared modulo the modulus, so the check carries on over a
+// wrap. One thread observes; the counters can be read from any thread.
+//
+
+#ifndef _SOCSEQUENCE_H
+#define _SOCSEQUENCE_H
+
+#include <atomic>
+#include <stdio.h>
+#include <stdint.h>
+
+// **************************************************************************
+class SOCSequence
+	{
+	public:
+		SOCSequence (uint32_t modulus = 0) : modulus(modulus), next(1) {}
+
+		// Take the next number
+		uint32_t Next ()
+		{
+			uint32_t n = next.load(std::memory_order_relaxed);
+			while (!next.compare_exchange_weak(n, After(n), std::memory_order_relaxed))
+				;
+			return n;
+		}
+
+		// Number the next frame will take
+		uint32_t Peek () const { return next.load(std::memory_order_relaxed); }
+
+		void Reset () { next.store(1, std::memory_order_relaxed); }
+
+		uint32_t After (uint32_t n) const
+		{
+			n++;
+			if (n == 0 || (modulus != 0 && n >= modulus))
+				n = 1;
+			return n;
+		}
+
+	private:
+		uint32_t modulus;
+		std::atomic<uint32_t> next;
+	};
+
+// **************************************************************************
+class SOCSequenceCheck
+	{
+	public:
+		SOCSequenceCheck (uint32_t modulus = 0)
+			: sequence(modulus), modulus(modulus), started(false), expected(0), seen(0),
+			  received(0), lost(0), gaps(0), duplicates(0), reordered(0)
+		{
+		}
+
+		// Forget the numbering, keeping the counters: the first number
+		// observed next is taken as is (new connection or subscription)
+		void Restart () { started = false; }
+
+		// Returns true if "seq" is the newest number so far, false for a
+		// duplicate or a frame arriving after a newer one
+		bool Observe (uint32_t seq)
+		{
+			received.fetch_add(1, std::memory_order_relaxed);
+			if (!started){
+				started = true;
+				Accept(seq, 0);
+				return true;
+			}
+
+			uint32_t ahead = Distance(expected, seq);
+			if (ahead == 0)
+				Accept(seq, 1);
+			else if (ahead < Span() / 2){
+				// Frames expected..seq-1 are missing
+				lost.fetch_add(ahead, std::memory_order_relaxed);
+				gaps.fetch_add(1, std::memory_order_relaxed);
+				Accept(seq, ahead + 1);
+			}
+			else {
+				// Behind: "behind" frames before the last one received
+				uint32_t behind = Distance(seq, expected) - 1;
+				if (behind == 0 || behind > 64 || (seen & ((uint64_t) 1 << (behind - 1))))
+					duplicates.fetch_add(1, std::memory_order_relaxed);
+				else {
+					seen |= (uint64_t) 1 << (behind - 1);
+					reordered.fetch_add(1, std::memory_order_relaxed);
+					if (lost.load(std::memory_order_relaxed) > 0)
+						lost.fetch_sub(1, std::memory_order_relaxed);
+				}
+				return false;
+			}
+			return true;
+		}
+
+		uint32_t Received () const { return received.load(std::memory_order_relaxed); }
+		uint32_t Lost () const { return lost.load(std::memory_order_relaxed); }
+		uint32_t Gaps () const { return gaps.load(std::memory_order_relaxed); }
+		uint32_t Duplicates () const { return duplicates.load(std::memory_order_relaxed); }
+		uint32_t Reordered () const { return reordered.load(std::memory_order_relaxed); }
+
+		void Print (const char* name) const
+		{
+			uint32_t r = Received(), l = Lost();
+			printf("%s: %u quadros recebidos, %u perdidos (%.2f%%) em %u lacunas, "
+				"%u duplicados, %u fora de ordem\n", name, r, l,
+				(r + l) > 0 ? 100.0 * l / (r + l) : 0.0, Gaps(), Duplicates(), Reordered());
+		}
+
+	private:
+		// seq is the newest number received; it moved "shift" places
+		void Accept (uint32_t seq, uint32_t shift)
+		{
+			// Bit k of "seen": frame seq-1-k was received
+			if (shift == 0)
+				seen = 0;
+			else if (shift >= 64)
+				seen = (shift == 64) ? ((uint64_t) 1 << 63) : 0;
+			else
+				seen = (seen << shift) | ((uint64_t) 1 << (shift - 1));
+			expected = sequence.After(seq);
+		}
+
+		// Steps from a to b, going forward
+		uint32_t Distance (uint32_t a, uint32_t b) const
+		{
+			if (b >= a) return b - a;
+			return Span() - (a - b);
+		}
+
+		// Numbers in use (1 to modulus - 1, or 1 to 2^32 - 1)
+		uint32_t Span () const
+		{
+			return modulus != 0 ? modulus - 1 : 0xFFFFFFFFu;
+		}
+
+		SOCSequence sequence;		// only its After()
+		uint32_t modulus;
+		bool started;
+		uint32_t expected;			// next number in order
+		uint64_t seen;				// the 64 numbers before expected - 1
+		std::atomic<uint32_t> received;
+		std::atomic<uint32_t> lost;
+		std::atomic<uint32_t> gaps;
+		std::atomic<uint32_t> duplicates;
+		std::atomic<uint32_t> reordered;
+	};
+
+#endif // _SOCSEQUENCE_H
@@ -0,0 +1,303 @@
+//
+// The OPC server functions of the "Simple OPC Client" (see
+// SimpleOPCClient_v3.cpp): server instantiation, group and item
+// management and synchronous reads and writes. They are kept apart from
+// the gateway, so that SOCSession can be built without it (see
+// tests/test_session_recovery.cpp).
+//
+
+#include <stdio.h>
+#include <vector>
+#include "SimpleOPCClient_v3.h"
+#include "SOCDataCallback.h"
+
+////////////////////////////////////////////////////////////////////
+// Instantiate the IOPCServer interface of the OPCServer
+// having the name ServerName. Return a pointer to this interface
+//
+IOPCServer* InstantiateServer(wchar_t ServerName[])
+{
+	CLSID CLSID_OPCServer;
+	HRESULT hr;
+
+	// get the CLSID from the OPC Server Name:
+	hr = CLSIDFromString(ServerName, &CLSID_OPCServer); // CLSIDfromProgId()
+	if (FAILED(hr)){
+		printf("Failed call to CLSIDFromString. Error code = %x\n", hr);
+		return NULL;
+	}
+
+
+	//queue of the class instances to create
+	LONG cmq = 1; // nbr of class instance to create.
+	MULTI_QI queue[1] =
+		{{&IID_IOPCServer,
+		NULL,
+		0}};
+
+	//Server info:
+	//COSERVERINFO CoServerInfo =
+    //{
+	//	/*dwReserved1*/ 0,
+	//	/*pwszName*/ REMOTE_SERVER_NAME,
+	//	/*COAUTHINFO*/  NULL,
+	//	/*dwReserved2*/ 0
+    //}; 
+
+	// create an instance of the IOPCServer (COM intance)
+	hr = CoCreateInstanceEx(CLSID_OPCServer, NULL, CLSCTX_SERVER, /*&CoServerInfo*/ NULL, cmq, queue);
+	if (FAILED(hr) || FAILED(queue[0].hr)){
+		printf("Failed call to CoCreateInstanceEx. Error code = %x\n",
+			FAILED(hr) ? hr : queue[0].hr);
+		return NULL;
+	}
+
+	// return a pointer to the IOPCServer interface:
+	return(IOPCServer*) queue[0].pItf;
+}
+
+
+/////////////////////////////////////////////////////////////////////
+// Add group "Group1" to the Server whose IOPCServer interface
+// is pointed by pIOPCServer. 
+// Returns a pointer to the IOPCItemMgt interface of the added group
+// and a server opc handle to the added group, or false on failure.
+//
+bool AddTheGroup(IOPCServer* pIOPCServer, IOPCItemMgt* &pIOPCItemMgt, 
+				 OPCHANDLE& hServerGroup)
+{
+	DWORD dwUpdateRate = 0;
+	OPCHANDLE hClientGroup = 0;
+
+	// pIOPCServer: instance of the OPCServer COM Interface 
+
+    HRESULT hr = pIOPCServer->AddGroup(/*szName*/ L"Group1",
+		/*bActive*/ FALSE,
+		/*dwRequestedUpdateRate*/ 1000,
+		/*hClientGroup*/ hClientGroup,
+		/*pTimeBias*/ 0,
+		/*pPercentDeadband*/ 0,
+		/*dwLCID*/0,
+		/*phServerGroup*/&hServerGroup,
+		&dwUpdateRate,
+		/*riid*/ IID_IOPCItemMgt,
+		/*ppUnk*/ (IUnknown**) &pIOPCItemMgt);
+	if (FAILED(hr)){
+		printf("Failed call to AddGroup function. Error code = %x\n", hr);
+		pIOPCItemMgt = NULL;
+		return false;
+	}
+	return true;
+}
+
+
+
+//////////////////////////////////////////////////////////////////
+// Add the Item ITEM_ID to the group whose IOPCItemMgt interface
+// is pointed by pIOPCItemMgt pointer. Return a server opc handle
+// to the item.
+ 
+void AddTheItem(IOPCItemMgt* pIOPCItemMgt, OPCHANDLE& hServerItem, wchar_t* ITEM_ID, int VT, int identifier)
+{
+	HRESULT hr;
+
+	// Array of items to add:
+	OPCITEMDEF ItemArray[1] =
+	{{
+	/*szAccessPath*/ L"",
+	/*szItemID*/ ITEM_ID,
+	/*bActive*/ TRUE,
+	/*hClient*/ identifier,
+	/*dwBlobSize*/ 0,
+	/*pBlob*/ NULL,
+	/*vtRequestedDataType*/ VT,
+	/*wReserved*/0
+	}};
+
+	//Add Result:
+	OPCITEMRESULT* pAddResult=NULL;
+	HRESULT* pErrors = NULL;
+
+	// Add an Item to the previous Group:
+	hr = pIOPCItemMgt->AddItems(1, ItemArray, &pAddResult, &pErrors);
+	if (hr != S_OK){
+		printf("Failed call to AddItems function. Error code = %x\n", hr);
+		exit(0);
+	}
+
+	// Server handle for the added item:
+	hServerItem = pAddResult[0].hServer;
+
+	// release memory allocated by the server:
+	CoTaskMemFree(pAddResult->pBlob);
+
+	CoTaskMemFree(pAddResult);
+	pAddResult = NULL;
+
+	CoTaskMemFree(pErrors);
+	pErrors = NULL;
+}
+
+//////////////////////////////////////////////////////////////////
+// Add all the "count" items to the group whose IOPCItemMgt interface
+// is pointed by pIOPCItemMgt in a single AddItems call, storing the
+// server opc handle of each one in its item_handle field. Items the
+// server rejects are reported and get a handle of 0; if "accepted" is
+// not NULL, accepted[i] tells whether items[i] was added. Returns false
+// only if the AddItems call itself failed, in which case no item was.
+ 
+bool AddTheItems(IOPCItemMgt* pIOPCItemMgt, Opc_item** items, DWORD count, bool* accepted)
+{
+	HRESULT hr;
+
+	// Array of items to add:
+	std::vector<OPCITEMDEF> ItemArray(count);
+	for (DWORD i = 0; i < count; i++){
+		ItemArray[i].szAccessPath = L"";
+		ItemArray[i].szItemID = items[i]->item_id;
+		ItemArray[i].bActive = TRUE;
+		ItemArray[i].hClient = items[i]->id;
+		ItemArray[i].dwBlobSize = 0;
+		ItemArray[i].pBlob = NULL;
+		ItemArray[i].vtRequestedDataType = items[i]->type;
+		ItemArray[i].wReserved = 0;
+	}
+
+	//Add Result:
+	OPCITEMRESULT* pAddResult=NULL;
+	HRESULT* pErrors = NULL;
+
+	// Add the Items to the previous Group:
+	hr = pIOPCItemMgt->AddItems(count, ItemArray.data(), &pAddResult, &pErrors);
+	if (FAILED(hr)){
+		printf("Failed call to AddItems function. Error code = %x\n", hr);
+		for (DWORD i = 0; i < count; i++){
+			items[i]->item_handle = 0;
+			if (accepted != NULL) accepted[i] = false;
+		}
+		return false;
+	}
+
+	for (DWORD i = 0; i < count; i++){
+		if (accepted != NULL) accepted[i] = SUCCEEDED(pErrors[i]);
+		if (FAILED(pErrors[i])){
+			printf("Failed to add item %S. Error code = %x\n", items[i]->item_id, pErrors[i]);
+			items[i]->item_handle = 0;
+			continue;
+		}
+		// Server handle for the added item:
+		items[i]->item_handle = pAddResult[i].hServer;
+
+		// release memory allocated by the server:
+		CoTaskMemFree(pAddResult[i].pBlob);
+	}
+
+	CoTaskMemFree(pAddResult);
+	pAddResult = NULL;
+
+	CoTaskMemFree(pErrors);
+	pErrors = NULL;
+
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Read from device the value of the item having the "hServerItem" server 
+// handle and belonging to the group whose one interface is pointed by
+// pGroupIUnknown. The value is put in varValue. 
+//
+void ReadItem(IUnknown* pGroupIUnknown, OPCHANDLE hServerItem, VARIANT& varValue,
+	WORD* quality, FILETIME* timestamp)
+{
+	// value of the item:
+	OPCITEMSTATE* pValue = NULL;
+
+	//get a pointer to the IOPCSyncIOInterface:
+	IOPCSyncIO* pIOPCSyncIO;
+	pGroupIUnknown->QueryInterface(__uuidof(pIOPCSyncIO), (void**) &pIOPCSyncIO);
+
+	// read the item value from the device:
+	HRESULT* pErrors = NULL; //to store error code(s)
+	HRESULT hr = pIOPCSyncIO->Read(OPC_DS_DEVICE, 1, &hServerItem, &pValue, &pErrors);
+	_ASSERT(!hr);
+	_ASSERT(pValue!=NULL);
+
+	varValue = pValue[0].vDataValue;
+	if (quality != NULL) *quality = pValue[0].wQuality;
+	if (timestamp != NULL) *timestamp = pValue[0].ftTimeStamp;
+
+	//Release memeory allocated by the OPC server:
+	CoTaskMemFree(pErrors);
+	pErrors = NULL;
+
+	CoTaskMemFree(pValue);
+	pValue = NULL;
+
+	// release the reference to the IOPCSyncIO interface:
+	pIOPCSyncIO->Release();
+}
+
+void WriteItem(IUnknown* pGroupIUnknown, OPCHANDLE hServerItem, VARIANT * varValue)
+{
+	// Items the server rejected are not in the group (see AddTheItems())
+	if (hServerItem == 0)
+		return;
+
+	//get a pointer to the IOPCSyncIOInterface:
+	IOPCSyncIO* pIOPCSyncIO;
+	HRESULT hr = pGroupIUnknown->QueryInterface(__uuidof(pIOPCSyncIO), (void**)&pIOPCSyncIO);
+	if (hr != S_OK){
+		// The server may have died; the session watchdog takes care of it.
+		printf("Could not obtain a pointer to IOPCSyncIO. Error = %x\n", hr);
+		return;
+	}
+
+	// write the item value to the device:
+	HRESULT* pErrors = NULL; //to store error code(s)
+	hr = pIOPCSyncIO->Write(1, &hServerItem, varValue, &pErrors);
+	if (hr != S_OK)
+		printf("Failed call to IOPCSyncIO::Write. Error code = %x\n", hr);
+
+	//Release memeory allocated by the OPC server:
+	CoTaskMemFree(pErrors);
+	pErrors = NULL;
+
+	// release the reference to the IOPCSyncIO interface:
+	pIOPCSyncIO->Release();
+}
+
+///////////////////////////////////////////////////////////////////////////
+// Remove the item whose server handle is hServerItem from the group
+// whose IOPCItemMgt interface is pointed by pIOPCItemMgt
+//
+void RemoveItem(IOPCItemMgt* pIOPCItemMgt, OPCHANDLE hServerItem)
+{
+	// server handle of items to remove:
+	OPCHANDLE hServerArray[1];
+	hServerArray[0] = hServerItem;
+	
+	//Remove the item:
+	HRESULT* pErrors; // to store error code(s)
+	HRESULT hr = pIOPCItemMgt->RemoveItems(1, hServerArray, &pErrors);
+	_ASSERT(!hr);
+
+	//release memory allocated by the server:
+	CoTaskMemFree(pErrors);
+	pErrors = NULL;
+}
+
+////////////////////////////////////////////////////////////////////////
+// Remove the Group whose server handle is hServerGroup from the server
+// whose IOPCServer interface is pointed by pIOPCServer
+//
+void RemoveGroup (IOPCServer* pIOPCServer, OPCHANDLE hServerGroup)
+{
+	// Remove the group:
+	HRESULT hr = pIOPCServer->RemoveGroup(hServerGroup, FALSE);
+	if (hr != S_OK){
+		if (hr == OPC_S_INUSE)
+			printf ("Failed to remove OPC group: object still has references to it.\n");
+		else printf ("Failed to remove OPC group. Error code = %x\n", hr);
+		exit(0);
+	}
+}
@@ -0,0 +1,349 @@
+//
+// C++ class that owns the client's subscription on the OPC server and is
+// able to rebuild it from scratch after the server process is restarted.
+//
+// The server instance, group, items, connection point advise and group
+// activation are always created in the same order, both at startup and
+// during recovery, so there is a single code path to get right.
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+#include <chrono>
+#include <memory>
+#include "SimpleOPCClient_v3.h"
+#include "SOCSession.h"
+#include "SOCWrapperFunctions.h"
+
+//	Constructor. The session starts closed; call Open() to build it.
+SOCSession::SOCSession (
+	wchar_t* server_name,
+	std::vector<Opc_item*> items,
+	std::vector<Opc_item*> sampled_items,
+	DWORD sampling_rate,
+	DWORD keep_alive,
+	SOCDataCallback* callback,
+	std::mutex* opc_mutex,
+	Opc_server_factory factory
+) {
+	this->server_name = server_name;
+	this->items = items;
+	this->sampled_items = sampled_items;
+	this->sampling_rate = sampling_rate;
+	this->requested_keep_alive = keep_alive;
+	this->keep_alive = keep_alive;
+	this->server_keep_alive = false;
+	this->callback = callback;
+	this->opc_mutex = opc_mutex;
+	this->factory = (factory != NULL) ? factory : InstantiateServer;
+
+	memset(&current, 0, sizeof(current));
+
+	stats.recoveries = 0;
+	stats.failed_attempts = 0;
+	stats.last_recovery_time = 0;
+	stats.max_recovery_time = 0;
+	stats.total_recovery_time = 0;
+}
+
+//	Destructor
+SOCSession::~SOCSession (){
+	Close();
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Build the whole subscription and activate the group. On failure anything
+// partially built is released again and false is returned.
+//
+// The server calls are made without opc_mutex, which only guards handing
+// the finished session over to the jobs: a server starting up, or dying
+// halfway, can take seconds to answer, and the jobs must not wait for it.
+//
+bool SOCSession::Open ()
+{
+	Server_objects built;
+	std::lock_guard<std::mutex> lock(session_mutex);
+
+	memset(&built, 0, sizeof(built));
+	if (!Build(built)){
+		Release(built);
+		return false;
+	}
+
+	opc_mutex->lock();
+	current = built;
+	opc_mutex->unlock();
+
+	// Activate outside of opc_mutex: the server sends the current values
+	// right away, and OnDataChange must be able to store them.
+	Activate();
+	return true;
+}
+
+// Instantiate the server, add the group and all of its items in one call,
+// and advise the data callback, into "built". Must be called with
+// session_mutex held.
+bool SOCSession::Build (Server_objects& built)
+{
+	built.server = factory(server_name);
+	if (built.server == NULL)
+		return false;
+
+	if (!AddTheGroup(built.server, built.item_mgt, built.group))
+		return false;
+
+	// Items the server rejects (unknown IDs, unsupported types) are
+	// reported by AddTheItems() and dropped from the session, instead of
+	// failing the whole of it.
+	std::unique_ptr<bool[]> accepted(new bool[items.size() + 1]);
+	if (!AddTheItems(built.item_mgt, items.data(), (DWORD) items.size(), accepted.get()))
+		return false;
+	DropRejected(accepted.get());
+
+	// Failing to set the sampling rate is not fatal; the items are then
+	// sampled at the group rate (see SetItemSampling()).
+	for (size_t i = 0; i < sampled_items.size(); i++)
+		SetItemSampling(built.item_mgt, sampled_items[i]->item_handle, sampling_rate, TRUE);
+
+	SetDataCallback(built.item_mgt, callback, built.connection_point, &built.cookie);
+	if (built.connection_point == NULL || built.cookie == 0)
+		return false;
+
+	keep_alive = SetGroupKeepAlive(built.item_mgt, requested_keep_alive);
+	server_keep_alive = (keep_alive != 0);
+	if (keep_alive == 0){
+		// Without server support a quiet group looks the same as a dead
+		// server: the watchdog then asks the server (see Responding())
+		// after a period well above the update rate.
+		keep_alive = requested_keep_alive;
+	}
+	return true;
+}
+
+// Remove the items AddTheItems() did not accept (accepted[i] false for
+// items[i]) from the item lists, so that recoveries do not ask for them
+// again.
+void SOCSession::DropRejected (const bool* accepted)
+{
+	std::vector<Opc_item*> kept;
+
+	for (size_t i = 0; i < items.size(); i++){
+		if (accepted[i]){
+			kept.push_back(items[i]);
+			continue;
+		}
+		printf("Item %S rejeitado pelo servidor OPC e removido da sessao. \n", items[i]->item_id);
+		for (size_t k = 0; k < sampled_items.size(); k++){
+			if (sampled_items[k] == items[i]){
+				sampled_items.erase(sampled_items.begin() + k);
+				break;
+			}
+		}
+	}
+	items.swap(kept);
+}
+
+// Change the group to the ACTIVE state so that we can receive the
+// server's callback notification
+void SOCSession::Activate ()
+{
+	IOPCItemMgt* pItemMgt;
+
+	opc_mutex->lock();
+	pItemMgt = current.item_mgt;
+	if (pItemMgt != NULL) pItemMgt->AddRef();
+	opc_mutex->unlock();
+
+	if (pItemMgt != NULL){
+		SetGroupActive(pItemMgt);
+		pItemMgt->Release();
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Tear the session down. It is taken from the jobs under opc_mutex, so that
+// they see it down from then on, and released after the mutex is let go:
+// on a dead server each of the calls waits for an RPC timeout.
+//
+void SOCSession::Close ()
+{
+	Server_objects closing;
+	std::lock_guard<std::mutex> lock(session_mutex);
+
+	opc_mutex->lock();
+	closing = current;
+	memset(&current, 0, sizeof(current));
+	opc_mutex->unlock();
+
+	Release(closing);
+}
+
+// Release everything obtained from the server. When the server process is
+// dead the calls below fail with RPC errors, which are only reported; the
+// local proxies are released all the same.
+void SOCSession::Release (Server_objects& objects)
+{
+	HRESULT hr;
+
+	if (objects.connection_point != NULL){
+		if (objects.cookie != 0)
+			// Also releases the connection point
+			CancelDataCallback(objects.connection_point, objects.cookie);
+		else
+			objects.connection_point->Release();
+	}
+	objects.connection_point = NULL;
+	objects.cookie = 0;
+
+	// The group can only be removed once we hold no references to it.
+	bool has_group = (objects.item_mgt != NULL);
+	if (objects.item_mgt != NULL){
+		objects.item_mgt->Release();
+		objects.item_mgt = NULL;
+	}
+
+	if (objects.server != NULL){
+		if (has_group){
+			hr = objects.server->RemoveGroup(objects.group, FALSE);
+			if (hr != S_OK)
+				printf ("Failed to remove OPC group. Error code = %x\n", hr);
+		}
+		objects.server->Release();
+		objects.server = NULL;
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Rebuild the session after the OPC server was lost, retrying with an
+// exponential backoff (0.5 s up to 8 s) until it succeeds or keep_running
+// turns false. Returns true if the session was recovered.
+//
+bool SOCSession::Recover (const bool& keep_running, HANDLE stop_event)
+{
+	ULONGLONG start = GetTickCount64();
+	DWORD backoff = 500;
+
+	printf("Recuperando sessao OPC... \n");
+	while (keep_running){
+		Close();
+		if (Open()){
+			ULONGLONG elapsed = GetTickCount64() - start;
+
+			stats_mutex.lock();
+			stats.recoveries++;
+			stats.last_recovery_time = elapsed;
+			if (elapsed > stats.max_recovery_time) stats.max_recovery_time = elapsed;
+			stats.total_recovery_time += elapsed;
+			stats_mutex.unlock();
+
+			printf("Sessao OPC recuperada em %llu ms. \n", elapsed);
+			return true;
+		}
+
+		stats_mutex.lock();
+		stats.failed_attempts++;
+		stats_mutex.unlock();
+
+		if (stop_event != NULL)
+			WaitForSingleObject(stop_event, backoff);
+		else
+			std::this_thread::sleep_for(std::chrono::milliseconds(backoff));
+		if (backoff < 8000) backoff *= 2;
+	}
+	return false;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Add items to the running group with a single AddItems call; the ones
+// the server rejects are reported and left out. If the session is down
+// they are only recorded, and Open() adds them with the rest of the items.
+//
+bool SOCSession::Subscribe (const std::vector<Opc_item*>& new_items)
+{
+	IOPCItemMgt* pItemMgt;
+
+	if (new_items.empty())
+		return true;
+
+	std::lock_guard<std::mutex> lock(session_mutex);
+	opc_mutex->lock();
+	pItemMgt = current.item_mgt;
+	if (pItemMgt != NULL) pItemMgt->AddRef();
+	opc_mutex->unlock();
+	if (pItemMgt == NULL){
+		// Open() adds them, and drops the ones the server rejects
+		items.insert(items.end(), new_items.begin(), new_items.end());
+		return true;
+	}
+
+	// Only the items the server accepted join the session, so that
+	// recoveries do not ask for the rejected ones again
+	std::vector<Opc_item*> added(new_items);
+	std::unique_ptr<bool[]> accepted(new bool[added.size()]);
+	bool ok = AddTheItems(pItemMgt, added.data(), (DWORD) added.size(), accepted.get());
+	pItemMgt->Release();
+	for (size_t i = 0; i < added.size(); i++){
+		if (accepted[i])
+			items.push_back(added[i]);
+	}
+	return ok;
+}
+
+bool SOCSession::IsOpen () const
+{
+	return current.item_mgt != NULL;
+}
+
+// Must be called with opc_mutex held, and the pointer must not be used
+// after the mutex is released.
+IOPCItemMgt* SOCSession::ItemMgt () const
+{
+	return current.item_mgt;
+}
+
+// The caller must Release() the returned pointer. Holding it does not
+// block the other users of opc_mutex, which makes it suitable for long
+// operations such as browsing the server address space.
+IOPCServer* SOCSession::AcquireServer ()
+{
+	std::lock_guard<std::mutex> lock(*opc_mutex);
+	if (current.server != NULL) current.server->AddRef();
+	return current.server;
+}
+
+DWORD SOCSession::KeepAlive () const
+{
+	return keep_alive;
+}
+
+bool SOCSession::ServerKeepAlive () const
+{
+	return server_keep_alive;
+}
+
+// A single IOPCServer::GetStatus round trip, made without opc_mutex. It
+// fails at once with an RPC error when the server process is gone.
+bool SOCSession::Responding ()
+{
+	OPCSERVERSTATUS* pStatus = NULL;
+	IOPCServer* pServer = AcquireServer();
+
+	if (pServer == NULL)
+		return false;
+	HRESULT hr = pServer->GetStatus(&pStatus);
+	pServer->Release();
+	if (FAILED(hr) || pStatus == NULL)
+		return false;
+
+	bool running = (pStatus->dwServerState != OPC_STATUS_FAILED);
+	CoTaskMemFree(pStatus->szVendorInfo);
+	CoTaskMemFree(pStatus);
+	return running;
+}
+
+Opc_recovery_stats SOCSession::RecoveryStats ()
+{
+	std::lock_guard<std::mutex> lock(stats_mutex);
+	return stats;
+}
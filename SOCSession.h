@@ -0,0 +1,105 @@
+// Class that owns everything the client builds on the OPC server: the
+// server instance, the group, its items, the IOPCDataCallback connection
+// point and the group's sampling and keep-alive settings.
+//
+// Keeping all of it in one place allows the whole subscription to be torn
+// down and rebuilt when the OPC server process dies and is restarted, so
+// that the gateway does not have to be restarted by hand.
+//
+
+#include "opcda.h"
+
+#ifndef _SOCSESSION_H
+#define _SOCSESSION_H
+
+#include <vector>
+#include <mutex>
+#include "SOCDataCallback.h"
+
+// Creates the server instance. Defaults to InstantiateServer(); a test can
+// pass a factory returning an in-process stand-in server instead.
+typedef IOPCServer* (*Opc_server_factory)(wchar_t* server_name);
+
+// Recovery-time metrics. All times in ms.
+struct Opc_recovery_stats {
+	unsigned int recoveries;		// successful rebuilds of the session
+	unsigned int failed_attempts;	// attempts that did not get to an active group
+	ULONGLONG last_recovery_time;	// from the start of the recovery to an active group
+	ULONGLONG max_recovery_time;
+	ULONGLONG total_recovery_time;
+};
+
+// **************************************************************************
+class SOCSession
+	{
+	public:
+		SOCSession (
+			wchar_t* server_name,
+			std::vector<Opc_item*> items,			// all items of the group
+			std::vector<Opc_item*> sampled_items,	// items sampled faster than the group rate
+			DWORD sampling_rate,
+			DWORD keep_alive,
+			SOCDataCallback* callback,
+			std::mutex* opc_mutex,
+			Opc_server_factory factory = NULL
+		);
+		~SOCSession ();
+
+		// Build the server, group, items and advise, then activate the group.
+		// Items the server rejects are reported and left out of the session.
+		bool Open ();
+		// Tear the session down. Errors from a dead server are ignored.
+		void Close ();
+		// Close and reopen until it succeeds or keep_running turns false.
+		// The waits between attempts end early when stop_event is set.
+		bool Recover (const bool& keep_running, HANDLE stop_event = NULL);
+		// Add items to the group in one AddItems call. Those the server
+		// accepts are also added again whenever the session is rebuilt.
+		bool Subscribe (const std::vector<Opc_item*>& new_items);
+
+		bool IsOpen () const;
+		IOPCItemMgt* ItemMgt () const;		// NULL while the session is down
+		IOPCServer* AcquireServer ();		// AddRef'ed server, or NULL while down
+		DWORD KeepAlive () const;			// keep-alive time revised by the server
+		bool ServerKeepAlive () const;		// the server sends keep-alive callbacks
+		// The server answers a status request and is not failed. For
+		// servers without keep-alive, where a quiet group says nothing.
+		bool Responding ();
+		Opc_recovery_stats RecoveryStats ();
+
+	private:
+		// What the server gave us for one session
+		struct Server_objects {
+			IOPCServer* server;
+			IOPCItemMgt* item_mgt;
+			OPCHANDLE group;
+			IConnectionPoint* connection_point;
+			DWORD cookie;
+		};
+
+		bool Build (Server_objects& built);
+		void DropRejected (const bool* accepted);
+		void Activate ();
+		static void Release (Server_objects& objects);
+
+		wchar_t* server_name;
+		std::vector<Opc_item*> items;
+		std::vector<Opc_item*> sampled_items;
+		DWORD sampling_rate;
+		DWORD requested_keep_alive;
+		DWORD keep_alive;
+		bool server_keep_alive;
+		SOCDataCallback* callback;
+		std::mutex* opc_mutex;
+		Opc_server_factory factory;
+
+		// Serializes Open(), Close() and Subscribe(), which make their
+		// server calls without opc_mutex; guards the item lists
+		std::mutex session_mutex;
+		Server_objects current;		// guarded by opc_mutex
+
+		std::mutex stats_mutex;
+		Opc_recovery_stats stats;
+	};
+
+#endif // _SOCSESSION_H
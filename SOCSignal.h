@@ -0,0 +1,72 @@
+// Change notification between the gateway threads.
+//
+// A signal is a generation counter bumped by Notify(). A waiter remembers
+// the last generation it has seen and sleeps until the counter moves past
+// it, so a notification sent between reading the state and calling Wait()
+// is never lost, and any number of threads may wait on the same signal:
+//
+//   uint32_t seen = wake.Generation();
+//   if (!work_pending)
+//       wake.Wait(seen, INFINITE);
+//
+// Generation() and the check of the state it guards need no lock; only
+// the sleep itself takes the signal's mutex.
+//
+// SOCTimerWheel sleeps on one between deadlines, and Trigger() and Stop()
+// wake it. (The gateway loops once waited on link and position signals of
+// their own; the timer wheel jobs replaced them.)
+//
+
+#ifndef _SOCSIGNAL_H
+#define _SOCSIGNAL_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <stdint.h>
+
+#ifndef INFINITE
+#define INFINITE 0xFFFFFFFF
+#endif
+
+// **************************************************************************
+class SOCSignal
+	{
+	public:
+		SOCSignal () : generation(0) {}
+
+		void Notify ()
+		{
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				generation.fetch_add(1, std::memory_order_release);
+			}
+			changed.notify_all();
+		}
+
+		uint32_t Generation () const
+		{
+			return generation.load(std::memory_order_acquire);
+		}
+
+		// Sleep until the generation differs from "seen" or "timeout_ms"
+		// elapses (INFINITE: no timeout). Returns the current generation.
+		uint32_t Wait (uint32_t seen, unsigned long timeout_ms)
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			auto moved = [this, seen] { return generation.load(std::memory_order_acquire) != seen; };
+			if (timeout_ms == INFINITE)
+				changed.wait(lock, moved);
+			else
+				changed.wait_for(lock, std::chrono::milliseconds(timeout_ms), moved);
+			return generation.load(std::memory_order_acquire);
+		}
+
+	private:
+		std::atomic<uint32_t> generation;
+		std::mutex mutex;
+		std::condition_variable changed;
+	};
+
+#endif // _SOCSIGNAL_H
@@ -0,0 +1,80 @@
+//
+// C++ class waiting on the socket of a link or the stop event, whichever
+// comes first.
+//
+
+#include "SOCSocketWait.h"
+
+//	Constructor
+SOCSocketWait::SOCSocketWait ()
+	: event(WSACreateEvent())
+{
+}
+
+//	Destructor
+SOCSocketWait::~SOCSocketWait ()
+{
+	if (event != WSA_INVALID_EVENT)
+		WSACloseEvent(event);
+}
+
+int SOCSocketWait::Connect (SOCKET s, const struct sockaddr* addr, int addrlen, HANDLE stop_event)
+{
+	// Selecting the events makes the socket non-blocking, so connect()
+	// only starts the connection
+	if (event == WSA_INVALID_EVENT)
+		return WSA_INVALID_HANDLE;
+	if (WSAEventSelect(s, event, FD_CONNECT) == SOCKET_ERROR)
+		return WSAGetLastError();
+
+	int error = 0;
+	if (connect(s, addr, addrlen) == SOCKET_ERROR){
+		error = WSAGetLastError();
+		if (error == WSAEWOULDBLOCK)
+			error = Wait(s, INFINITE, stop_event); // The stack times out on its own
+	}
+	Release(s);
+	return error;
+}
+
+int SOCSocketWait::Readable (SOCKET s, DWORD timeout_ms, HANDLE stop_event)
+{
+	// Data already there, or a connection already closed, signal the event
+	// at once
+	if (event == WSA_INVALID_EVENT)
+		return WSA_INVALID_HANDLE;
+	if (WSAEventSelect(s, event, FD_READ | FD_CLOSE) == SOCKET_ERROR)
+		return WSAGetLastError();
+
+	int error = Wait(s, timeout_ms, stop_event);
+	Release(s);
+	return error;
+}
+
+int SOCSocketWait::Wait (SOCKET s, DWORD timeout_ms, HANDLE stop_event)
+{
+	HANDLE handles[2] = { event, stop_event };
+	DWORD result = WaitForMultipleObjects(2, handles, FALSE, timeout_ms);
+	if (result == WAIT_OBJECT_0 + 1)
+		return WSAEINTR;
+	if (result == WAIT_TIMEOUT)
+		return WSAETIMEDOUT;
+	if (result != WAIT_OBJECT_0)
+		return (int) GetLastError();
+
+	WSANETWORKEVENTS happened;
+	if (WSAEnumNetworkEvents(s, event, &happened) == SOCKET_ERROR)
+		return WSAGetLastError();
+	if (happened.lNetworkEvents & FD_CONNECT)
+		return happened.iErrorCode[FD_CONNECT_BIT];
+	return 0; // Readable: recv() reports a close or a reset itself
+}
+
+void SOCSocketWait::Release (SOCKET s)
+{
+	// Deselecting leaves the socket non-blocking: put it back
+	u_long blocking = 0;
+	WSAEventSelect(s, NULL, 0);
+	ioctlsocket(s, FIONBIO, &blocking);
+	WSAResetEvent(event);
+}
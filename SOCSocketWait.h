@@ -0,0 +1,44 @@
+// Socket waits that give up at shutdown.
+//
+// A blocking connect() to an unreachable web server takes about 21 s to
+// fail, and a blocking recv() waits for as long as the server keeps
+// quiet, and neither gives way to a shutdown. Here the socket
+// events are selected onto an event object (WSAEventSelect) and waited for
+// together with the stop event of the client, so a shutdown ends the wait
+// at once. The socket is back in blocking mode when a call returns.
+//
+// The calls on one object must not overlap: each link has its own, used
+// with the link mutex held.
+//
+
+#include <winsock2.h>
+
+#ifndef _SOCSOCKETWAIT_H
+#define _SOCSOCKETWAIT_H
+
+// **************************************************************************
+class SOCSocketWait
+	{
+	public:
+		SOCSocketWait ();
+		~SOCSocketWait ();
+
+		// Connect "s" to "addr". Returns 0 once connected, WSAEINTR if
+		// "stop_event" (manual reset) was set first, or the error of the
+		// connection.
+		int Connect (SOCKET s, const struct sockaddr* addr, int addrlen, HANDLE stop_event);
+
+		// Wait until "s" can be read without blocking (data, or the
+		// connection closed or reset), for at most "timeout_ms" ms
+		// (INFINITE: no timeout). Returns 0 when it can, WSAETIMEDOUT,
+		// WSAEINTR if "stop_event" was set first, or a socket error.
+		int Readable (SOCKET s, DWORD timeout_ms, HANDLE stop_event);
+
+	private:
+		int Wait (SOCKET s, DWORD timeout_ms, HANDLE stop_event);
+		void Release (SOCKET s);
+
+		WSAEVENT event;
+	};
+
+#endif // _SOCSOCKETWAIT_H
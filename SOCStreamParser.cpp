@@ -0,0 +1,153 @@
+//
+// C++ class that decodes the OPC DA 1.0 data stream in place.
+//
+// Headers and VARIANTs are copied out with memcpy(), since the server does
+// not have to align them; everything else is left where it is.
+//
+
+#include <stddef.h>
+#include <string.h>
+#include "SOCStreamParser.h"
+
+//	Constructor. Only the group header is read here.
+SOCStreamParser::SOCStreamParser (const BYTE* data, size_t size)
+{
+	this->data = data;
+	this->size = size;
+	memset(&header, 0, sizeof(header));
+	valid = false;
+
+	if (data == NULL || size < sizeof(OPCGROUPHEADER))
+		return;
+	memcpy(&header, data, sizeof(OPCGROUPHEADER));
+
+	// The header gives the size of the data actually written, which may
+	// be less than the size of the memory block.
+	if (header.dwSize >= sizeof(OPCGROUPHEADER) && header.dwSize < this->size)
+		this->size = header.dwSize;
+
+	if (header.dwItemCount > (this->size - sizeof(OPCGROUPHEADER)) / sizeof(OPCITEMHEADER1))
+		return;
+	valid = true;
+}
+
+bool SOCStreamParser::Valid () const
+{
+	return valid;
+}
+
+const OPCGROUPHEADER& SOCStreamParser::GroupHeader () const
+{
+	return header;
+}
+
+DWORD SOCStreamParser::Count () const
+{
+	return valid ? header.dwItemCount : 0;
+}
+
+bool SOCStreamParser::Fits (size_t offset, size_t length) const
+{
+	return offset <= size && length <= size - offset;
+}
+
+bool SOCStreamParser::Item (DWORD index, Opc_stream_item& item) const
+{
+	DWORD value_offset;
+
+	if (index >= Count())
+		return false;
+
+	// Fields read one by one, straight from the block: copying the whole
+	// header out and reading it back stalls on store forwarding
+	const BYTE* itemheader = data + sizeof(OPCGROUPHEADER) + index * sizeof(OPCITEMHEADER1);
+	memcpy(&item.client_handle, itemheader + offsetof(OPCITEMHEADER1, hClient), sizeof(OPCHANDLE));
+	memcpy(&value_offset, itemheader + offsetof(OPCITEMHEADER1, dwValueOffset), sizeof(DWORD));
+	memcpy(&item.quality, itemheader + offsetof(OPCITEMHEADER1, wQuality), sizeof(WORD));
+	memcpy(&item.timestamp, itemheader + offsetof(OPCITEMHEADER1, ftTimeStampItem), sizeof(FILETIME));
+	item.data = NULL;
+	item.data_size = 0;
+	item.dims = 0;
+	item.element_size = 0;
+	item.elements = 0;
+
+	size_t offset = value_offset;
+	if (!Fits(offset, sizeof(VARIANT))){
+		memset(&item.value, 0, sizeof(VARIANT));
+		return false;
+	}
+	memcpy(&item.value, data + offset, sizeof(VARIANT));
+	offset += sizeof(VARIANT);
+
+	// Pointers in the VARIANT are the server's and are meaningless here;
+	// they are either rebuilt below or cleared.
+	VARTYPE vt = item.value.vt;
+	if (vt == VT_BSTR)
+		return ReadString(offset, item);
+	if (vt & VT_ARRAY)
+		return ReadArray(offset, item);
+	if ((vt & VT_BYREF) || vt == VT_VARIANT || vt == VT_UNKNOWN || vt == VT_DISPATCH)
+		return false;
+	return true;
+}
+
+// VARIANT, DWORD byte count (without the NUL), characters, NUL
+bool SOCStreamParser::ReadString (size_t offset, Opc_stream_item& item) const
+{
+	DWORD length;
+
+	item.value.bstrVal = NULL;
+	if (!Fits(offset, sizeof(DWORD)))
+		return false;
+	memcpy(&length, data + offset, sizeof(DWORD));
+	offset += sizeof(DWORD);
+
+	if (length % sizeof(OLECHAR) != 0 || !Fits(offset, (size_t) length + sizeof(OLECHAR)))
+		return false;
+	if (*(const OLECHAR*) (data + offset + length) != 0)
+		return false;
+
+	item.data = data + offset;
+	item.data_size = length;
+	if (length > 0)
+		item.value.bstrVal = (BSTR) (data + offset);
+	return true;
+}
+
+// VARIANT, SAFEARRAY, extra SAFEARRAYBOUNDs, elements
+bool SOCStreamParser::ReadArray (size_t offset, Opc_stream_item& item) const
+{
+	SAFEARRAY sa;
+
+	item.value.parray = NULL;
+	if ((item.value.vt & VT_TYPEMASK) == VT_BSTR || (item.value.vt & VT_BYREF))
+		return false;		// elements with pointers of their own
+	if (!Fits(offset, sizeof(SAFEARRAY)))
+		return false;
+	memcpy(&sa, data + offset, sizeof(SAFEARRAY));
+	offset += sizeof(SAFEARRAY);
+
+	if (sa.cDims < 1 || sa.cDims > 2 || sa.cbElements == 0 || sa.cbElements > 8)
+		return false;
+	item.dims = sa.cDims;
+	item.element_size = sa.cbElements;
+	item.bounds[0] = sa.rgsabound[0];
+
+	ULONGLONG elements = sa.rgsabound[0].cElements;
+	if (sa.cDims == 2){
+		if (!Fits(offset, sizeof(SAFEARRAYBOUND)))
+			return false;
+		memcpy(&item.bounds[1], data + offset, sizeof(SAFEARRAYBOUND));
+		offset += sizeof(SAFEARRAYBOUND);
+		elements *= item.bounds[1].cElements;
+	}
+
+	ULONGLONG bytes = elements * sa.cbElements;
+	if (bytes > size || !Fits(offset, (size_t) bytes))
+		return false;
+
+	item.elements = (DWORD) elements;
+	item.data = data + offset;
+	item.data_size = (DWORD) bytes;
+	return true;
+}
@@ -0,0 +1,66 @@
+// Parser for the OPC DA 1.0 data stream passed to IAdviseSink::OnDataChange.
+//
+// The stream is a block of global memory holding an OPCGROUPHEADER, an
+// array of OPCITEMHEADER1 (one per item) and the item values, each at the
+// dwValueOffset of its header. A value is a VARIANT, followed for strings
+// by a DWORD byte count and the NUL-terminated characters, and for arrays
+// by the SAFEARRAY descriptor, one more SAFEARRAYBOUND per extra dimension
+// and the elements.
+//
+// The parser reads the block in place: nothing is copied except the fixed
+// size headers, and string and array data are returned as pointers into
+// the block. Every offset and length is checked against the block size,
+// so a malformed stream makes Item() fail instead of reading past the end.
+//
+
+#include "opcda.h"
+
+#ifndef _SOCSTREAMPARSER_H
+#define _SOCSTREAMPARSER_H
+
+// One item of the stream. Pointers refer to the parsed block and are only
+// valid while it is locked.
+struct Opc_stream_item {
+	OPCHANDLE client_handle;
+	WORD quality;
+	FILETIME timestamp;
+	VARIANT value;				// for VT_BSTR, bstrVal points into the block;
+								// for arrays, parray is NULL (see below)
+	const BYTE* data;			// VT_BSTR: characters, VT_ARRAY: elements
+	DWORD data_size;			// bytes at "data"
+	USHORT dims;				// VT_ARRAY: 1 or 2
+	ULONG element_size;			// VT_ARRAY: bytes per element
+	DWORD elements;				// VT_ARRAY: total number of elements
+	SAFEARRAYBOUND bounds[2];	// VT_ARRAY: one per dimension
+};
+
+// **************************************************************************
+class SOCStreamParser
+	{
+	public:
+		// "size" is the size of the block (GlobalSize()), which bounds
+		// every read.
+		SOCStreamParser (const BYTE* data, size_t size);
+
+		// False if the block is too small for its own headers
+		bool Valid () const;
+		const OPCGROUPHEADER& GroupHeader () const;
+		DWORD Count () const;
+
+		// Decode item "index" (0 <= index < Count()). Returns false if its
+		// header or value lies outside of the block, or if the value has a
+		// type the DA 1.0 stream format does not define.
+		bool Item (DWORD index, Opc_stream_item& item) const;
+
+	private:
+		bool ReadString (size_t offset, Opc_stream_item& item) const;
+		bool ReadArray (size_t offset, Opc_stream_item& item) const;
+		bool Fits (size_t offset, size_t length) const;
+
+		const BYTE* data;
+		size_t size;
+		OPCGROUPHEADER header;
+		bool valid;
+	};
+
+#endif // _SOCSTREAMPARSER_H
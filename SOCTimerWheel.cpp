@@ -0,0 +1,214 @@
+//
+// C++ class running periodic jobs on absolute deadlines from a timing
+// wheel, on a single thread.
+//
+// Only the scheduler thread touches the wheel and the deadlines once it is
+// started; other threads only set a job's trigger flag and read counters.
+//
+
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include "SOCTimerWheel.h"
+
+//	Constructor
+SOCTimerWheel::SOCTimerWheel (unsigned int tick_ms, unsigned int slots)
+	: tick((tick_ms > 0 ? tick_ms : 1) * (int64_t) 1000), cursor(0),
+	  slots(slots > 0 ? slots : 1), running(false)
+{
+}
+
+//	Destructor
+SOCTimerWheel::~SOCTimerWheel ()
+{
+	Stop();
+}
+
+int SOCTimerWheel::Add (const char* name, unsigned int period_ms, std::function<void()> run)
+{
+	std::unique_ptr<Opc_timer_job> job(new Opc_timer_job);
+	job->name = name;
+	job->period.store((period_ms > 0 ? period_ms : 1) * (int64_t) 1000, std::memory_order_relaxed);
+	job->deadline = 0;
+	job->run = run;
+	job->trigger.store(false, std::memory_order_relaxed);
+	job->monitor.SetName(name);
+	jobs.push_back(std::move(job));
+	return (int) jobs.size() - 1;
+}
+
+void SOCTimerWheel::Start ()
+{
+	if (running) return;
+
+	// Every grid starts at the same origin, so jobs whose periods are
+	// multiples of each other stay in phase.
+	int64_t origin = Now();
+	cursor = origin / tick;
+	for (size_t id = 0; id < jobs.size(); id++){
+		jobs[id]->deadline = origin + jobs[id]->period.load(std::memory_order_relaxed);
+		Schedule((int) id);
+	}
+	running = true;
+	thread = std::thread(&SOCTimerWheel::ThreadLoop, this);
+}
+
+void SOCTimerWheel::Stop ()
+{
+	if (!running) return;
+	running = false;
+	wake.Notify();
+	thread.join();
+}
+
+void SOCTimerWheel::Trigger (int id)
+{
+	if (id < 0 || (size_t) id >= jobs.size())
+		return;
+	jobs[id]->trigger.store(true, std::memory_order_release);
+	wake.Notify();
+}
+
+void SOCTimerWheel::SetPeriod (int id, unsigned int period_ms)
+{
+	if (id < 0 || (size_t) id >= jobs.size())
+		return;
+	jobs[id]->period.store((period_ms > 0 ? period_ms : 1) * (int64_t) 1000, std::memory_order_relaxed);
+}
+
+size_t SOCTimerWheel::Jobs () const
+{
+	return jobs.size();
+}
+
+Opc_timer_stats SOCTimerWheel::Stats (int id) const
+{
+	const Opc_timer_job& job = *jobs[id];
+	Opc_timer_stats stats;
+	stats.name = job.name;
+	stats.period = (unsigned int) (job.period.load(std::memory_order_relaxed) / 1000);
+	stats.runs = job.monitor.Cycles() + job.monitor.ExtraRuns();
+	stats.triggered = job.monitor.ExtraRuns();
+	stats.overruns = job.monitor.Overruns();
+	return stats;
+}
+
+const SOCCycleMonitor& SOCTimerWheel::Monitor (int id) const
+{
+	return jobs[id]->monitor;
+}
+
+void SOCTimerWheel::PrintStats () const
+{
+	for (size_t id = 0; id < jobs.size(); id++){
+		printf("Tarefa %s, periodo %u ms:\n", jobs[id]->name, Stats((int) id).period);
+		jobs[id]->monitor.Print();
+	}
+}
+
+void SOCTimerWheel::ThreadLoop ()
+{
+	uint32_t seen = wake.Generation();
+
+	while (running){
+		RunDue(Now());
+
+		for (size_t id = 0; id < jobs.size() && running; id++){
+			Opc_timer_job& job = *jobs[id];
+			if (job.trigger.exchange(false, std::memory_order_acquire)){
+				int64_t start = Now();
+				job.run();
+				job.monitor.Extra(Now() - start);
+			}
+		}
+		if (!running) break;
+
+		// Sleep until the next occupied tick. A Trigger() or Stop() since
+		// "seen" was read ends the wait at once.
+		int64_t next = NextTick();
+		unsigned long wait = INFINITE;
+		if (next >= 0){
+			int64_t us = next * tick - Now();
+			wait = (us > 0) ? (unsigned long) ((us + 999) / 1000) : 0;
+		}
+		if (wait > 0)
+			seen = wake.Wait(seen, wait);
+	}
+}
+
+// Put job "id" in the bucket of its deadline tick
+void SOCTimerWheel::Schedule (int id)
+{
+	int64_t t = (jobs[id]->deadline + tick - 1) / tick;
+	if (t < cursor) t = cursor;
+	slots[(size_t) (t % (int64_t) slots.size())].push_back(id);
+}
+
+// Expire the buckets up to "now" and run the jobs found due, in deadline
+// order, then put each one back on the wheel at its next deadline.
+void SOCTimerWheel::RunDue (int64_t now)
+{
+	std::vector<int> due;
+	int64_t now_tick = now / tick;
+
+	for (; cursor <= now_tick; cursor++){
+		std::vector<int>& slot = slots[(size_t) (cursor % (int64_t) slots.size())];
+		for (size_t k = 0; k < slot.size(); ){
+			if ((jobs[slot[k]]->deadline + tick - 1) / tick <= cursor){
+				due.push_back(slot[k]);
+				slot[k] = slot.back();
+				slot.pop_back();
+			}
+			else
+				k++;
+		}
+	}
+	std::sort(due.begin(), due.end(),
+		[this](int a, int b) { return jobs[a]->deadline < jobs[b]->deadline; });
+
+	for (size_t k = 0; k < due.size() && running; k++){
+		Opc_timer_job& job = *jobs[due[k]];
+		int64_t start = Now();
+		job.run();
+		int64_t after = Now();
+		job.monitor.Cycle(start - job.deadline, after - start);
+
+		// Next deadline on the grid; the ones already past are skipped
+		int64_t period = job.period.load(std::memory_order_relaxed);
+		job.deadline += period;
+		if (job.deadline <= after){
+			int64_t missed = (after - job.deadline) / period + 1;
+			job.monitor.Missed((uint32_t) missed);
+			job.deadline += missed * period;
+		}
+		Schedule(due[k]);
+	}
+}
+
+// Earliest deadline tick on the wheel, -1 if it is empty. A bucket may
+// hold jobs due in a later turn of the wheel, so the scan stops at the
+// first bucket with a job due in the current turn.
+int64_t SOCTimerWheel::NextTick () const
+{
+	int64_t earliest = -1;
+
+	for (size_t offset = 0; offset < slots.size(); offset++){
+		int64_t t = cursor + (int64_t) offset;
+		const std::vector<int>& slot = slots[(size_t) (t % (int64_t) slots.size())];
+		for (size_t k = 0; k < slot.size(); k++){
+			int64_t due = (jobs[slot[k]]->deadline + tick - 1) / tick;
+			if (due < t) due = t;
+			if (earliest < 0 || due < earliest)
+				earliest = due;
+		}
+		if (earliest >= 0 && earliest <= t)
+			return earliest;
+	}
+	return earliest;
+}
+
+int64_t SOCTimerWheel::Now () const
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
@@ -0,0 +1,93 @@
+// Scheduler running the periodic jobs of the gateway on one thread.
+//
+// Every job runs on a fixed grid of absolute deadlines, origin + k * period,
+// so the time a job takes (or waits for a lock) does not shift its next
+// run the way a sleep after the work does. A job that is still running
+// when one or more of its deadlines pass skips them and counts them as
+// overruns, then resumes on the grid.
+//
+// Deadlines are kept in a hashed timing wheel: "slots" buckets of "tick"
+// milliseconds, a job sitting in the bucket of its deadline tick modulo
+// the number of slots. The thread sleeps until the next occupied bucket
+// (or until Trigger() wakes it), never polling empty ticks.
+//
+// Jobs run one at a time, in deadline order, so they should not block for
+// long: a job that stalls delays every other one, and shows up as start
+// jitter and overruns in the others' statistics (see SOCCycleMonitor.h).
+//
+
+#ifndef _SOCTIMERWHEEL_H
+#define _SOCTIMERWHEEL_H
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+#include "SOCSignal.h"
+#include "SOCCycleMonitor.h"
+
+struct Opc_timer_stats {
+	const char* name;
+	unsigned int period;	// ms
+	uint32_t runs;			// scheduled and triggered runs
+	uint32_t triggered;		// runs requested by Trigger()
+	uint32_t overruns;		// deadlines skipped because the job was late
+};
+
+// **************************************************************************
+class SOCTimerWheel
+	{
+	public:
+		SOCTimerWheel (unsigned int tick_ms = 10, unsigned int slots = 256);
+		~SOCTimerWheel ();
+
+		// Add a job run every "period_ms" ms, the first time one period
+		// after Start(). Jobs are added before Start(). Returns the job id.
+		int Add (const char* name, unsigned int period_ms, std::function<void()> run);
+
+		void Start ();
+		void Stop ();
+
+		// Run job "id" as soon as possible, once, without moving its grid.
+		// May be called from any thread.
+		void Trigger (int id);
+
+		// Change the period of job "id". The grid restarts from the job's
+		// current deadline: called from the job itself, the new period
+		// applies to the next deadline; from any other thread, to the one
+		// after it.
+		void SetPeriod (int id, unsigned int period_ms);
+
+		size_t Jobs () const;
+		Opc_timer_stats Stats (int id) const;
+		const SOCCycleMonitor& Monitor (int id) const;
+		void PrintStats () const;
+
+	private:
+		struct Opc_timer_job {
+			const char* name;
+			std::atomic<int64_t> period;	// us
+			int64_t deadline;			// us, on the job's grid
+			std::function<void()> run;
+			std::atomic<bool> trigger;
+			SOCCycleMonitor monitor;
+		};
+
+		void ThreadLoop ();
+		void Schedule (int id);
+		void RunDue (int64_t now);
+		int64_t NextTick () const;
+		int64_t Now () const;
+
+		int64_t tick;					// us
+		int64_t cursor;					// next tick to expire
+		std::vector<std::unique_ptr<Opc_timer_job>> jobs;
+		std::vector<std::vector<int>> slots;	// job ids, by deadline tick
+		std::thread thread;
+		std::atomic<bool> running;
+		SOCSignal wake;
+	};
+
+#endif // _SOCTIMERWHEEL_H
@@ -0,0 +1,163 @@
+// Compile-time table of the scalar VARIANT types used by OPC items.
+//
+// Opc_vt_traits<VT> gives, for each VARTYPE, the C++ type of its values
+// and how to read and write it in a VARIANT, so that code working on a
+// known type needs no switch and cannot pick the wrong union member.
+// VtDispatch() is the single runtime switch that turns a VARTYPE only
+// known at run time (an item's declared type, a slot's type) into the
+// matching traits; the typed functions below are built on it:
+//
+//   VariantSet(v, item.type, 42.0)		write, converted to the item type
+//   VariantGet(v, d)					read any scalar as d's type
+//   VtDecode(slot.vt, &slot.value, d)	read the 8 bytes of a slot
+//
+// Conversions saturate: an integer target receives the nearest value it
+// can hold (NaN gives 0), and VT_BOOL is 0 or 1 on reading and
+// VARIANT_FALSE/VARIANT_TRUE on writing.
+//
+
+#include "opcda.h"
+
+#ifndef _SOCVARTRAITS_H
+#define _SOCVARTRAITS_H
+
+#include <string.h>
+#include <limits>
+#include <type_traits>
+
+// **************************************************************************
+// Saturating conversion between arithmetic types
+template <class To, class From>
+inline To VtSaturate (From x)
+{
+	typedef std::numeric_limits<To> lim;
+
+	if constexpr (std::is_floating_point<To>::value)
+		return (To) x;
+	else if constexpr (std::is_floating_point<From>::value){
+		if (!(x == x)) return 0;
+		if (x <= (From) lim::min()) return lim::min();
+		if (x >= (From) lim::max()) return lim::max();
+		return (To) x;
+	}
+	else {
+		if constexpr (std::is_signed<From>::value){
+			if (x < 0){
+				if constexpr (!std::is_signed<To>::value)
+					return 0;
+				else
+					return ((LONGLONG) x < (LONGLONG) lim::min()) ? lim::min() : (To) x;
+			}
+		}
+		return ((ULONGLONG) x > (ULONGLONG) lim::max()) ? lim::max() : (To) x;
+	}
+}
+
+// **************************************************************************
+template <VARTYPE VT> struct Opc_vt_traits;
+
+#define OPC_VT_TRAITS(VT, TYPE, MEMBER) \
+	template <> struct Opc_vt_traits<VT> { \
+		typedef TYPE type; \
+		static const VARTYPE vt = VT; \
+		static type Get (const VARIANT& v) { return v.MEMBER; } \
+		static void Set (VARIANT& v, type x) { v.vt = VT; v.MEMBER = x; } \
+		static type Decode (const void* p) { type x; memcpy(&x, p, sizeof(x)); return x; } \
+		template <class From> static type Make (From x) { return VtSaturate<type>(x); } \
+		static type Value (type x) { return x; } \
+	};
+
+OPC_VT_TRAITS(VT_I1,	CHAR,		cVal)
+OPC_VT_TRAITS(VT_I2,	SHORT,		iVal)
+OPC_VT_TRAITS(VT_I4,	LONG,		lVal)
+OPC_VT_TRAITS(VT_INT,	INT,		intVal)
+OPC_VT_TRAITS(VT_I8,	LONGLONG,	llVal)
+OPC_VT_TRAITS(VT_UI1,	BYTE,		bVal)
+OPC_VT_TRAITS(VT_UI2,	USHORT,		uiVal)
+OPC_VT_TRAITS(VT_UI4,	ULONG,		ulVal)
+OPC_VT_TRAITS(VT_UINT,	UINT,		uintVal)
+OPC_VT_TRAITS(VT_UI8,	ULONGLONG,	ullVal)
+OPC_VT_TRAITS(VT_R4,	FLOAT,		fltVal)
+OPC_VT_TRAITS(VT_R8,	DOUBLE,		dblVal)
+OPC_VT_TRAITS(VT_DATE,	DATE,		date)
+OPC_VT_TRAITS(VT_ERROR,	SCODE,		scode)
+
+#undef OPC_VT_TRAITS
+
+template <> struct Opc_vt_traits<VT_BOOL> {
+	typedef VARIANT_BOOL type;
+	static const VARTYPE vt = VT_BOOL;
+	static type Get (const VARIANT& v) { return v.boolVal; }
+	static void Set (VARIANT& v, type x) { v.vt = VT_BOOL; v.boolVal = x; }
+	static type Decode (const void* p) { type x; memcpy(&x, p, sizeof(x)); return x; }
+	template <class From> static type Make (From x) { return (x != 0) ? VARIANT_TRUE : VARIANT_FALSE; }
+	static BYTE Value (type x) { return x ? 1 : 0; }
+};
+
+// **************************************************************************
+// Call f(Opc_vt_traits<vt>()) for a scalar type known at run time.
+// Returns false, without calling f, for any other type.
+template <class F>
+inline bool VtDispatch (VARTYPE vt, F&& f)
+{
+	switch (vt)
+	{
+		case VT_I1:		f(Opc_vt_traits<VT_I1>());		return true;
+		case VT_I2:		f(Opc_vt_traits<VT_I2>());		return true;
+		case VT_I4:		f(Opc_vt_traits<VT_I4>());		return true;
+		case VT_INT:	f(Opc_vt_traits<VT_INT>());		return true;
+		case VT_I8:		f(Opc_vt_traits<VT_I8>());		return true;
+		case VT_UI1:	f(Opc_vt_traits<VT_UI1>());		return true;
+		case VT_UI2:	f(Opc_vt_traits<VT_UI2>());		return true;
+		case VT_UI4:	f(Opc_vt_traits<VT_UI4>());		return true;
+		case VT_UINT:	f(Opc_vt_traits<VT_UINT>());	return true;
+		case VT_UI8:	f(Opc_vt_traits<VT_UI8>());		return true;
+		case VT_R4:		f(Opc_vt_traits<VT_R4>());		return true;
+		case VT_R8:		f(Opc_vt_traits<VT_R8>());		return true;
+		case VT_DATE:	f(Opc_vt_traits<VT_DATE>());	return true;
+		case VT_ERROR:	f(Opc_vt_traits<VT_ERROR>());	return true;
+		case VT_BOOL:	f(Opc_vt_traits<VT_BOOL>());	return true;
+		default:		return false;
+	}
+}
+
+// Size in bytes of a value of type "vt", 0 if it is not a supported scalar
+inline size_t VtSize (VARTYPE vt)
+{
+	size_t size = 0;
+	VtDispatch(vt, [&size](auto traits) { size = sizeof(typename decltype(traits)::type); });
+	return size;
+}
+
+// Set "v" to type "vt" holding "x" converted to that type
+template <class T>
+inline bool VariantSet (VARIANT& v, VARTYPE vt, T x)
+{
+	return VtDispatch(vt, [&v, x](auto traits) {
+		typedef decltype(traits) Tr;
+		Tr::Set(v, Tr::Make(x));
+	});
+}
+
+// Value of a scalar VARIANT converted to T
+template <class T>
+inline bool VariantGet (const VARIANT& v, T& out)
+{
+	return VtDispatch(v.vt, [&v, &out](auto traits) {
+		typedef decltype(traits) Tr;
+		out = VtSaturate<T>(Tr::Value(Tr::Get(v)));
+	});
+}
+
+// Value of type "vt" stored at "p" (a registry slot, an array element)
+// converted to T
+template <class T>
+inline bool VtDecode (VARTYPE vt, const void* p, T& out)
+{
+	return VtDispatch(vt, [p, &out](auto traits) {
+		typedef decltype(traits) Tr;
+		out = VtSaturate<T>(Tr::Value(Tr::Decode(p)));
+	});
+}
+
+#endif // _SOCVARTRAITS_H
@@ -15,7 +15,9 @@ void SetAdviseSink(IUnknown* pGroupIUnknown, IAdviseSink* pSOCAdviseSink,
 				   IDataObject* &pIDataObject, DWORD* ptkAsyncConnection);
 void CancelAdviseSink(IDataObject *pIDataObject, DWORD tkAsyncConnection);
 void SetGroupActive(IUnknown* pGroupIUnknown);
-bool VarToStr (VARIANT pvar, char *buffer);
 void SetDataCallback(IUnknown* pGroupIUnknown, IOPCDataCallback* pSOCDataCallback,
 					 IConnectionPoint* &pIConnectionPoint, DWORD *pdwCookie);
 void CancelDataCallback(IConnectionPoint *pIConnectionPoint,  DWORD dwCookie);
+bool SetItemSampling(IUnknown* pGroupIUnknown, OPCHANDLE hServerItem,
+					 DWORD dwSamplingRate, BOOL bBufferEnable);
+DWORD SetGroupKeepAlive(IUnknown* pGroupIUnknown, DWORD dwKeepAliveTime);
@@ -106,60 +106,6 @@ void CancelAdviseSink(IDataObject *pIDataObject,  DWORD tkAsyncConnection)
 	return; 
 }
 
-/////////////////////////////////////////////////////////////////////////
-// Function to mimic the Delphi VARTOSTR procedure in which a VARIANT
-// is converted to a string. Only a few VARIANT types are supported in
-// this version.
-//
-// Luiz T. S. Mendes - 07/09/2011
-//
-// Os trechos comentados referem-se s correes apontadas pelos alunos Rafael
-// Tupynamb Dutra e Tarcsio Ribeiro Oliveira Cortes em 19/05/2012
-//
-// Contudo, estes comendos "sprintf" devem ser adaptados s caractersticas
-// de cada situao especfica.
-//
-bool VarToStr (VARIANT pvar, char *buffer)
-{
-	bool vReturn = true;
-	switch (pvar.vt & ~VT_ARRAY)
-	{
-        case VT_BOOL:
-		case VT_I1:
-			sprintf(buffer, "%d",    pvar.iVal);	break;
-			// RAFAEL sprintf(buffer, "%06d",    pvar.iVal);	break;
-		case VT_I2:
-			sprintf(buffer, "%d",    pvar.intVal);	break;
-			// RAFAEL sprintf(buffer, "%06d",    pvar.intVal);	break;
-		case VT_I4:
-			sprintf(buffer, "%ld",   pvar.intVal);	break;
-			//RAFAEL sprintf(buffer, "%06d",   pvar.intVal);	break;
-		case VT_UI1:
-			//sprintf(buffer, "%u",    pvar.uiVal);	break;
-			sprintf(buffer, "%06u",    pvar.uiVal);	break;
-		case VT_UI2:
-			sprintf(buffer, "%u",    pvar.ulVal);	break;
-			//RAFAEL sprintf(buffer, "%06u",    pvar.ulVal);	break;
-		case VT_UI4:
-			sprintf(buffer, "%lu",   pvar.ulVal);	break;
-			//RAFAEL sprintf(buffer, "%06u",   pvar.ulVal);	break;
-		case VT_R4:
-			sprintf(buffer, "%6.2f", pvar.fltVal);	break;
-			//RAFAEL sprintf(buffer, "%06.1f", pvar.fltVal);	break;
-		case VT_R8:
-			//LUIZ sprintf(buffer, "%lu",   pvar.dblVal);	break;
-			sprintf(buffer, "%lf",   pvar.dblVal);	break;
-			//RAFAEL sprintf(buffer, "%06.1Lf",   pvar.dblVal);	break;
-		case VT_BSTR:
-			sprintf(buffer, "%ls",    pvar.bstrVal);	break;
-			//RAFAEL sprintf(buffer, "%6.6s",    pvar.bstrVal);	break;
-		default:
-			sprintf(buffer, "%s", "");
-			vReturn = false;
-			break;
-	}
-	return(vReturn);
-}
 ///////////////////////////////////////////////////////////////////////////////
 // Set up an asynchronous connection with the server by means of the OPC DA
 // 2.0 IConnectionPointContainer
@@ -228,3 +174,102 @@ void CancelDataCallback(IConnectionPoint *pIConnectionPoint,  DWORD dwCookie)
     pIConnectionPoint->Release();
 	return; 
 }
+
+///////////////////////////////////////////////////////////////////////////////
+// Ask the server to sample the item given by hServerItem faster than the
+// group update rate, by means of the OPC DA 3.0 IOPCItemSamplingMgt
+// interface. With buffering enabled the server keeps every sample taken
+// between two updates and delivers all of them in the next OnDataChange,
+// so that the same client handle may appear several times in one callback.
+//
+// Returns false if the server does not implement IOPCItemSamplingMgt (OPC
+// DA 2.0 servers) or rejects the request; the item then keeps being
+// sampled at the group update rate.
+//
+bool SetItemSampling(IUnknown* pGroupIUnknown, OPCHANDLE hServerItem,
+					 DWORD dwSamplingRate, BOOL bBufferEnable)
+{
+	HRESULT hr;
+	IOPCItemSamplingMgt* pIOPCItemSamplingMgt = NULL;
+	DWORD* pdwRevisedSamplingRate = NULL;
+	HRESULT* pErrors = NULL;
+	bool vReturn = true;
+
+	// Get a pointer to the IOPCItemSamplingMgt interface:
+	hr = pGroupIUnknown->QueryInterface(__uuidof(pIOPCItemSamplingMgt),
+		                               (void**) &pIOPCItemSamplingMgt);
+	if (hr != S_OK){
+		printf ("Could not obtain a pointer to IOPCItemSamplingMgt. Error = %x\n", hr);
+		return false;
+	}
+
+	hr = pIOPCItemSamplingMgt->SetItemSamplingRate(1, &hServerItem, &dwSamplingRate,
+		                                           &pdwRevisedSamplingRate, &pErrors);
+	if (FAILED(hr) || FAILED(pErrors[0])){
+		printf ("Failed call to IOPCItemSamplingMgt::SetItemSamplingRate. Error = %x\n",
+			    FAILED(hr) ? hr : pErrors[0]);
+		vReturn = false;
+	}
+	else if (pdwRevisedSamplingRate[0] != dwSamplingRate)
+		printf ("Sampling rate revised by the server from %lu to %lu ms\n",
+		        dwSamplingRate, pdwRevisedSamplingRate[0]);
+
+	// Release memory allocated by the server:
+	CoTaskMemFree(pdwRevisedSamplingRate);
+	pdwRevisedSamplingRate = NULL;
+	CoTaskMemFree(pErrors);
+	pErrors = NULL;
+
+	// Buffering only makes sense if the item is sampled faster than the
+	// group is updated.
+	if (vReturn){
+		hr = pIOPCItemSamplingMgt->SetItemBufferEnable(1, &hServerItem,
+			                                           &bBufferEnable, &pErrors);
+		if (FAILED(hr) || FAILED(pErrors[0])){
+			printf ("Failed call to IOPCItemSamplingMgt::SetItemBufferEnable. Error = %x\n",
+				    FAILED(hr) ? hr : pErrors[0]);
+			vReturn = false;
+		}
+		CoTaskMemFree(pErrors);
+		pErrors = NULL;
+	}
+
+	pIOPCItemSamplingMgt->Release();
+	return vReturn;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Request keep-alive callbacks for the group by means of the OPC DA 3.0
+// IOPCGroupStateMgt2 interface. The server then calls OnDataChange (with
+// no items) whenever dwKeepAliveTime ms elapse without a data change, so
+// the client can tell a quiet server from a dead one.
+//
+// Returns the keep-alive time revised by the server, or 0 if keep-alive
+// is not supported.
+//
+DWORD SetGroupKeepAlive(IUnknown* pGroupIUnknown, DWORD dwKeepAliveTime)
+{
+	HRESULT hr;
+	IOPCGroupStateMgt2* pIOPCGroupStateMgt2 = NULL;
+	DWORD dwRevisedKeepAliveTime = 0;
+
+	// Get a pointer to the IOPCGroupStateMgt2 interface:
+	hr = pGroupIUnknown->QueryInterface(__uuidof(pIOPCGroupStateMgt2),
+		                               (void**) &pIOPCGroupStateMgt2);
+	if (hr != S_OK){
+		printf ("Could not obtain a pointer to IOPCGroupStateMgt2. Error = %x\n", hr);
+		return 0;
+	}
+
+	hr = pIOPCGroupStateMgt2->SetKeepAlive(dwKeepAliveTime, &dwRevisedKeepAliveTime);
+	if (FAILED(hr)){
+		printf ("Failed call to IOPCGroupStateMgt2::SetKeepAlive. Error = %x\n", hr);
+		dwRevisedKeepAliveTime = 0;
+	}
+	else if (dwRevisedKeepAliveTime != dwKeepAliveTime)
+		printf ("Keep-alive time revised by the server from %lu to %lu ms\n",
+		        dwKeepAliveTime, dwRevisedKeepAliveTime);
+
+	pIOPCGroupStateMgt2->Release();
+	return dwRevisedKeepAliveTime;
+}
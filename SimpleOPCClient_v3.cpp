@@ -28,45 +28,115 @@
 #include "SOCAdviseSink.h"
 #include "SOCDataCallback.h"
 #include "SOCWrapperFunctions.h"
+#include "SOCSession.h"
+#include "SOCBrowse.h"
+#include "SOCItemRegistry.h"
+#include "SOCSeqlock.h"
+#include "SOCHistogram.h"
+#include "SOCSampleLog.h"
+#include "SOCFormat.h"
+#include "SOCVarTraits.h"
+#include "SOCTimerWheel.h"
+#include "SOCCycleMonitor.h"
+#include "SOCAdaptivePoll.h"
+#include "SOCFrameReader.h"
+#include "SOCSocketWait.h"
+#include "SOCAckWindow.h"
+#include "SOCSequence.h"
 
 using namespace std;
 
 // ------- THREADS AND SYNCHRONICITY -------
-std::mutex socket_mutex; // Protects socket variable
-std::mutex opc_mutex; // Protects opc variables
+std::mutex opc_mutex; // Protects the OPC session (see SOCSession)
 bool executing= false; 
-bool connected = false;
-HANDLE connectionLostEvent; // Event to handle lost connections
+HANDLE stop_event; // Set on shutdown: every thread waits on it besides its timer or socket
+HANDLE abort_event; // Set once the shutdown drain time is over: replies still awaited are given up
+std::atomic<bool> opc_stale(false); // No callback from the OPC server within the keep-alive period
 
 
 // ------- WINSOCK -------
 #define DEFAULT_PORT "3445"
-SOCKET ConnectSocket = INVALID_SOCKET;
-char recvbuf[DEFAULT_BUFLEN];
-int recvbuflen = DEFAULT_BUFLEN;
+// Status (and array) frames and position frames travel on links of their
+// own, so that a slow reply on one never holds the other back. With
+// positions on the status link (see main()), position_link points to
+// status_link.
+Web_link status_link("status");
+Web_link position_channel("posicao");
+Web_link* position_link = &position_channel;
 
 // ------- OPC GLOBAL VARIABLES -------
-IOPCServer* pIOPCServer = NULL;   //pointer to IOPServer interface
-IOPCItemMgt* pIOPCItemMgt = NULL; //pointer to IOPCItemMgt interface
-OPCHANDLE hServerGroup; // server handle to the group
+SOCSession* opc_session = NULL; // server, group, items and callback advise
 
-// Write items (Posicao)
-Opc_item vel_trans = {NULL, L"Bucket Brigade.Real4", REAL4,1 };
-Opc_item coord_x = { NULL, L"Bucket Brigade.UInt1", UINT1,2 };
-Opc_item coord_y = { NULL, L"Bucket Brigade.UInt2", UINT2,3 };
-Opc_item coord_z = { NULL, L"Bucket Brigade.UInt4", UINT4,4 };
-Opc_item taxa_rec = { NULL, L"Bucket Brigade.Real8", REAL8,5 };
+// Write items (Posicao). Client handles ("id") are assigned by opc_registry.
+Opc_item vel_trans = {NULL, L"Bucket Brigade.Real4", REAL4, 0 };
+Opc_item coord_x = { NULL, L"Bucket Brigade.UInt1", UINT1, 0 };
+Opc_item coord_y = { NULL, L"Bucket Brigade.UInt2", UINT2, 0 };
+Opc_item coord_z = { NULL, L"Bucket Brigade.UInt4", UINT4, 0 };
+Opc_item taxa_rec = { NULL, L"Bucket Brigade.Real8", REAL8, 0 };
 
 // Read items (Status)
-Opc_item taxa_rec_real = { NULL, L"Random.UInt1", UINT1,6 };
-Opc_item potencia = { NULL, L"Random.Real4", REAL4,7 };
-Opc_item temp_transl = { NULL, L"Saw-Toothed Waves.Real4", REAL4,8 };
-Opc_item temp_roda = { NULL, L"Square Waves.Real4", REAL4,9 };
+Opc_item taxa_rec_real = { NULL, L"Random.UInt1", UINT1, 0 };
+Opc_item potencia = { NULL, L"Random.Real4", REAL4, 0 };
+Opc_item temp_transl = { NULL, L"Saw-Toothed Waves.Real4", REAL4, 0 };
+Opc_item temp_roda = { NULL, L"Square Waves.Real4", REAL4, 0 };
+
+// Array items, forwarded to the web server as "55" frames when they change.
+// They are optional: added apart from the fixed items, and only kept if
+// the server knows them (see main()).
+Opc_item forma_onda = { NULL, L"Random.ArrayOfReal8", VT_ARRAY | REAL8, 0 };
+Opc_item* published_arrays[] = { &forma_onda };
+bool array_publish = true; // Subscribe to the array items and send their frames
+bool array_reply = false; // The web server answers "55" frames (older ones do not)
+
+// Additional items, resolved at startup against the server address space.
+// A pattern is an item ID, a prefix followed by '*' or a glob with '*'/'?'.
+const wchar_t* subscription_patterns[] = {
+	L"Random.*",
+};
+
+// Every item of the client, indexed by client handle
+SOCItemRegistry opc_registry;
+
+// Samples handed over by the OPC callback to its worker thread. With
+// OPC_OVERFLOW_COALESCE a burst larger than the ring keeps the newest
+// value of every item; OPC_OVERFLOW_DROP_OLDEST keeps the newest samples.
+SOCSampleRing opc_sample_ring(4096, OPC_REGISTRY_CAPACITY, OPC_OVERFLOW_COALESCE);
 
 // State variables
-unsigned int msg_seq = 1;
-Posicao posicao = { 0.0,0,0,0, 0.0 };
-Status_rec status = { 0,0,0,0 };
+// Last position received from the web server. Written by position_job()
+// and read by opcclient_job() through a seqlock, so neither side ever waits.
+SOCSeqlock<Posicao_sample> posicao_store(Posicao_sample{ { 0.0,0,0,0, 0.0 }, 0, 0, 0, 0 });
+
+// Position subscription (see subscribe_positions()). With push mode on,
+// the web server sends every new position as a "34" frame and the client
+// acknowledges them cumulatively, on its status frames when it can;
+// otherwise positions are polled.
+bool position_subscribe = true; // Ask the web server to push positions
+std::atomic<bool> position_push(false); // Positions are pushed on the current connection
+std::atomic<bool> position_pending(false); // Pushed position stored but not written yet
+std::atomic<uint32_t> pushed_positions(0); // Pushed positions received
+SOCAckWindow position_acks(16, 250); // ACK on its own after 16 frames or 250 ms (under position_link->mutex)
+
+// Stages of the position pipeline, in microseconds: web server round trip
+// (request to frame), gateway (frame to last OPC write) and end to end
+// (request to last OPC write)
+SOCHistogram position_rtt;
+SOCHistogram position_gateway;
+SOCHistogram position_latency;
+
+// Age of the status values when sent to the web server (source timestamp
+// to send), in microseconds
+SOCHistogram status_age;
+
+// Cycle times of opcwatchdog_loop(); the jobs of the schedulers have their
+// own (see SOCTimerWheel::PrintStats())
+SOCCycleMonitor watchdog_cycles("watchdog");
+
+// Status publishing (see webclient_job())
+Status_policy status_policy = { true, 100, 2000 };
+std::atomic<LONGLONG> status_changed_at(0); // First registry update not yet sent (epoch us), 0: none
+std::atomic<bool> status_resend(false); // Send the next status whatever it holds (new connection)
+SOCHistogram status_latency; // From a registry update to the send() of its status frame, us
 
 // The OPC DA Spec requires that some constants be registered in order to use
 // them. The one below refers to the OPC DA 1.0 IDataObject interface.
@@ -78,21 +148,42 @@ int main(void)
 	char buf[100];
 	unsigned int loop_web_time = 2000;
 	unsigned int loop_opc_time = 1000;
+	unsigned int loop_pos_time = 100; // Position requests to the web server: while moving ...
+	unsigned int loop_pos_max_time = 2000; // ... and at most this far apart when parked (ms)
+	unsigned int sampling_rate = 100; // Status items are sampled faster than the group rate
+	unsigned int opc_keep_alive = 3000; // Upper bound for OPC server death detection
+	unsigned int opc_log_every = 0; // Print 1 of every N OPC samples (0: no log)
+	status_policy.on_change = true; // Push status when it changes, instead of every loop_web_time ms
+	status_policy.min_interval = 100; // ... but not more often than this (ms)
+	status_policy.max_silence = loop_web_time; // ... and at least this often (ms)
+	bool position_channel_on = true; // Positions on a connection of their own
+	unsigned int shutdown_drain_time = 50; // On 'q', time left to the frames in flight (ms)
 	executing = true;
+	if (!position_channel_on) position_link = &status_link;
 
-	// ---------- RECONNECT EVENT -----------
+	// ---------- RECONNECT AND STOP EVENTS -----------
 	// Source: https://docs.microsoft.com/en-us/windows/win32/sync/using-event-objects
-	connectionLostEvent = CreateEvent( 
-        NULL,               // default security attributes
-        FALSE,               // NOT manual-reset event
-        FALSE,              // initial state is nonsignaled
-        TEXT("ReconnectEvent")  // object name
-        ); 
-    if (connectionLostEvent == NULL) 
-    { 
-        printf("CreateEvent failed (%d)\n", GetLastError());
-        return 1;
-    }
+	stop_event = CreateEvent(NULL, TRUE, FALSE, NULL); // manual-reset: wakes every waiter
+	abort_event = CreateEvent(NULL, TRUE, FALSE, NULL);
+	if (stop_event == NULL || abort_event == NULL) 
+	{ 
+		printf("CreateEvent failed (%d)\n", GetLastError());
+		return 1;
+	}
+	Web_link* links[] = { &status_link, &position_channel };
+	for (int k = 0; k < 2; k++) {
+		links[k]->lost_event = CreateEvent( 
+			NULL,               // default security attributes
+			FALSE,               // NOT manual-reset event
+			FALSE,              // initial state is nonsignaled
+			NULL                // unnamed: one per link
+			); 
+		if (links[k]->lost_event == NULL) 
+		{ 
+			printf("CreateEvent failed (%d)\n", GetLastError());
+			return 1;
+		}
+	}
 
 	// ----------- WINSOCKETS -----------
 	WSADATA wsaData;
@@ -122,222 +213,287 @@ int main(void)
         return 1;
     }
 
-	// Connection to be estabilished
-	connected = false;
-
 	// ----------- OPC -----------
 	printf("Initializing the COM environment\n");
 	CoInitializeEx(NULL,COINIT_MULTITHREADED); // Initialize COM environment
-	pIOPCServer = InstantiateServer(OPC_SERVER_NAME); // Take ProgId -> Generate COM (server) instance 
-	
-	// Add the OPC group the OPC server and get an handle to the IOPCItemMgt
-	//interface:
-	AddTheGroup(pIOPCServer, pIOPCItemMgt, hServerGroup);
 
-	// Add the OPC item. First we have to convert from wchar_t* to char*
-	// in order to print the item name in the console.
+	// Establish a callback asynchronous read by means of the IOPCDataCallback
+	// (OPC DA 2.0) method. We first instantiate a new SOCDataCallback object and
+	// adjusts its reference count. The session below advises it on the group,
+	// and advises it again whenever the session has to be rebuilt.
+	SOCDataCallback* pSOCDataCallback = new SOCDataCallback(&opc_registry, &opc_sample_ring);
+	pSOCDataCallback->AddRef();
 
-	AddTheItem(pIOPCItemMgt, vel_trans.item_handle , vel_trans.item_id , vel_trans.type, vel_trans.id );
-	AddTheItem(pIOPCItemMgt, coord_x.item_handle , coord_x.item_id , coord_x.type, coord_x.id );
-	AddTheItem(pIOPCItemMgt, coord_y.item_handle , coord_y.item_id , coord_y.type, coord_y.id );
-	AddTheItem(pIOPCItemMgt, coord_z.item_handle , coord_z.item_id , coord_z.type, coord_z.id );
-	AddTheItem(pIOPCItemMgt, taxa_rec.item_handle , taxa_rec.item_id , taxa_rec.type, taxa_rec.id );
+	// Values are no longer printed as they arrive; a sample of them can be
+	// printed by a thread of its own instead.
+	SOCSampleLog opc_log("OPC", opc_log_every);
+	if (opc_log_every > 0) {
+		opc_log.Start();
+		pSOCDataCallback->SetSampleHandler([&opc_log](const Opc_sample& sample) {
+			opc_log.Log(sample.client_handle, *sample.value, sample.quality, sample.timestamp);
+		});
+	}
+	// Periodic jobs, run on absolute deadlines by scheduler threads: status
+	// to the web server and position to the OPC server. With
+	// status_policy.on_change the status job runs at the minimum interval,
+	// and at once after each update of the registry. The position job has
+	// a thread of its own, so that waiting for a position never delays a
+	// status frame, and the other way round.
+	SOCTimerWheel scheduler;
+	SOCTimerWheel position_scheduler;
+	int status_job = scheduler.Add("web",
+		status_policy.on_change ? status_policy.min_interval : loop_web_time, webclient_job);
+	// Position requests adapt their interval to the motion they observe.
+	// When the web server pushes positions, the job only acknowledges them
+	// and writes the last one, every loop_pos_time ms.
+	SOCAdaptivePoll position_poll(loop_pos_time, loop_pos_max_time);
+	int position_fetch_job = -1;
+	position_fetch_job = position_scheduler.Add("posicao", loop_pos_time, [&]() {
+		bool moved;
+		if (position_push) {
+			position_push_job();
+			position_scheduler.SetPeriod(position_fetch_job, loop_pos_time);
+		}
+		else if (position_job(moved))
+			position_scheduler.SetPeriod(position_fetch_job, position_poll.Update(moved));
+	});
+	scheduler.Add("opc", loop_opc_time, opcclient_job);
+	if (status_policy.on_change) {
+		opc_registry.SetUpdateHandler([&scheduler, status_job]() {
+			LONGLONG none = 0;
+			status_changed_at.compare_exchange_strong(none, EpochNow());
+			scheduler.Trigger(status_job);
+		});
+	}
 
-	// Status items
-	AddTheItem(pIOPCItemMgt, taxa_rec_real.item_handle, taxa_rec_real.item_id, taxa_rec_real.type, taxa_rec_real.id);
-	AddTheItem(pIOPCItemMgt, potencia.item_handle, potencia.item_id, potencia.type, potencia.id);
-	AddTheItem(pIOPCItemMgt, temp_transl.item_handle, temp_transl.item_id, temp_transl.type, temp_transl.id);
-	AddTheItem(pIOPCItemMgt, temp_roda.item_handle, temp_roda.item_id, temp_roda.type, temp_roda.id);
+	pSOCDataCallback->StartWorker();
 
-	VARIANT varValue; //to store the read value
-	VariantInit(&varValue);
-	
-	// Initialize reconnect thread
-	std::thread t1(reconnect_server_thread, result);
-	SetEvent(connectionLostEvent); // estabilish connection
+	// All fixed items of the group, added in one AddItems call.
+	Opc_item* fixed_items[] = { &vel_trans, &coord_x, &coord_y, &coord_z, &taxa_rec,
+		&taxa_rec_real, &potencia, &temp_transl, &temp_roda };
+	std::vector<Opc_item*> opc_items;
+	for (size_t k = 0; k < sizeof(fixed_items) / sizeof(fixed_items[0]); k++) {
+		if (opc_registry.Register(fixed_items[k]))
+			opc_items.push_back(fixed_items[k]);
+	}
 
-	// Initialize web clint thread
-	std::thread t2(webclient_loop, loop_web_time);
+	// The status items are sampled at sampling_rate and the samples buffered
+	// between group updates. Servers without OPC DA 3.0 support simply keep
+	// delivering one value per item per update.
+	std::vector<Opc_item*> sampled_items;
+	sampled_items.push_back(&taxa_rec_real);
+	sampled_items.push_back(&potencia);
+	sampled_items.push_back(&temp_transl);
+	sampled_items.push_back(&temp_roda);
+
+	// Take ProgId -> Generate COM (server) instance, add the group and its
+	// items, advise the callback, ask for keep-alive callbacks so that a dead
+	// server is noticed even when no values change, and activate the group.
+	opc_session = new SOCSession(OPC_SERVER_NAME, opc_items, sampled_items,
+		sampling_rate, opc_keep_alive, pSOCDataCallback, &opc_mutex);
+	if (!opc_session->Open())
+		printf("Servidor OPC indisponivel. Nova tentativa em breve. \n");
+
+	// Load the address-space index saved by the last run and revalidate it
+	// against the server: only items not yet in the index are looked up.
+	SOCBrowseIndex browse_index(OPC_SERVER_NAME, OPC_INDEX_FILE);
+	browse_index.Load();
+	IOPCServer* pBrowseServer = opc_session->AcquireServer();
+	if (pBrowseServer != NULL) {
+		if (browse_index.Refresh(pBrowseServer))
+			browse_index.Save();
+		pBrowseServer->Release();
+	}
 
-	// Initialize opc client thread
-	std::thread t3(opcclient_loop, loop_opc_time);
+	// The array items, which not every server has: the ones it rejects are
+	// left out of the session and never sent. They are registered before
+	// the patterns are resolved, so a pattern covering one skips it instead
+	// of taking its item ID.
+	if (array_publish) {
+		std::vector<Opc_item*> array_items;
+		for (size_t k = 0; k < sizeof(published_arrays) / sizeof(published_arrays[0]); k++) {
+			if (opc_registry.Register(published_arrays[k]))
+				array_items.push_back(published_arrays[k]);
+		}
+		if (!array_items.empty())
+			opc_session->Subscribe(array_items);
+	}
 
+	// Resolve the subscription patterns against the index and add all the
+	// matching items in one AddItems call. If the server is down the index
+	// saved by the last run is used, and the items are added on recovery.
+	std::vector<Opc_item*> pattern_items;
+	for (size_t k = 0; k < sizeof(subscription_patterns) / sizeof(subscription_patterns[0]); k++) {
+		std::vector<Opc_item*> matched = opc_registry.Subscribe(browse_index, subscription_patterns[k]);
+		pattern_items.insert(pattern_items.end(), matched.begin(), matched.end());
+	}
+	if (!pattern_items.empty()) {
+		printf("%u itens adicionados por padrao\n", (unsigned) pattern_items.size());
+		opc_session->Subscribe(pattern_items);
+	}
 
-	//std::thread t4(opcread_loop, loop_opc_read__time);
-	
-	// Establish a callback asynchronous read by means of the IOPCDataCallback
-	// (OPC DA 2.0) method. We first instantiate a new SOCDataCallback object and
-	// adjusts its reference count, and then call a wrapper function to
-	// setup the callback.
-	IConnectionPoint* pIConnectionPoint = NULL; //pointer to IConnectionPoint Interface
-	DWORD dwCookie = 0;
-	SOCDataCallback* pSOCDataCallback = new SOCDataCallback(
-		&taxa_rec_real, 
-		&potencia, 
-		&temp_transl, 
-		&temp_roda, 
-		&status,
-		&opc_mutex);
-	pSOCDataCallback->AddRef();
-	SetDataCallback(pIOPCItemMgt, pSOCDataCallback, pIConnectionPoint, &dwCookie);
+	// Initialize reconnect threads, one per link
+	std::thread t1(reconnect_server_thread, &status_link, result);
+	SetEvent(status_link.lost_event); // estabilish connection
+	std::thread t2;
+	if (position_link != &status_link) {
+		t2 = std::thread(reconnect_server_thread, position_link, result);
+		SetEvent(position_link->lost_event);
+	}
 
-	// Change the group to the ACTIVE state so that we can receive the
-	// server's callback notification
-    SetGroupActive(pIOPCItemMgt); 
+	scheduler.Start();
+	position_scheduler.Start();
+
+	// Initialize OPC session watchdog thread. It also rebuilds the session
+	// when the server is lost.
+	std::thread t4(opcwatchdog_loop, pSOCDataCallback, opc_keep_alive);
 
 	printf("Press Q+ENTER to terminate ... \n");
 	while(true){
 		int c=getchar();
 
 		if((char)c=='p') {
-			// Solicit position from web server ---
-			// seq.33 ->
-			// position X, Y, Z ... <- 
-			// ACK ->
-
-			if(!connected){
+			// Solicit position from web server now, besides the periodic
+			// requests (see position_job())
+			if(!position_link->connected){
 				printf("Nao e' possivel mandar mensagens enquanto \
 				a Conexao Nao for reestabelecida. \n");
 			}
 			else{
-				socket_mutex.lock();
-				if(!connected){
-					// Test connection again in case it was lost during the mutex wait
-					printf("Nao e' possivel mandar mensagens enquanto \
-					a Conexao Nao for reestabelecida. \n");
-					socket_mutex.unlock();
-					continue;
-				}
-				// Build message
-				std::string send_msg = get_msg_seq();
-				send_msg+= "$33";
-
-				// Send request
-				iResult = send( ConnectSocket, send_msg.c_str(), (int) send_msg.size() , 0 );
-				if (iResult == SOCKET_ERROR) {
-					printf("Erro em send(): %d\n", WSAGetLastError());
-
-					// Reconnect to server ...
-					set_disconnected();
-					socket_mutex.unlock();
-					continue;
-				}
-
-				printf("SENT: %s\n", send_msg.c_str());
-
-				// Receive data
-				iResult = recv(ConnectSocket, recvbuf, recvbuflen, 0);
-				if ( iResult > 0 )
-				{
-					printf("RECV: %s\n", recvbuf);
-					if(++msg_seq >= 1000000) msg_seq = 1;
-
-					// Update posicao
-					string data(recvbuf);
-					std::vector<string> fields = split(data, '$');
-
-					// Test if message has 7 fields
-					if(fields.size() != 7){
-						printf("MENSAGEM DO SERVIDOR NAO ESTA NO FORMATO ESPERADO.\n\n");
-					}
-
-					posicao.vel_transl = std::stod(fields.at(2));
-					posicao.coord_x = std::stoi(fields.at(3));
-					posicao.coord_y = std::stoi(fields.at(4));
-					posicao.coord_z = std::stoi(fields.at(5));
-					posicao.taxa_rec = std::stod(fields.at(6));
-
-				}
-				else 
-				{
-					if ( iResult == 0 ) printf("Conexao perdida. \n");
-					else printf("Erro em recv(): %d\n", WSAGetLastError());
-					// Reconnect to server ...
-					set_disconnected();
-					socket_mutex.unlock();
-					continue;
-				}
-
-				// Send ACK
-				std::string send_ack = get_msg_seq();
-				send_ack+= "$99";
-				iResult = send( ConnectSocket, send_ack.c_str(), (int) send_ack.size() , 0 );
-				if (iResult == SOCKET_ERROR) {
-					printf("Erro em send(): %d\n", WSAGetLastError());
-
-					// Reconnect to server ...
-					set_disconnected();
-					socket_mutex.unlock();
-					continue;
-				}
-
-
-				socket_mutex.unlock();
+				position_scheduler.Trigger(position_fetch_job);
 			}
+		}
 
+		if((char)c=='m') {
+			// Print OPC session metrics
+			Opc_recovery_stats rs = opc_session->RecoveryStats();
+			printf("OPC: sessao %s, %u recuperacoes, %u tentativas falhas, "
+				"ultima %llu ms, maxima %llu ms, total %llu ms\n",
+				opc_stale ? "inativa" : "ativa", rs.recoveries, rs.failed_attempts,
+				rs.last_recovery_time, rs.max_recovery_time, rs.total_recovery_time);
+
+			Opc_ring_stats ring = pSOCDataCallback->RingStats();
+			printf("OPC: fila de amostras %u (max %u), %u recebidas, "
+				"%u descartadas, %u agrupadas\n",
+				ring.depth, ring.max_depth, ring.pushed, ring.dropped, ring.coalesced);
+			status_age.Print("Idade dos dados de status");
+			status_latency.Print("Latencia atualizacao-envio do status");
+			position_rtt.Print("Posicao: ida e volta ao servidor web");
+			position_gateway.Print("Posicao: recebida-escrita no OPC");
+			position_latency.Print("Posicao: pedido-escrita no OPC");
+			position_poll.Print("Posicao: consultas ao servidor web");
+			printf("Posicao: %s, %u recebidas por envio do servidor web, "
+				"%u quadros descartados por tamanho\n",
+				position_push ? "enviada pelo servidor" : "consultada",
+				pushed_positions.load(), position_link->reader.Oversized());
+			position_acks.Print("Posicao: confirmacoes ao servidor web");
+			position_link->received.Print("Posicao: envios do servidor web");
+			print_cpu_usage();
+			scheduler.PrintStats();
+			position_scheduler.PrintStats();
+			watchdog_cycles.Print();
+
+			SOCArrayArena* arrays = opc_registry.Arrays();
+			printf("OPC: %u blocos de vetores em uso (%u bytes cada), %u vetores rejeitados\n",
+				arrays->BlocksUsed(), arrays->BlockSize(), arrays->Rejected());
 		}
 
 		if((char)c=='q') break;
 	}
 	
-
-	// Cancel the callback and release its reference
-	CancelDataCallback(pIConnectionPoint, dwCookie);
-	pSOCDataCallback->Release();
-	
-	// Stop threads
+	// Every thread waits on stop_event besides its timer or socket, so
+	// they all stop at once
+	std::chrono::steady_clock::time_point stop_start = std::chrono::steady_clock::now();
+	std::chrono::steady_clock::time_point drain_deadline =
+		stop_start + std::chrono::milliseconds(shutdown_drain_time);
 	executing = false;
+	SetEvent(stop_event);
+
+	// Let the frames in flight finish, then stop the links. A job still
+	// waiting for a reply at the deadline gives it up.
+	drain_link(status_link, drain_deadline);
+	if (position_link != &status_link)
+		drain_link(*position_link, drain_deadline);
 
-	// Signal reconnect_server_thread() to stop working
-	SetEvent(connectionLostEvent);
+	// Stop the periodic jobs, then the threads
+	scheduler.Stop();
+	position_scheduler.Stop();
+
+	// The watchdog uses the session and the callback object, so stop it first
+	t4.join();
 
 	// Wait threads to finish
 	t1.join();
-	t2.join();
-	t3.join();
-
-	//t4.join();
+	if (t2.joinable()) t2.join();
+	ULONGLONG threads_time = std::chrono::duration_cast<std::chrono::milliseconds>(
+		std::chrono::steady_clock::now() - stop_start).count();
 
-	// Close event
-	CloseHandle(connectionLostEvent);
+	// Close events
+	CloseHandle(status_link.lost_event);
+	CloseHandle(position_channel.lost_event);
 	freeaddrinfo(result);
 
-	// Remove items
+	// Cancel the callback, remove the OPC group and release the interface
+	// references, then release our reference to the callback:
 	printf("Removing items ...\n");
-	RemoveItem(pIOPCItemMgt, taxa_rec_real.item_handle);
-	RemoveItem(pIOPCItemMgt, potencia.item_handle);
-	RemoveItem(pIOPCItemMgt, temp_transl.item_handle);
-	RemoveItem(pIOPCItemMgt, temp_roda.item_handle);
-
-	// Remove the OPC group:
-    pIOPCItemMgt->Release();
-	RemoveGroup(pIOPCServer, hServerGroup);
-
-	// release the interface references:
-	pIOPCServer->Release();
+	opc_session->Close();
+	delete opc_session;
+	opc_session = NULL;
+	pSOCDataCallback->StopWorker();
+	pSOCDataCallback->Release();
+	opc_log.Stop();
 
 	//close the COM library:
 	CoUninitialize();
 	
-	// CLOSE SOCKET
-	// shutdown the connection since no more data will be sent
-	if (connected){
-		iResult = shutdown(ConnectSocket, SD_SEND);
-		if (iResult == SOCKET_ERROR) {
-			printf("shutdown failed with error: %d\n", WSAGetLastError());
-			closesocket(ConnectSocket);
-			WSACleanup();
-			return 1;
-		}
-	}
-	else{
-		closesocket(ConnectSocket);
-	}
-    
+	// CLOSE SOCKETS
+	// The web server is given until the drain deadline to close its end
+	close_link(status_link, drain_deadline);
+	if (position_link != &status_link)
+		close_link(*position_link, drain_deadline);
+	CloseHandle(stop_event);
+	CloseHandle(abort_event);
+
+	printf("Encerrado em %llu ms (threads em %llu ms)\n",
+		(ULONGLONG) std::chrono::duration_cast<std::chrono::milliseconds>(
+			std::chrono::steady_clock::now() - stop_start).count(), threads_time);
+	return 0;
+}
+
+void drain_link(Web_link& link, std::chrono::steady_clock::time_point deadline) {
+	// Wait until "deadline" for the exchange in flight on "link", if any,
+	// to end, then shut the sending side: no frame is sent on it anymore.
+	// If the exchange is still waiting for its reply at the deadline, the
+	// wait is given up (see recv_frame()) and the receiving side shut as
+	// well.
+	bool idle = link.mutex.try_lock_until(deadline);
+	if (!idle)
+		SetEvent(abort_event);
+	link.connected = false;
+	if (link.socket != INVALID_SOCKET)
+		shutdown(link.socket, idle ? SD_SEND : SD_BOTH); // Fails if the link is already down
+	if (!idle)
+		printf("Conexao %s encerrada com quadro pendente. \n", link.name);
+	else
+		link.mutex.unlock();
+}
+
+void close_link(Web_link& link, std::chrono::steady_clock::time_point deadline) {
+	// Close a link stopped by drain_link(), once the web server has closed
+	// its end or "deadline" has passed, whichever comes first.
+	int iResult;
+	if (link.socket == INVALID_SOCKET)
+		return;
+
 	// Receive until the peer closes the connection
     do {
+		std::chrono::steady_clock::duration left = deadline - std::chrono::steady_clock::now();
+		DWORD timeout = (DWORD) std::chrono::duration_cast<std::chrono::milliseconds>(left).count();
+		if (left <= std::chrono::steady_clock::duration::zero()) break;
+		if (timeout == 0) timeout = 1; // 0 would wait forever
+		setsockopt(link.socket, SOL_SOCKET, SO_RCVTIMEO, (const char*) &timeout, sizeof(timeout));
 
-        iResult = recv(ConnectSocket, recvbuf, recvbuflen, 0);
+        iResult = recv(link.socket, link.recvbuf, link.recvbuflen, 0);
         if ( iResult > 0 )
             printf("Bytes received: %d\n", iResult);
         else if ( iResult == 0 )
@@ -347,382 +503,603 @@ int main(void)
 
     } while( iResult > 0 );
 
-	return 0;
+	closesocket(link.socket);
+	link.socket = INVALID_SOCKET;
 }
 
-////////////////////////////////////////////////////////////////////
-// Instantiate the IOPCServer interface of the OPCServer
-// having the name ServerName. Return a pointer to this interface
-//
-IOPCServer* InstantiateServer(wchar_t ServerName[])
-{
-	CLSID CLSID_OPCServer;
-	HRESULT hr;
-
-	// get the CLSID from the OPC Server Name:
-	hr = CLSIDFromString(ServerName, &CLSID_OPCServer); // CLSIDfromProgId()
-	_ASSERT(!FAILED(hr));
-
-
-	//queue of the class instances to create
-	LONG cmq = 1; // nbr of class instance to create.
-	MULTI_QI queue[1] =
-		{{&IID_IOPCServer,
-		NULL,
-		0}};
-
-	//Server info:
-	//COSERVERINFO CoServerInfo =
-    //{
-	//	/*dwReserved1*/ 0,
-	//	/*pwszName*/ REMOTE_SERVER_NAME,
-	//	/*COAUTHINFO*/  NULL,
-	//	/*dwReserved2*/ 0
-    //}; 
-
-	// create an instance of the IOPCServer (COM intance)
-	hr = CoCreateInstanceEx(CLSID_OPCServer, NULL, CLSCTX_SERVER, /*&CoServerInfo*/ NULL, cmq, queue);
-	_ASSERT(!hr);
-
-	// return a pointer to the IOPCServer interface:
-	return(IOPCServer*) queue[0].pItf;
-}
+void webclient_job() {
+	// Send STATUS to webserver. Run by the scheduler, either every
+	// loop_web_time ms, or with status_policy.on_change at the minimum
+	// interval and whenever the registry is updated: the status is then
+	// sent only if it changed, at most once per min_interval ms, and at
+	// least once per max_silence ms (heartbeat). While
+	// reconnect_server_thread() holds the socket the run is skipped rather
+	// than waited for, so the other jobs keep their times. The frames go
+	// on status_link.
+
+	const size_t n_arrays = sizeof(published_arrays) / sizeof(published_arrays[0]);
+	static uint32_t sent_versions[n_arrays] = {}; // Last array version sent, per array item
+	static uint32_t sent_generation = 0; // Registry generation of the last status sent
+	static Status_rec sent_status = {};
+	static LONGLONG sent_at = 0; // epoch us
+	Web_link& link = status_link;
+
+	if(!link.connected || !link.mutex.try_lock())
+		return;
+	if(!link.connected){
+		link.mutex.unlock();
+		return;
+	}
 
+	LONGLONG now = EpochNow();
+	bool heartbeat = !status_policy.on_change || status_resend.exchange(false) ||
+		now - sent_at >= (LONGLONG) status_policy.max_silence * 1000;
+	if (!heartbeat && (now - sent_at < (LONGLONG) status_policy.min_interval * 1000 ||
+			opc_registry.Generation() == sent_generation)) {
+		// Too early, or nothing new: a later run will send it
+		link.mutex.unlock();
+		return;
+	}
 
-/////////////////////////////////////////////////////////////////////
-// Add group "Group1" to the Server whose IOPCServer interface
-// is pointed by pIOPCServer. 
-// Returns a pointer to the IOPCItemMgt interface of the added group
-// and a server opc handle to the added group.
-//
-void AddTheGroup(IOPCServer* pIOPCServer, IOPCItemMgt* &pIOPCItemMgt, 
-				 OPCHANDLE& hServerGroup)
-{
-	DWORD dwUpdateRate = 0;
-	OPCHANDLE hClientGroup = 0;
-
-	// pIOPCServer: instance of the OPCServer COM Interface 
-
-    HRESULT hr = pIOPCServer->AddGroup(/*szName*/ L"Group1",
-		/*bActive*/ FALSE,
-		/*dwRequestedUpdateRate*/ 1000,
-		/*hClientGroup*/ hClientGroup,
-		/*pTimeBias*/ 0,
-		/*pPercentDeadband*/ 0,
-		/*dwLCID*/0,
-		/*phServerGroup*/&hServerGroup,
-		&dwUpdateRate,
-		/*riid*/ IID_IOPCItemMgt,
-		/*ppUnk*/ (IUnknown**) &pIOPCItemMgt);
-	_ASSERT(!FAILED(hr));
-}
+	// The update time is taken before the snapshot, so that an update
+	// landing in between is timed by the next frame.
+	LONGLONG changed_at = status_changed_at.exchange(0);
+	uint32_t generation = opc_registry.Generation();
+	Status_rec status = get_status();
+	bool changed = status.taxa_rec_real != sent_status.taxa_rec_real ||
+		status.potencia != sent_status.potencia || status.temp_transl != sent_status.temp_transl ||
+		status.temp_roda != sent_status.temp_roda || status.quality != sent_status.quality ||
+		status.timestamp != sent_status.timestamp;
+	sent_generation = generation;
+
+	bool sent = true;
+	if (changed || heartbeat) {
+		std::string send_msg = get_msg_seq(link);
+		send_msg+= "$";
+		send_msg+= "11";
+		send_msg+= "$";
+		send_msg+= get_int_str(status.taxa_rec_real);
+		send_msg+= "$";
+		send_msg+= get_float_str(status.potencia);
+		send_msg+= "$";
+		send_msg+= get_float_str(status.temp_transl);
+		send_msg+= "$";
+		send_msg+= get_float_str(status.temp_roda);
+		send_msg+= "$";
+		send_msg+= get_int_str(status.quality);
+		send_msg+= "$";
+		send_msg+= get_epoch_str(status.timestamp);
+		if (position_link == &link && position_push && position_acks.Pending()) {
+			// Acknowledge the pushed positions on the way, when they
+			// come on this link
+			send_msg+= "$99$";
+			send_msg+= get_int_str(position_acks.Take(true));
+		}
+
+		// Age of the oldest value, from its source timestamp to now, and
+		// delay from the update to the frame
+		now = EpochNow();
+		if (status.timestamp != 0)
+			status_age.Record(now - status.timestamp);
+		if (changed && changed_at != 0)
+			status_latency.Record(now - changed_at);
+
+		sent = send_frame(link, send_msg);
+		sent_status = status;
+		sent_at = now;
+	}
 
+	// Then the arrays that changed since they were last sent. Unless the
+	// web server is known to answer them, nothing is waited for.
+	for (size_t k = 0; k < n_arrays && sent && array_publish; k++) {
+		std::string array_msg = get_array_msg(link, *published_arrays[k], sent_versions[k]);
+		if (!array_msg.empty())
+			sent = array_reply ? send_frame(link, array_msg) : post_frame(link, array_msg);
+	}
 
+	link.mutex.unlock();
 
-//////////////////////////////////////////////////////////////////
-// Add the Item ITEM_ID to the group whose IOPCItemMgt interface
-// is pointed by pIOPCItemMgt pointer. Return a server opc handle
-// to the item.
- 
-void AddTheItem(IOPCItemMgt* pIOPCItemMgt, OPCHANDLE& hServerItem, wchar_t* ITEM_ID, int VT, int identifier)
-{
-	HRESULT hr;
-
-	// Array of items to add:
-	OPCITEMDEF ItemArray[1] =
-	{{
-	/*szAccessPath*/ L"",
-	/*szItemID*/ ITEM_ID,
-	/*bActive*/ TRUE,
-	/*hClient*/ identifier,
-	/*dwBlobSize*/ 0,
-	/*pBlob*/ NULL,
-	/*vtRequestedDataType*/ VT,
-	/*wReserved*/0
-	}};
-
-	//Add Result:
-	OPCITEMRESULT* pAddResult=NULL;
-	HRESULT* pErrors = NULL;
-
-	// Add an Item to the previous Group:
-	hr = pIOPCItemMgt->AddItems(1, ItemArray, &pAddResult, &pErrors);
-	if (hr != S_OK){
-		printf("Failed call to AddItems function. Error code = %x\n", hr);
-		exit(0);
-	}
-
-	// Server handle for the added item:
-	hServerItem = pAddResult[0].hServer;
-
-	// release memory allocated by the server:
-	CoTaskMemFree(pAddResult->pBlob);
-
-	CoTaskMemFree(pAddResult);
-	pAddResult = NULL;
-
-	CoTaskMemFree(pErrors);
-	pErrors = NULL;
+	// Positions pushed while waiting for the replies
+	write_pushed_positions();
 }
 
-///////////////////////////////////////////////////////////////////////////////
-// Read from device the value of the item having the "hServerItem" server 
-// handle and belonging to the group whose one interface is pointed by
-// pGroupIUnknown. The value is put in varValue. 
-//
-void ReadItem(IUnknown* pGroupIUnknown, OPCHANDLE hServerItem, VARIANT& varValue)
-{
-	// value of the item:
-	OPCITEMSTATE* pValue = NULL;
+bool send_frame(Web_link& link, const std::string& send_msg) {
+	// Send one frame and wait for the reply. On failure the connection is
+	// marked as lost. Called with link.mutex held.
+
+	int iResult = send_text(link, send_msg);
+	if (iResult == SOCKET_ERROR) {
+		printf("Erro em send(): %d\n", WSAGetLastError());
+
+		// Reconnect to server ...
+		set_disconnected(link);
+		return false;
+	}
 
-	//get a pointer to the IOPCSyncIOInterface:
-	IOPCSyncIO* pIOPCSyncIO;
-	pGroupIUnknown->QueryInterface(__uuidof(pIOPCSyncIO), (void**) &pIOPCSyncIO);
+	iResult = recv_frame(link, link.recvbuf, link.recvbuflen);
+	if ( iResult > 0 )
+	{
+		link.seq.Next(); // The reply takes a number too
+		return true;
+	}
 
-	// read the item value from the device:
-	HRESULT* pErrors = NULL; //to store error code(s)
-	HRESULT hr = pIOPCSyncIO->Read(OPC_DS_DEVICE, 1, &hServerItem, &pValue, &pErrors);
-	_ASSERT(!hr);
-	_ASSERT(pValue!=NULL);
+	if ( iResult == 0 ) printf("Conexao perdida. \n");
+	else printf("Erro em recv(): %d\n", WSAGetLastError());
 
-	varValue = pValue[0].vDataValue;
+	// Reconnect to server ...
+	set_disconnected(link);
+	return false;
+}
 
-	//Release memeory allocated by the OPC server:
-	CoTaskMemFree(pErrors);
-	pErrors = NULL;
+bool post_frame(Web_link& link, const std::string& send_msg) {
+	// Send one frame the web server does not answer. On failure the
+	// connection is marked as lost. Called with link.mutex held.
 
-	CoTaskMemFree(pValue);
-	pValue = NULL;
+	if (send_text(link, send_msg) == SOCKET_ERROR) {
+		printf("Erro em send(): %d\n", WSAGetLastError());
 
-	// release the reference to the IOPCSyncIO interface:
-	pIOPCSyncIO->Release();
+		// Reconnect to server ...
+		set_disconnected(link);
+		return false;
+	}
+	return true;
 }
 
-void WriteItem(IUnknown* pGroupIUnknown, OPCHANDLE hServerItem, VARIANT * varValue)
-{
-	//get a pointer to the IOPCSyncIOInterface:
-	IOPCSyncIO* pIOPCSyncIO;
-	pGroupIUnknown->QueryInterface(__uuidof(pIOPCSyncIO), (void**)&pIOPCSyncIO);
+bool position_job(bool& moved) {
+	// Fetch the position from the web server and write it to the OPC
+	// server. Run by the scheduler at an interval set by position_poll
+	// (see main()), and on 'p':
+	// seq.33 ->
+	// position X, Y, Z ... <- 
+	// ACK ->
+	// The new position is written at once, by calling opcclient_job() from
+	// this job, and every stage is timestamped. Returns true if a position
+	// was received; "moved" tells whether it differs from the last one.
+	// The frames go on position_link.
+
+	int iResult;
+	Posicao_sample sample = {};
+	Web_link& link = *position_link;
+
+	moved = false;
+	if(!link.connected || !link.mutex.try_lock())
+		return false;
+	if(!link.connected){
+		link.mutex.unlock();
+		return false;
+	}
+
+	// Send request
+	std::string send_msg = get_msg_seq(link);
+	send_msg+= "$33";
+	sample.requested_at = EpochNow();
+	iResult = send_text(link, send_msg);
+	if (iResult == SOCKET_ERROR) {
+		printf("Erro em send(): %d\n", WSAGetLastError());
+
+		// Reconnect to server ...
+		set_disconnected(link);
+		link.mutex.unlock();
+		return false;
+	}
+
+	// Receive data
+	iResult = recv_frame(link, link.recvbuf, link.recvbuflen);
+	if ( iResult <= 0 )
+	{
+		if ( iResult == 0 ) printf("Conexao perdida. \n");
+		else printf("Erro em recv(): %d\n", WSAGetLastError());
+		// Reconnect to server ...
+		set_disconnected(link);
+		link.mutex.unlock();
+		return false;
+	}
+	sample.received_at = EpochNow();
+	link.seq.Next(); // The reply takes a number too
+
+	bool valid = parse_position(link.recvbuf, sample.posicao);
+	sample.parsed_at = EpochNow();
+
+	// Send ACK
+	std::string send_ack = get_msg_seq(link);
+	send_ack+= "$99";
+	iResult = send_text(link, send_ack);
+	if (iResult == SOCKET_ERROR) {
+		printf("Erro em send(): %d\n", WSAGetLastError());
 
-	// read the item value from the device:
-	HRESULT* pErrors = NULL; //to store error code(s)
-	HRESULT hr = pIOPCSyncIO->Write(1, &hServerItem, varValue, &pErrors);
-	_ASSERT(!hr);
+		// Reconnect to server ...
+		set_disconnected(link);
+	}
+	link.mutex.unlock();
 
-	//Release memeory allocated by the OPC server:
-	CoTaskMemFree(pErrors);
-	pErrors = NULL;
+	if(!valid){
+		printf("MENSAGEM DO SERVIDOR NAO ESTA NO FORMATO ESPERADO.\n\n");
+		return false;
+	}
+	position_rtt.Record(sample.received_at - sample.requested_at);
 
-	// release the reference to the IOPCSyncIO interface:
-	pIOPCSyncIO->Release();
+	moved = store_position(sample);
+	opcclient_job();
+	return true;
 }
 
-///////////////////////////////////////////////////////////////////////////
-// Remove the item whose server handle is hServerItem from the group
-// whose IOPCItemMgt interface is pointed by pIOPCItemMgt
-//
-void RemoveItem(IOPCItemMgt* pIOPCItemMgt, OPCHANDLE hServerItem)
-{
-	// server handle of items to remove:
-	OPCHANDLE hServerArray[1];
-	hServerArray[0] = hServerItem;
-	
-	//Remove the item:
-	HRESULT* pErrors; // to store error code(s)
-	HRESULT hr = pIOPCItemMgt->RemoveItems(1, hServerArray, &pErrors);
-	_ASSERT(!hr);
-
-	//release memory allocated by the server:
-	CoTaskMemFree(pErrors);
-	pErrors = NULL;
+bool store_position(Posicao_sample& sample) {
+	// Publish a new position to opcclient_job(), giving it the next
+	// version. Returns true if it differs from the last one.
+	static uint32_t version = 0;
+
+	Posicao last = posicao_store.Load().posicao;
+	bool moved = version == 0 || sample.posicao.vel_transl != last.vel_transl ||
+		sample.posicao.coord_x != last.coord_x || sample.posicao.coord_y != last.coord_y ||
+		sample.posicao.coord_z != last.coord_z;
+
+	sample.version = ++version;
+	posicao_store.Store(sample);
+	return moved;
 }
 
-////////////////////////////////////////////////////////////////////////
-// Remove the Group whose server handle is hServerGroup from the server
-// whose IOPCServer interface is pointed by pIOPCServer
-//
-void RemoveGroup (IOPCServer* pIOPCServer, OPCHANDLE hServerGroup)
-{
-	// Remove the group:
-	HRESULT hr = pIOPCServer->RemoveGroup(hServerGroup, FALSE);
-	if (hr != S_OK){
-		if (hr == OPC_S_INUSE)
-			printf ("Failed to remove OPC group: object still has references to it.\n");
-		else printf ("Failed to remove OPC group. Error code = %x\n", hr);
-		exit(0);
+bool subscribe_positions() {
+	// Ask the web server to push positions on a new connection:
+	// seq$44 ->
+	// seq$45 <-  subscribed
+	// From the "45" on, both sides end every frame with '\n', and the web
+	// server sends each new position, unrequested, as
+	// seq$34$vel_transl$x$y$z$taxa_rec (see handle_pushed_frame()). The
+	// client acknowledges them cumulatively, appending $99$<last seq> to
+	// its next status frame, or sending seq$99$<last seq> on its own when
+	// none goes out soon enough (see position_push_job()). Any other reply comes from a server
+	// without subscriptions, and positions are polled as before; no reply
+	// within a second, or a connection closed or failed during the
+	// handshake, turns subscriptions off for good.
+	// Called on position_link, with its mutex held. Returns false if the
+	// link failed.
+	Web_link& link = *position_link;
+	char* recvbuf = link.recvbuf;
+
+	std::string send_msg = get_msg_seq(link);
+	send_msg+= "$44";
+	int iResult = send_text(link, send_msg);
+	printf("SENT: %s\n", send_msg.c_str());
+	int error = (iResult == SOCKET_ERROR) ? WSAGetLastError() :
+		link.wait.Readable(link.socket, 1000, stop_event);
+	if (error == 0) {
+		iResult = recv(link.socket, recvbuf, link.recvbuflen - 1, 0);
+		if (iResult == SOCKET_ERROR)
+			error = WSAGetLastError();
+	}
+	else
+		iResult = SOCKET_ERROR;
+
+	if (error == WSAEINTR)
+		return false; // Shutting down: the server is not to blame
+	if (iResult <= 0) {
+		// Timeout, close, reset or any other error: taken as a server that
+		// does not know subscriptions, so the next connection polls
+		// instead of failing the same way again
+		if (iResult == 0)
+			printf("Servidor web fechou a conexao na inscricao. Posicao sera consultada. \n");
+		else if (error == WSAETIMEDOUT)
+			printf("Servidor web nao respondeu a inscricao. Posicao sera consultada. \n");
+		else
+			printf("Erro %d na inscricao. Posicao sera consultada. \n", error);
+		position_subscribe = false;
+		return false;
 	}
+	recvbuf[iResult] = 0;
+	link.seq.Next(); // The reply takes a number too
+
+	// The reply may be followed by the first pushed frames
+	char* end = strchr(recvbuf, '\n');
+	if (end != NULL) *end = 0;
+	printf("RECV: %s\n", recvbuf);
+	std::vector<string> fields = split(string(recvbuf), '$');
+	if (fields.size() < 2 || fields[1] != "45") {
+		printf("Servidor web sem envio de posicao. Posicao sera consultada. \n");
+		return true;
+	}
+
+	link.reader.Reset(true);
+	link.received.Restart();
+	if (end != NULL)
+		link.reader.Unread(end + 1, iResult - (end + 1 - recvbuf));
+	position_acks.Reset();
+	position_push = true;
+	printf("Posicao enviada pelo servidor web. \n");
+	return true;
 }
 
-void webclient_loop(unsigned int loop_delay) {
-	// Send STATUS to webserver
+bool position_push_job() {
+	// Take the positions pushed by the web server and write the last one.
+	// If no status frame carried their ACK in time, acknowledge them all
+	// with a single one:
+	// seq$99$<seq of the last pushed frame> ->
+	// Run by the scheduler every loop_pos_time ms while push mode is on.
+	// The socket is read without blocking. Returns false if the link
+	// failed.
+	Web_link& link = *position_link;
+
+	if(!link.connected || !link.mutex.try_lock())
+		return true;
+	if(!link.connected || !position_push){
+		link.mutex.unlock();
+		return true;
+	}
 
-	int iResult;
-	std::chrono::milliseconds interval(loop_delay);
+	bool closed;
+	char frame[DEFAULT_BUFLEN];
+	link.reader.Poll(link.socket, closed);
+	while (link.reader.Pop(frame, sizeof(frame))) {
+		if (!handle_pushed_frame(link, frame))
+			printf("RECV (ignorado): %s\n", frame);
+	}
 
-	while(executing)
-	{	
-		if(socket_mutex.try_lock())
-		{
-			if(!connected){
-				socket_mutex.unlock();
-				continue;
-			}
-			std::string send_msg = get_msg_seq();
-			send_msg+= "$";
-			send_msg+= "11";
-			send_msg+= "$";
-			send_msg+= get_int_str(status.taxa_rec_real);
-			send_msg+= "$";
-			send_msg+= get_float_str(status.potencia);
-			send_msg+= "$";
-			send_msg+= get_float_str(status.temp_transl);
-			send_msg+= "$";
-			send_msg+= get_float_str(status.temp_roda);
-
-
-			iResult = send( ConnectSocket, send_msg.c_str(), (int) send_msg.size() , 0 );
-			printf("SENT: %s\n", send_msg.c_str());
-			if (iResult == SOCKET_ERROR) {
-				printf("Erro em send(): %d\n", WSAGetLastError());
-
-				// Reconnect to server ...
-				set_disconnected();
-				socket_mutex.unlock();
-				continue;
-			}
+	bool alive = !closed;
+	if (closed) {
+		printf("Conexao perdida. \n");
+		set_disconnected(link);
+	}
+	else if (position_acks.Due()) {
+		std::string send_ack = get_msg_seq(link);
+		send_ack+= "$99$";
+		send_ack+= get_int_str(position_acks.Take(false));
+		if (send_text(link, send_ack) == SOCKET_ERROR) {
+			printf("Erro em send(): %d\n", WSAGetLastError());
+			set_disconnected(link);
+			alive = false;
+		}
+	}
+	link.mutex.unlock();
 
-			iResult = recv(ConnectSocket, recvbuf, recvbuflen, 0);
-			if ( iResult > 0 )
-			{
-				if(iResult>= recvbuflen)iResult-=1; // Prevent possible invalid memory access
-				recvbuf[iResult]=0;
-				printf("RECV: %s\n", recvbuf);
-				if(++msg_seq >= 1000000) msg_seq = 1;
-			}
-			else 
-			{
-				if ( iResult == 0 ) printf("Conexao perdida. \n");
-				else printf("Erro em recv(): %d\n", WSAGetLastError());
-
-				// Reconnect to server ...
-				set_disconnected();
-				socket_mutex.unlock();
-				continue;
-			}
+	write_pushed_positions();
+	return alive;
+}
 
-			socket_mutex.unlock();
-		}
-		else{
-			continue;
-		}
-		
-		std::this_thread::sleep_for(interval);
+bool handle_pushed_frame(Web_link& link, const char* frame) {
+	// Store a position pushed by the web server; it is written to the OPC
+	// server by write_pushed_positions(), once the socket is released.
+	// The server numbers its pushed frames one by one: link.received
+	// counts the ones lost, duplicated or reordered on the way, and a
+	// position older than one already stored is dropped.
+	// Returns false if the frame is not a pushed position.
+	// Called with link.mutex held.
+	std::vector<string> fields = split(string(frame), '$');
+	if (fields.size() < 2 || fields[1] != "34")
+		return false;
+
+	Posicao_sample sample = {};
+	sample.received_at = EpochNow();
+	sample.requested_at = sample.received_at; // Nothing was requested
+	uint32_t seq = (uint32_t) strtoul(fields[0].c_str(), NULL, 10);
+	position_acks.Received(seq);
+	pushed_positions++;
+	if (!link.received.Observe(seq))
+		return true;
+	if (!parse_position(frame, sample.posicao)) {
+		printf("MENSAGEM DO SERVIDOR NAO ESTA NO FORMATO ESPERADO.\n\n");
+		return true;
 	}
+	sample.parsed_at = EpochNow();
+	store_position(sample);
+	position_pending = true;
+	return true;
+}
+
+void write_pushed_positions() {
+	// Write the last pushed position, if one arrived since it was last
+	// written. opcclient_job() clears position_pending only once it holds
+	// the session: a run skipped because another thread had it leaves the
+	// position to the next call (every loop_pos_time ms at most).
+	if (position_pending)
+		opcclient_job();
+}
 
+bool parse_position(const char* msg, Posicao& posicao) {
+	// Decodes a position frame, seq$code$vel_transl$x$y$z$taxa_rec.
+	// Returns false, leaving "posicao" alone, unless every field is a
+	// number.
+	std::vector<string> fields = split(string(msg), '$');
+	if(fields.size() != 7)
+		return false;
+
+	double values[5];
+	for (int k = 0; k < 5; k++) {
+		const char* field = fields[k + 2].c_str();
+		char* end;
+		values[k] = strtod(field, &end);
+		if (end == field || *end != '\0' || !(values[k] == values[k]))
+			return false;
+	}
+	posicao.vel_transl = (float) values[0];
+	posicao.coord_x = VtSaturate<unsigned int>(values[1]);
+	posicao.coord_y = VtSaturate<unsigned int>(values[2]);
+	posicao.coord_z = VtSaturate<unsigned int>(values[3]);
+	posicao.taxa_rec = values[4];
+	return true;
 }
 
-void opcclient_loop(unsigned int loop_delay) {
-	// WRITE variables (Posicao) to OPC server
+void opcclient_job() {
+	// WRITE variables (Posicao) to OPC server. Called by position_job() as
+	// soon as a new position arrives, and run by the scheduler every
+	// loop_opc_time ms. A new position only writes the fields that
+	// changed; a periodic run with no new position writes them all again.
+	// While opcwatchdog_loop() or the other scheduler thread holds the
+	// session, the run is skipped.
+	// A pushed position (see write_pushed_positions()) is taken as written
+	// here, as the run writes the last position stored whatever triggered it.
 	VARIANT varValue; //to store the read value
 	VariantInit(&varValue);
-	std::chrono::milliseconds interval(loop_delay);
+	static Posicao written = {};
+	static uint32_t written_version = 0;
 
-	while(executing)
-	{
-		if(opc_mutex.try_lock())
-		{
-			varValue.vt = vel_trans.type;
-			varValue.fltVal = posicao.vel_transl;
-			WriteItem(pIOPCItemMgt, vel_trans.item_handle, &varValue);
+	if(!opc_mutex.try_lock())
+		return;
 
-			varValue.vt = coord_x.type;
-			
-			// Cap posicao.coord_x to 255, because it is only 1 byte
-			unsigned int cx = posicao.coord_x;
-			if (cx > 255) cx = 255;
-			varValue.uintVal = cx;
-			varValue.uiVal = cx;
-			WriteItem(pIOPCItemMgt, coord_x.item_handle, &varValue);
-
-			varValue.vt = coord_y.type;
-			varValue.uintVal = posicao.coord_y;
-			WriteItem(pIOPCItemMgt, coord_y.item_handle, &varValue);
-
-			varValue.vt = coord_z.type;
-			varValue.uintVal = posicao.coord_z;
-			WriteItem(pIOPCItemMgt, coord_z.item_handle, &varValue);
-
-			varValue.vt = taxa_rec.type;
-			varValue.dblVal = posicao.taxa_rec;
-			WriteItem(pIOPCItemMgt, taxa_rec.item_handle, &varValue);
-			opc_mutex.unlock();
-		}
-		else{
-			continue;
-		}
-		std::this_thread::sleep_for(interval);
+	IOPCItemMgt* pIOPCItemMgt = opc_session->ItemMgt();
+	if (pIOPCItemMgt == NULL) {
+		// OPC session is down and being recovered by opcwatchdog_loop()
+		opc_mutex.unlock();
+		return;
+	}
+
+	position_pending = false;
+	Posicao_sample sample = posicao_store.Load();
+	const Posicao& posicao = sample.posicao;
+	bool all = (sample.version == written_version);
+
+	// Each value is converted to the type the item was added with;
+	// out of range values saturate (coord_x is a single byte, so
+	// it is capped at 255).
+	if (all || posicao.vel_transl != written.vel_transl) {
+		VariantSet(varValue, (VARTYPE) vel_trans.type, posicao.vel_transl);
+		WriteItem(pIOPCItemMgt, vel_trans.item_handle, &varValue);
+	}
+	if (all || posicao.coord_x != written.coord_x) {
+		VariantSet(varValue, (VARTYPE) coord_x.type, posicao.coord_x);
+		WriteItem(pIOPCItemMgt, coord_x.item_handle, &varValue);
+	}
+	if (all || posicao.coord_y != written.coord_y) {
+		VariantSet(varValue, (VARTYPE) coord_y.type, posicao.coord_y);
+		WriteItem(pIOPCItemMgt, coord_y.item_handle, &varValue);
+	}
+	if (all || posicao.coord_z != written.coord_z) {
+		VariantSet(varValue, (VARTYPE) coord_z.type, posicao.coord_z);
+		WriteItem(pIOPCItemMgt, coord_z.item_handle, &varValue);
+	}
+	if (all || posicao.taxa_rec != written.taxa_rec) {
+		VariantSet(varValue, (VARTYPE) taxa_rec.type, posicao.taxa_rec);
+		WriteItem(pIOPCItemMgt, taxa_rec.item_handle, &varValue);
+	}
+	written = posicao;
+	written_version = sample.version;
+	opc_mutex.unlock();
+
+	if (!all) {
+		LONGLONG written_at = EpochNow();
+		position_gateway.Record(written_at - sample.received_at);
+		position_latency.Record(written_at - sample.requested_at);
 	}
 }
 
-void opcread_loop(unsigned int loop_delay) {
-	// READ variables (status) from OPC Server
+void opcread_job() {
+	// READ variables (status) from OPC Server, as an alternative to the
+	// callback notifications. To use it, add it to the scheduler in main().
 
 	VARIANT varValue; 
 	VariantInit(&varValue);
-	std::chrono::milliseconds interval(loop_delay);
-	bool verbose = false;
+	Opc_item* status_items[] = { &taxa_rec_real, &potencia, &temp_transl, &temp_roda };
+
+	if(!opc_mutex.try_lock())
+		return;
+
+	IOPCItemMgt* pIOPCItemMgt = opc_session->ItemMgt();
+	if (pIOPCItemMgt == NULL) {
+		// OPC session is down and being recovered by opcwatchdog_loop()
+		opc_mutex.unlock();
+		return;
+	}
+
+	for (int k = 0; k < 4; k++) {
+		WORD quality;
+		FILETIME timestamp;
+		if (status_items[k]->item_handle == 0)
+			continue;	// rejected by the server
+		ReadItem(pIOPCItemMgt, status_items[k]->item_handle, varValue, &quality, &timestamp);
+		opc_registry.BeginUpdate();
+		opc_registry.Store(status_items[k]->id, varValue, quality, FileTimeToEpoch(timestamp));
+		opc_registry.EndUpdate();
+	}
+	opc_mutex.unlock();
+}
+
+void opcwatchdog_loop(SOCDataCallback* pSOCDataCallback, unsigned int keep_alive) {
+	// Flag the OPC session as stale when the server stops calling back, and
+	// rebuild it. The server sends at least one callback (data or keep-alive)
+	// every keep_alive ms, so with a check every keep_alive/2 ms a dead server
+	// is detected within 1.5 * keep_alive + keep_alive/2 ms at most. A server
+	// without keep-alive support is asked for its status instead once the
+	// group has been quiet that long.
+
+	// Recovery makes COM calls from this thread
+	CoInitializeEx(NULL, COINIT_MULTITHREADED);
+
+	ULONGLONG last_recovery = 0;
+
+	// Checks run on absolute deadlines, so the time spent in a recovery
+	// does not shift the following ones.
+	std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now();
+
 	while(executing)
 	{
-		if(opc_mutex.try_lock())
-		{
-			ReadItem(pIOPCItemMgt, taxa_rec_real.item_handle, varValue);
-			if(status.taxa_rec_real != varValue.uintVal)
-			{
-				status.taxa_rec_real = varValue.uintVal;
-				if(verbose) printf("%S: %d\n", taxa_rec_real.item_id , status.taxa_rec_real );
-			}
-			
-			ReadItem(pIOPCItemMgt, potencia.item_handle, varValue);
-			if(status.potencia != varValue.fltVal)
-			{
-				status.potencia = varValue.fltVal;
-				if(verbose) printf("%S: %f\n", potencia.item_id , status.potencia );
-			}
-
-			ReadItem(pIOPCItemMgt, temp_transl.item_handle, varValue);
-			if(status.temp_transl != varValue.fltVal)
-			{
-				status.temp_transl = varValue.fltVal;
-				if(verbose) printf("%S: %f\n", temp_transl.item_id , status.temp_transl );
-			}
-			
-			ReadItem(pIOPCItemMgt, temp_roda.item_handle, varValue);
-			if(status.temp_roda != varValue.fltVal)
-			{
-				status.temp_roda = varValue.fltVal;
-				if(verbose) printf("%S: %f\n", temp_roda.item_id , status.temp_roda );
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+		// The server may have revised the keep-alive time
+		if (opc_session->KeepAlive() != 0) keep_alive = opc_session->KeepAlive();
+		unsigned int check_delay = keep_alive / 2;
+		if (check_delay == 0) check_delay = 1;
+		std::chrono::milliseconds interval(check_delay);
+		ULONGLONG timeout = keep_alive + keep_alive / 2; // Tolerate server jitter
+
+		ULONGLONG now = GetTickCount64();
+		ULONGLONG silence = now - pSOCDataCallback->LastCallbackTick();
+
+		// Without keep-alive callbacks a group whose values do not change
+		// is quiet on a live server too: it is only stale if the server
+		// does not answer either.
+		if (silence > timeout && !opc_session->ServerKeepAlive() && opc_session->Responding()) {
+			if (opc_stale.exchange(false))
+				printf("Sessao OPC restabelecida. \n");
+		}
+		else if (silence > timeout) {
+			if (!opc_stale.exchange(true))
+				printf("Servidor OPC nao responde ha %llu ms. Sessao OPC inativa.\n", silence);
+
+			// Give a freshly rebuilt session one timeout to deliver its
+			// first callback before rebuilding it again.
+			if (now - last_recovery > timeout) {
+				opc_session->Recover(executing, stop_event);
+				last_recovery = GetTickCount64();
 			}
-				opc_mutex.unlock();
 		}
-		else{
-			continue;
+		else if (opc_stale.exchange(false)) {
+			printf("Sessao OPC restabelecida. \n");
 		}
-	
-		std::this_thread::sleep_for(interval);
+
+		std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+		watchdog_cycles.Cycle(
+			std::chrono::duration_cast<std::chrono::microseconds>(start - deadline).count(),
+			std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+
+		// Next deadline; the ones already past (a long recovery) are skipped
+		deadline += interval;
+		if (deadline <= end) {
+			long long missed = (end - deadline) / interval + 1;
+			watchdog_cycles.Missed((uint32_t) missed);
+			deadline += missed * interval;
+		}
+		// Sleep until the deadline, or until shutdown
+		std::chrono::steady_clock::duration left = deadline - std::chrono::steady_clock::now();
+		if (left > std::chrono::steady_clock::duration::zero())
+			WaitForSingleObject(stop_event,
+				(DWORD) std::chrono::duration_cast<std::chrono::milliseconds>(left).count() + 1);
 	}
+
+	CoUninitialize();
 }
 
-void reconnect_server_thread(struct addrinfo *result){
+void reconnect_server_thread(Web_link* link, struct addrinfo *result){
+	// (Re)connect "link" whenever it is lost. One thread per link.
 	struct addrinfo *ptr = NULL;
 	std::chrono::milliseconds interval(2000);
 	int iResult;
 	while(true){
-		// wait for event...
-		DWORD dwWaitResult = WaitForSingleObject( 
-			connectionLostEvent, // event handle
+		// wait for event, or shutdown...
+		HANDLE events[2] = { link->lost_event, stop_event };
+		DWORD dwWaitResult = WaitForMultipleObjects( 
+			2, events,    // event handles
+			FALSE,        // either of them
 			INFINITE);    // indefinite wait
 
-		if (dwWaitResult!=WAIT_OBJECT_0) {
+		if (dwWaitResult!=WAIT_OBJECT_0 && dwWaitResult!=WAIT_OBJECT_0 + 1) {
 			printf("Wait error (%d)\n", GetLastError()); 
 		}
 
@@ -730,115 +1107,259 @@ void reconnect_server_thread(struct addrinfo *result){
 		if(!executing) break;
 
 		// lock connection mutex
-		socket_mutex.lock();
-		connected = false;
+		link->mutex.lock();
+		link->connected = false;
 
 		while(executing){ // Connection loop
 
-			if (ConnectSocket != INVALID_SOCKET) {
+			if (link->socket != INVALID_SOCKET) {
 				// Test if there is connection
-				printf("Testando Conexao... \n");
+				printf("Testando Conexao (%s)... \n", link->name);
 
 				// Build message
-				std::string send_msg = get_msg_seq();
+				std::string send_msg = get_msg_seq(*link);
 				send_msg+= "$33";
 
 				// Send request
-				iResult = send( ConnectSocket, send_msg.c_str(), (int) send_msg.size() , 0 );
+				iResult = send_text(*link, send_msg);
 				printf("SENT: %s\n", send_msg.c_str());
 
 				// Receive data
-				iResult = recv(ConnectSocket, recvbuf, recvbuflen, 0);
+				iResult = recv_frame(*link, link->recvbuf, link->recvbuflen);
 				if ( iResult > 0 )
 				{
-					printf("RECV: %s\n\n", recvbuf);
-					msg_seq += 1;
+					printf("RECV: %s\n\n", link->recvbuf);
+					link->seq.Next(); // The reply takes a number too
 
 					// Send ACK if data was received
-					std::string send_ack = get_msg_seq();
+					std::string send_ack = get_msg_seq(*link);
 					send_ack+= "$99";
-					iResult = send( ConnectSocket, send_ack.c_str(), (int) send_ack.size() , 0 );
+					iResult = send_text(*link, send_ack);
+
+					// On the position link, a connection that was already
+					// subscribed stays so; a new one subscribes now
+					bool linked = true;
+					if (link == position_link) {
+						if (link->reader.Delimited())
+							position_push = true;
+						else if (position_subscribe)
+							linked = subscribe_positions();
+					}
 
-					// Connection restored
-					printf("Conexao estabelecida. \n\n");
-					connected = true;
+					if (linked) {
+						// Connection restored
+						printf("Conexao estabelecida (%s). \n\n", link->name);
+						if (link == &status_link)
+							status_resend = true;
+						link->connected = true;
 
-					break; // Break connection loop
+						break; // Break connection loop
+					}
+					closesocket(link->socket);
+					link->socket = INVALID_SOCKET;
 				}
 
 				else{
 					// No connection 
-					closesocket(ConnectSocket);
-					ConnectSocket = INVALID_SOCKET;
+					closesocket(link->socket);
+					link->socket = INVALID_SOCKET;
 				}
 			}
 
 			// No connection, attempt to connect
-			printf("Reconectando... \n");
-			msg_seq = 1;
+			printf("Reconectando (%s)... \n", link->name);
+			link->seq.Reset();
 
-			// Wait to try again
-			std::this_thread::sleep_for(interval);
+			// Wait to try again, unless shutting down
+			if (WaitForSingleObject(stop_event, (DWORD) interval.count()) == WAIT_OBJECT_0)
+				break;
 			
 			for(ptr=result; ptr != NULL ;ptr=ptr->ai_next) {
 
 				// Create a SOCKET for connecting to server
-				ConnectSocket = socket(ptr->ai_family, ptr->ai_socktype, 
+				link->socket = socket(ptr->ai_family, ptr->ai_socktype, 
 					ptr->ai_protocol);
-				if (ConnectSocket == INVALID_SOCKET) {
+				if (link->socket == INVALID_SOCKET) {
 					printf("socket failed with error: %ld\n", WSAGetLastError());
 				}
 
-				// Connect to server.
-				iResult = connect( ConnectSocket, ptr->ai_addr, (int)ptr->ai_addrlen);
-				if (iResult == SOCKET_ERROR) {
-					closesocket(ConnectSocket);
-					ConnectSocket = INVALID_SOCKET;
+				// Connect to server. A server that does not answer takes
+				// the stack some 21 s to give up: the wait ends on shutdown
+				// instead, so that link->mutex is not held past it.
+				iResult = link->wait.Connect(link->socket, ptr->ai_addr, (int)ptr->ai_addrlen, stop_event);
+				if (iResult != 0) {
+					closesocket(link->socket);
+					link->socket = INVALID_SOCKET;
+					if (iResult == WSAEINTR) break;
 					continue;
 				}
+				link->reader.Reset(false); // New connection, not subscribed
 				break; // Finished connecting
 			}
 
 		}
 
-		socket_mutex.unlock();
+		link->mutex.unlock();
 	}
 }
 
-void set_disconnected(){
-	SetEvent(connectionLostEvent);
-	connected = false;
+void set_disconnected(Web_link& link){
+	SetEvent(link.lost_event);
+	if (&link == position_link)
+		position_push = false;
+	link.connected = false;
 }
 
-std::string get_msg_seq() {
-	// Fills string with leading zeros
-	// Source: https://stackoverflow.com/questions/225362/convert-a-number-to-a-string-with-specified-length-in-c
+int send_text(Web_link& link, const std::string& msg) {
+	// Send one frame, with the '\n' that ends it once positions are
+	// pushed. Called with link.mutex held.
+	if (!link.reader.Delimited())
+		return send( link.socket, msg.c_str(), (int) msg.size() , 0 );
+	std::string line = msg + "\n";
+	return send( link.socket, line.c_str(), (int) line.size() , 0 );
+}
 
-	std::stringstream ss;
-	ss << std::setw(6) << std::setfill('0') << msg_seq;
-	std::string s = ss.str();
+int recv_frame(Web_link& link, char* buf, int len) {
+	// Receive the reply to the frame just sent, NUL terminated. Positions
+	// the web server pushes in the meantime are stored on the way (see
+	// handle_pushed_frame()). Returns like recv(); once the shutdown drain
+	// time is over (abort_event) the wait fails with WSAEINTR.
+	// Called with link.mutex held.
+	for (;;) {
+		if (!link.reader.Buffered()) {
+			int error = link.wait.Readable(link.socket, INFINITE, abort_event);
+			if (error != 0) {
+				WSASetLastError(error);
+				return SOCKET_ERROR;
+			}
+		}
+		int iResult = link.reader.Next(link.socket, buf, len);
+		if (iResult <= 0 || !link.reader.Delimited() || !handle_pushed_frame(link, buf))
+			return iResult;
+	}
+}
 
-	if(++msg_seq >= 1000000) msg_seq = 1;
+void print_cpu_usage(){
+	// CPU time used by the process since the previous call (since start on
+	// the first one), in percent of one core. Idle, it should stay near 0.
+	FILETIME creation, exit_time, kernel, user, now;
+	ULARGE_INTEGER k, u, c, n;
+
+	GetProcessTimes(GetCurrentProcess(), &creation, &exit_time, &kernel, &user);
+	GetSystemTimeAsFileTime(&now);
+	k.LowPart = kernel.dwLowDateTime; k.HighPart = kernel.dwHighDateTime;
+	u.LowPart = user.dwLowDateTime; u.HighPart = user.dwHighDateTime;
+	c.LowPart = creation.dwLowDateTime; c.HighPart = creation.dwHighDateTime;
+	n.LowPart = now.dwLowDateTime; n.HighPart = now.dwHighDateTime;
+
+	static ULONGLONG last_cpu = 0;
+	static ULONGLONG last_wall = c.QuadPart;
+	ULONGLONG cpu = k.QuadPart + u.QuadPart;
+	ULONGLONG wall = n.QuadPart;
+	if (wall > last_wall)
+		printf("CPU: %.1f%% de um nucleo nos ultimos %.1f s\n",
+			100.0 * (cpu - last_cpu) / (wall - last_wall), (wall - last_wall) / 1e7);
+	last_cpu = cpu;
+	last_wall = wall;
+}
 
-	return s; 
+Status_rec get_status() {
+	// Builds the status record from the last values stored in the registry.
+	// All four values are taken from the same callback batch.
+	OPCHANDLE handles[4] = { (OPCHANDLE) taxa_rec_real.id, (OPCHANDLE) potencia.id,
+		(OPCHANDLE) temp_transl.id, (OPCHANDLE) temp_roda.id };
+	Opc_slot slots[4];
+	opc_registry.Snapshot(handles, 4, slots);
+
+	// Each slot is decoded from the type the server sent straight into
+	// the field's type; empty slots leave the field at zero.
+	Status_rec s = {};
+	VtDecode(slots[0].vt, &slots[0].value, s.taxa_rec_real);
+	VtDecode(slots[1].vt, &slots[1].value, s.potencia);
+	VtDecode(slots[2].vt, &slots[2].value, s.temp_transl);
+	VtDecode(slots[3].vt, &slots[3].value, s.temp_roda);
+
+	// The record is only as good, and as recent, as its worst value.
+	s.quality = slots[0].quality;
+	s.timestamp = slots[0].timestamp;
+	for (int k = 1; k < 4; k++) {
+		if ((slots[k].quality & OPC_QUALITY_MASK) < (s.quality & OPC_QUALITY_MASK))
+			s.quality = slots[k].quality;
+		if (slots[k].timestamp < s.timestamp)
+			s.timestamp = slots[k].timestamp;
+	}
+	return s;
 }
 
-std::string get_int_str(int val){
+std::string get_array_msg(Web_link& link, const Opc_item& item, uint32_t& sent_version) {
+	// Builds the "55" frame of an array item, or an empty string if the
+	// array did not change since sent_version:
+	//   seq$55$handle$total$sent$e1,e2,...
+	// where "total" is the number of elements of the array and "sent" the
+	// number of leading elements that fit in the frame. An item that was
+	// never registered keeps the handle of another one and is not sent.
+	if (opc_registry.Find((OPCHANDLE) item.id) != &item)
+		return std::string();
+	Opc_slot slot = opc_registry.Slot((OPCHANDLE) item.id);
+	if (!(slot.vt & VT_ARRAY) || (uint32_t) slot.value == sent_version)
+		return std::string();
+
+	// The elements are copied out of the registry once, straight into a
+	// buffer of the size of an arena block.
+	static std::vector<BYTE> data(opc_registry.Arrays()->BlockSize());
+	Opc_array_info info;
+	if (!opc_registry.CopyArray((OPCHANDLE) item.id, info, data.data(), data.size()))
+		return std::string();
+	sent_version = (uint32_t) slot.value;
+
+	std::string send_msg = get_msg_seq(link);
+	send_msg+= "$";
+	send_msg+= "55";
+	send_msg+= "$";
+	send_msg+= get_int_str(item.id);
+	send_msg+= "$";
+	send_msg+= get_int_str(info.elements);
+	send_msg+= "$";
+
+	// Leave room for the count of sent elements, the '$' and the NUL
+	char elements[DEFAULT_BUFLEN];
+	ULONG fitted;
+	size_t room = DEFAULT_BUFLEN - send_msg.size() - 8;
+	size_t length = FormatArray(info.vt, data.data(), info.elements, elements, room,
+		OPC_FORMAT_TEXT, &fitted);
+
+	send_msg+= get_int_str(fitted);
+	send_msg+= "$";
+	send_msg.append(elements, length);
+	return send_msg;
+}
+
+std::string get_msg_seq(Web_link& link) {
+	// Next sequence number of "link", filled with leading zeros
+	// Source: https://stackoverflow.com/questions/225362/convert-a-number-to-a-string-with-specified-length-in-c
+
 	std::stringstream ss;
-	if(val > 999999) val = 999999;
-	if(val <0) val = 0;
-	ss << std::setw(6) << std::setfill('0') << val;
-	std::string s = ss.str();
-	return s;
+	ss << std::setw(6) << std::setfill('0') << link.seq.Next();
+	return ss.str();
+}
+
+// Fixed-width fields of the frames sent to the web server (see SOCFormat.h)
+std::string get_int_str(int val){
+	char buffer[32];
+	size_t length = FormatInteger(val, buffer, sizeof(buffer), OPC_FORMAT_INT6);
+	return std::string(buffer, length);
 }
 
 std::string get_float_str(float val){
-	std::stringstream ss;
-	if(val>9999.0) val = 9999.0;
-	if(val<0.0) val = 0.0;
-	ss << std::setw(6) << std::setfill('0') <<  std::fixed << std::setprecision(1) << val;
-	std::string s = ss.str();
-	return s;
+	char buffer[32];
+	size_t length = FormatDouble(val, buffer, sizeof(buffer), OPC_FORMAT_FLOAT6);
+	return std::string(buffer, length);
+}
+
+std::string get_epoch_str(LONGLONG val){
+	char buffer[32];
+	size_t length = FormatInteger(val, buffer, sizeof(buffer), OPC_FORMAT_EPOCH16);
+	return std::string(buffer, length);
 }
 
 std::vector<string> split (const string &s, char delim) {
@@ -40,6 +40,7 @@
 #include <thread>
 #include <functional>
 #include <mutex>
+#include <atomic>
 
 // Winsockets
 // Source: https://docs.microsoft.com/en-us/windows/win32/winsock/complete-client-code
@@ -54,6 +55,9 @@
 #pragma comment (lib, "Mswsock.lib")
 #pragma comment (lib, "AdvApi32.lib")
 #define DEFAULT_BUFLEN 512
+#include "SOCFrameReader.h"
+#include "SOCSocketWait.h"
+#include "SOCSequence.h"
 
 
 
@@ -69,20 +73,68 @@
 #define REAL8 VT_R8
 
 IOPCServer *InstantiateServer(wchar_t ServerName[]);
-void AddTheGroup(IOPCServer* pIOPCServer, IOPCItemMgt* &pIOPCItemMgt, OPCHANDLE& hServerGroup);
+bool AddTheGroup(IOPCServer* pIOPCServer, IOPCItemMgt* &pIOPCItemMgt, OPCHANDLE& hServerGroup);
 void AddTheItem(IOPCItemMgt* pIOPCItemMgt, OPCHANDLE& hServerItem, wchar_t*, int, int);
+bool AddTheItems(IOPCItemMgt* pIOPCItemMgt, struct Opc_item** items, DWORD count,
+	bool* accepted = NULL);
 void WriteItem(IUnknown* pGroupIUnknown, OPCHANDLE hServerItem, VARIANT* varValue);
-void ReadItem(IUnknown* pGroupIUnknown, OPCHANDLE hServerItem, VARIANT& varValue);
+void ReadItem(IUnknown* pGroupIUnknown, OPCHANDLE hServerItem, VARIANT& varValue,
+	WORD* quality = NULL, FILETIME* timestamp = NULL);
 void RemoveItem(IOPCItemMgt* pIOPCItemMgt, OPCHANDLE hServerItem);
 void RemoveGroup(IOPCServer* pIOPCServer, OPCHANDLE hServerGroup);
 
+// Status publishing policy (see webclient_job())
+struct Status_policy {
+	bool on_change;				// send when the status changes, not periodically
+	unsigned int min_interval;	// ms between two status frames, at least
+	unsigned int max_silence;	// ms without a status frame, at most
+};
+
+// Connection to the web server (see reconnect_server_thread())
+struct Web_link {
+	const char* name;
+	std::timed_mutex mutex;			// Protects the socket and everything below
+	std::atomic<bool> connected;	// Link is up
+	HANDLE lost_event;				// Set to have the link reconnected
+	SOCKET socket;
+	SOCFrameReader reader;			// Splits what the web server sends into frames
+	SOCSocketWait wait;				// Connects and waits for replies, giving up on shutdown
+	SOCSequence seq;				// Numbers of the frames on this link, 6 digits
+	SOCSequenceCheck received;		// Numbers of the frames pushed by the web server
+	char recvbuf[DEFAULT_BUFLEN];
+	int recvbuflen;
+
+	Web_link (const char* name) : name(name), connected(false), lost_event(NULL),
+		socket(INVALID_SOCKET), reader(4 * DEFAULT_BUFLEN), seq(1000000), received(1000000),
+		recvbuflen(DEFAULT_BUFLEN) {}
+};
+
 // Added functions
-void webclient_loop(unsigned int loop_delay);
-void opcclient_loop(unsigned int loop_delay);
-void set_disconnected();
-void reconnect_server_thread(struct addrinfo *result);
-std::string get_msg_seq();
+void webclient_job();
+bool send_frame(Web_link& link, const std::string& send_msg);
+bool post_frame(Web_link& link, const std::string& send_msg);
+bool position_job(bool& moved);
+bool parse_position(const char* msg, struct Posicao& posicao);
+bool store_position(struct Posicao_sample& sample);
+bool subscribe_positions();
+bool position_push_job();
+bool handle_pushed_frame(Web_link& link, const char* frame);
+void write_pushed_positions();
+void opcclient_job();
+void opcread_job();
+void opcwatchdog_loop(class SOCDataCallback* pSOCDataCallback, unsigned int keep_alive);
+void set_disconnected(Web_link& link);
+int send_text(Web_link& link, const std::string& msg);
+int recv_frame(Web_link& link, char* buf, int len);
+void print_cpu_usage();
+void reconnect_server_thread(Web_link* link, struct addrinfo *result);
+void drain_link(Web_link& link, std::chrono::steady_clock::time_point deadline);
+void close_link(Web_link& link, std::chrono::steady_clock::time_point deadline);
+struct Status_rec get_status();
+std::string get_array_msg(Web_link& link, const struct Opc_item& item, uint32_t& sent_version);
+std::string get_msg_seq(Web_link& link);
 std::string get_int_str(int val);
 std::string get_float_str(float val);
+std::string get_epoch_str(LONGLONG val);
 std::vector<std::string> split (const std::string &s, char delim);
 #endif // SIMPLE_OPC_CLIENT_H not defined
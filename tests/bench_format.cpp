@@ -0,0 +1,142 @@
+//
+// Check and benchmark of the wire fields written by SOCFormat against the
+// code it replaced: the stringstreams of get_int_str, get_float_str and
+// get_epoch_str, and the sprintf calls of VarToStr.
+//
+// Usage: bench_format [iterations]
+// Exits with 1 if a field differs from the old one.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include "SOCFormat.h"
+
+// The old fields, as they were written before SOCFormat
+static std::string old_int_str (int val)
+{
+	std::stringstream ss;
+	if (val > 999999) val = 999999;
+	if (val < 0) val = 0;
+	ss << std::setw(6) << std::setfill('0') << val;
+	return ss.str();
+}
+
+static std::string old_float_str (float val)
+{
+	std::stringstream ss;
+	if (val > 9999.0) val = 9999.0;
+	if (val < 0.0) val = 0.0;
+	ss << std::setw(6) << std::setfill('0') << std::fixed << std::setprecision(1) << val;
+	return ss.str();
+}
+
+static std::string old_epoch_str (LONGLONG val)
+{
+	std::stringstream ss;
+	if (val < 0) val = 0;
+	ss << std::setw(16) << std::setfill('0') << val;
+	return ss.str();
+}
+
+static std::string int_str (int val)
+{
+	char buffer[32];
+	size_t length = FormatInteger(val, buffer, sizeof(buffer), OPC_FORMAT_INT6);
+	return std::string(buffer, length);
+}
+
+static std::string float_str (float val)
+{
+	char buffer[32];
+	size_t length = FormatDouble(val, buffer, sizeof(buffer), OPC_FORMAT_FLOAT6);
+	return std::string(buffer, length);
+}
+
+static std::string epoch_str (LONGLONG val)
+{
+	char buffer[32];
+	size_t length = FormatInteger(val, buffer, sizeof(buffer), OPC_FORMAT_EPOCH16);
+	return std::string(buffer, length);
+}
+
+static int failures = 0;
+
+static void expect (const std::string& got, const std::string& wanted, const char* what)
+{
+	if (got != wanted){
+		printf("FALHA %s: \"%s\", esperado \"%s\"\n", what, got.c_str(), wanted.c_str());
+		failures++;
+	}
+}
+
+// ns per call of "f" over "n" calls
+template <typename F>
+static double time_ns (long n, F f)
+{
+	auto start = std::chrono::steady_clock::now();
+	for (long k = 0; k < n; k++)
+		f(k);
+	auto end = std::chrono::steady_clock::now();
+	return std::chrono::duration<double, std::nano>(end - start).count() / n;
+}
+
+static volatile size_t sink;
+
+int main (int argc, char** argv)
+{
+	long iterations = (argc > 1) ? atol(argv[1]) : 200000;
+
+	// Same text as the old fields over their whole ranges
+	for (int v = -10; v <= 1000010; v += 7)
+		expect(int_str(v), old_int_str(v), "INT6");
+	for (int v = -100; v <= 100100; v++)
+		expect(float_str(v / 10.0f), old_float_str(v / 10.0f), "FLOAT6");
+	LONGLONG epochs[] = { -1, 0, 1, 1609459200000000LL, 9999999999999998LL, 9999999999999999LL };
+	for (size_t k = 0; k < sizeof(epochs) / sizeof(epochs[0]); k++)
+		expect(epoch_str(epochs[k]), old_epoch_str(epochs[k]), "EPOCH16");
+
+	// Past the field the old code overflowed; the new one clamps to 16 digits
+	expect(epoch_str(10000000000000000LL), "9999999999999999", "EPOCH16 max");
+	expect(epoch_str(0x7FFFFFFFFFFFFFFFLL), "9999999999999999", "EPOCH16 max");
+	expect(int_str(0x7FFFFFFF), "999999", "INT6 max");
+
+	if (failures > 0){
+		printf("%d falhas\n", failures);
+		return 1;
+	}
+
+	char buffer[32];
+	double t;
+	printf("%ld iteracoes\n", iterations);
+
+	t = time_ns(iterations, [&](long k) { sink = old_int_str((int) k).size(); });
+	printf("INT6    stringstream %7.1f ns", t);
+	t = time_ns(iterations, [&](long k) { sink = snprintf(buffer, sizeof(buffer), "%06d", (int) k); });
+	printf("  snprintf %7.1f ns", t);
+	t = time_ns(iterations, [&](long k) {
+		sink = FormatInteger(k, buffer, sizeof(buffer), OPC_FORMAT_INT6); });
+	printf("  SOCFormat %7.1f ns\n", t);
+
+	t = time_ns(iterations, [&](long k) { sink = old_float_str(k * 0.1f).size(); });
+	printf("FLOAT6  stringstream %7.1f ns", t);
+	t = time_ns(iterations, [&](long k) { sink = snprintf(buffer, sizeof(buffer), "%06.1f", k * 0.1f); });
+	printf("  snprintf %7.1f ns", t);
+	t = time_ns(iterations, [&](long k) {
+		sink = FormatDouble(k * 0.1f, buffer, sizeof(buffer), OPC_FORMAT_FLOAT6); });
+	printf("  SOCFormat %7.1f ns\n", t);
+
+	t = time_ns(iterations, [&](long k) { sink = old_epoch_str(1609459200000000LL + k).size(); });
+	printf("EPOCH16 stringstream %7.1f ns", t);
+	t = time_ns(iterations, [&](long k) {
+		sink = snprintf(buffer, sizeof(buffer), "%016lld", (long long) (1609459200000000LL + k)); });
+	printf("  snprintf %7.1f ns", t);
+	t = time_ns(iterations, [&](long k) {
+		sink = FormatInteger(1609459200000000LL + k, buffer, sizeof(buffer), OPC_FORMAT_EPOCH16); });
+	printf("  SOCFormat %7.1f ns\n", t);
+	return 0;
+}
@@ -0,0 +1,230 @@
+//
+// Benchmark of the CPU the gateway threads burn while they have nothing to
+// do, with the three ways the client has waited so far, as print_cpu_usage()
+// ('m' key) reports it: process CPU time over wall time, in percent of one
+// core.
+//
+//   spin    before SOCSignal: webclient_loop and opcclient_loop go back to
+//           try_lock() at once while the mutex is taken or the link is down
+//   signal  link_signal / position_signal and blocking lock()s
+//   wheel   SOCTimerWheel jobs that skip their period on a failed try_lock()
+//           (the current client: web and position every 100 ms, opc 1 s)
+//
+// Each one is run twice: during a reconnection (reconnect_server_thread and
+// opcwatchdog_loop hold the mutexes, link down) and with the link up and
+// nothing to send.
+//
+// Usage: bench_idle_wait [seconds per run]
+// Exits with 1 if signal or wheel use more than MAX_IDLE_CPU % of a core.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include "SOCSignal.h"
+#include "SOCTimerWheel.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#define MAX_IDLE_CPU 5.0	// % of a core
+
+// CPU time used by the process so far, in us
+static long long cpu_us ()
+{
+#ifdef _WIN32
+	FILETIME creation, exit_time, kernel, user;
+	GetProcessTimes(GetCurrentProcess(), &creation, &exit_time, &kernel, &user);
+	ULARGE_INTEGER k, u;
+	k.LowPart = kernel.dwLowDateTime; k.HighPart = kernel.dwHighDateTime;
+	u.LowPart = user.dwLowDateTime; u.HighPart = user.dwHighDateTime;
+	return (long long) ((k.QuadPart + u.QuadPart) / 10);
+#else
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return (long long) usage.ru_utime.tv_sec * 1000000 + usage.ru_utime.tv_usec +
+		(long long) usage.ru_stime.tv_sec * 1000000 + usage.ru_stime.tv_usec;
+#endif
+}
+
+// The state the loops look at, as in SimpleOPCClient_v3.cpp
+struct Gateway {
+	std::mutex socket_mutex;
+	std::mutex opc_mutex;
+	std::atomic<bool> connected;
+	std::atomic<bool> executing;
+	SOCSignal link_signal;
+	SOCSignal position_signal;
+	std::atomic<unsigned int> runs;	// periods that did (trivial) work
+};
+
+// ---- spin: the loops before SOCSignal ----
+
+static void spin_webclient (Gateway& g)
+{
+	while (g.executing){
+		if (g.socket_mutex.try_lock()){
+			if (!g.connected){
+				g.socket_mutex.unlock();
+				continue;
+			}
+			g.runs++;
+			g.socket_mutex.unlock();
+		}
+		else{
+			continue;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(2000));
+	}
+}
+
+static void spin_opcclient (Gateway& g)
+{
+	while (g.executing){
+		if (g.opc_mutex.try_lock()){
+			g.runs++;
+			g.opc_mutex.unlock();
+		}
+		else{
+			continue;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+	}
+}
+
+// ---- signal: link_signal / position_signal ----
+
+static void signal_webclient (Gateway& g)
+{
+	while (g.executing){
+		uint32_t link_seen = g.link_signal.Generation();
+		if (!g.connected){
+			g.link_signal.Wait(link_seen, INFINITE);
+			continue;
+		}
+		g.socket_mutex.lock();
+		if (g.connected)
+			g.runs++;
+		g.socket_mutex.unlock();
+		g.link_signal.Wait(link_seen, 2000);
+	}
+}
+
+static void signal_opcclient (Gateway& g)
+{
+	uint32_t position_seen = g.position_signal.Generation();
+	while (g.executing){
+		g.opc_mutex.lock();
+		g.runs++;
+		g.opc_mutex.unlock();
+		position_seen = g.position_signal.Wait(position_seen, 1000);
+	}
+}
+
+// One run of "seconds" s. Returns the CPU use in % of one core.
+enum Design { SPIN, SIGNAL, WHEEL };
+
+static double run (Design design, bool reconnecting, double seconds)
+{
+	Gateway g;
+	g.connected = !reconnecting;
+	g.executing = true;
+	g.runs = 0;
+
+	// reconnect_server_thread() and opcwatchdog_loop() at work
+	std::unique_lock<std::mutex> socket_hold(g.socket_mutex, std::defer_lock);
+	std::unique_lock<std::mutex> opc_hold(g.opc_mutex, std::defer_lock);
+	if (reconnecting){
+		socket_hold.lock();
+		opc_hold.lock();
+	}
+
+	std::thread web, opc;
+	SOCTimerWheel scheduler;
+	SOCTimerWheel position_scheduler;
+	std::mutex position_mutex;
+
+	long long cpu_start = cpu_us();
+	std::chrono::steady_clock::time_point wall_start = std::chrono::steady_clock::now();
+
+	switch (design){
+	case SPIN:
+		web = std::thread(spin_webclient, std::ref(g));
+		opc = std::thread(spin_opcclient, std::ref(g));
+		break;
+	case SIGNAL:
+		web = std::thread(signal_webclient, std::ref(g));
+		opc = std::thread(signal_opcclient, std::ref(g));
+		break;
+	case WHEEL:
+		// Both links are down together, so the position job skips too
+		if (reconnecting) position_mutex.lock();
+		scheduler.Add("web", 100, [&g]() {
+			if (!g.connected || !g.socket_mutex.try_lock()) return;
+			g.runs++;
+			g.socket_mutex.unlock();
+		});
+		scheduler.Add("opc", 1000, [&g]() {
+			if (!g.opc_mutex.try_lock()) return;
+			g.runs++;
+			g.opc_mutex.unlock();
+		});
+		position_scheduler.Add("posicao", 100, [&g, &position_mutex]() {
+			if (!g.connected || !position_mutex.try_lock()) return;
+			g.runs++;
+			position_mutex.unlock();
+		});
+		scheduler.Start();
+		position_scheduler.Start();
+		break;
+	}
+
+	std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+
+	long long cpu = cpu_us() - cpu_start;
+	double wall = std::chrono::duration<double, std::micro>(
+		std::chrono::steady_clock::now() - wall_start).count();
+
+	// Stop, the way main() does
+	g.executing = false;
+	g.link_signal.Notify();
+	g.position_signal.Notify();
+	if (socket_hold.owns_lock()) socket_hold.unlock();
+	if (opc_hold.owns_lock()) opc_hold.unlock();
+	if (design == WHEEL){
+		scheduler.Stop();
+		position_scheduler.Stop();
+		if (reconnecting) position_mutex.unlock();
+	}
+	else{
+		// The spin loops may be sleeping out a whole period first
+		web.join();
+		opc.join();
+	}
+	return 100.0 * cpu / wall;
+}
+
+int main (int argc, char** argv)
+{
+	double seconds = (argc > 1) ? atof(argv[1]) : 2.0;
+	const char* names[] = { "spin", "signal", "wheel" };
+	int failures = 0;
+
+	printf("%-8s %18s %18s\n", "", "reconectando", "ocioso");
+	for (int d = SPIN; d <= WHEEL; d++){
+		double down = run((Design) d, true, seconds);
+		double up = run((Design) d, false, seconds);
+		printf("%-8s %17.1f%% %17.1f%%\n", names[d], down, up);
+		if (d != SPIN && (down > MAX_IDLE_CPU || up > MAX_IDLE_CPU)){
+			printf("FALHA: %s acima de %.1f%% de um nucleo\n", names[d], MAX_IDLE_CPU);
+			failures++;
+		}
+	}
+	return failures > 0 ? 1 : 0;
+}
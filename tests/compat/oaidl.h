@@ -0,0 +1,2 @@
+// Stand-in for the Windows header of the same name (see win_compat.h)
+#include "win_compat.h"
@@ -0,0 +1,209 @@
+// Just enough of the Windows and OLE Automation headers to compile
+// opcda.h and the platform independent parts of the client (stream
+// parser, formatter) outside of Windows, for the portable tests and
+// benchmarks of this directory. Only used when not building on Windows.
+//
+// Types keep their Windows sizes (LONG and ULONG are 32 bits, OLECHAR
+// is UTF-16), so that the in-memory layouts the parser walks match the
+// real ones. WCHAR stays wchar_t, for the L"" constants of opcda.h.
+//
+
+#ifndef _WIN_COMPAT_H
+#define _WIN_COMPAT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <wchar.h>
+
+#define __RPCNDR_H_VERSION__	500
+#define interface				struct
+#define MIDL_INTERFACE(x)		struct
+#define STDMETHODCALLTYPE
+#define __RPC_FAR
+#define __RPC_USER
+#define __RPC_STUB
+#define __RPC__in
+#define __RPC__out
+#define EXTERN_C				extern "C"
+#define DECLSPEC_UUID(x)
+#define DECLSPEC_NOVTABLE
+
+typedef uint8_t BYTE;
+typedef uint16_t WORD;
+typedef uint32_t DWORD;
+typedef int32_t LONG;
+typedef uint32_t ULONG;
+typedef int BOOL;
+typedef int32_t HRESULT;
+typedef int32_t SCODE;
+typedef int16_t SHORT;
+typedef uint16_t USHORT;
+typedef int64_t LONGLONG;
+typedef uint64_t ULONGLONG;
+typedef char CHAR;
+typedef float FLOAT;
+typedef double DOUBLE;
+typedef int INT;
+typedef unsigned int UINT;
+typedef double DATE;
+typedef uint16_t VARTYPE;
+typedef int16_t VARIANT_BOOL;
+typedef wchar_t WCHAR;
+typedef char16_t OLECHAR;
+typedef WCHAR* LPWSTR;
+typedef const WCHAR* LPCWSTR;
+typedef OLECHAR* BSTR;
+typedef DWORD LCID;
+typedef void* RPC_IF_HANDLE;
+typedef void* HANDLE;
+
+typedef struct _GUID {
+	uint32_t Data1;
+	uint16_t Data2, Data3;
+	uint8_t Data4[8];
+} GUID;
+typedef GUID IID;
+typedef GUID CLSID;
+typedef const IID& REFIID;
+typedef const CLSID& REFCLSID;
+
+typedef struct _FILETIME {
+	DWORD dwLowDateTime;
+	DWORD dwHighDateTime;
+} FILETIME;
+
+typedef union tagCY {
+	LONGLONG int64;
+} CY;
+
+typedef struct tagSAFEARRAYBOUND {
+	ULONG cElements;
+	LONG lLbound;
+} SAFEARRAYBOUND;
+
+typedef struct tagSAFEARRAY {
+	USHORT cDims;
+	USHORT fFeatures;
+	ULONG cbElements;
+	ULONG cLocks;
+	void* pvData;
+	SAFEARRAYBOUND rgsabound[1];
+} SAFEARRAY;
+
+typedef struct tagVARIANT {
+	VARTYPE vt;
+	WORD wReserved1, wReserved2, wReserved3;
+	union {
+		LONGLONG llVal; LONG lVal; BYTE bVal; SHORT iVal; FLOAT fltVal; DOUBLE dblVal;
+		VARIANT_BOOL boolVal; SCODE scode; CY cyVal; DATE date; BSTR bstrVal;
+		SAFEARRAY* parray; CHAR cVal; USHORT uiVal; ULONG ulVal; ULONGLONG ullVal;
+		INT intVal; UINT uintVal; void* byref;
+		struct { void* pvRecord; void* pRecInfo; } brecVal;
+	};
+} VARIANT;
+
+enum VARENUM {
+	VT_EMPTY = 0, VT_NULL = 1, VT_I2 = 2, VT_I4 = 3, VT_R4 = 4, VT_R8 = 5, VT_CY = 6,
+	VT_DATE = 7, VT_BSTR = 8, VT_DISPATCH = 9, VT_ERROR = 10, VT_BOOL = 11, VT_VARIANT = 12,
+	VT_UNKNOWN = 13, VT_DECIMAL = 14, VT_I1 = 16, VT_UI1 = 17, VT_UI2 = 18, VT_UI4 = 19,
+	VT_I8 = 20, VT_UI8 = 21, VT_INT = 22, VT_UINT = 23, VT_ARRAY = 0x2000, VT_BYREF = 0x4000,
+	VT_TYPEMASK = 0xfff
+};
+
+#define VARIANT_TRUE	((VARIANT_BOOL) -1)
+#define VARIANT_FALSE	((VARIANT_BOOL) 0)
+#define S_OK			((HRESULT) 0)
+#define S_FALSE			((HRESULT) 1)
+#define E_FAIL			((HRESULT) 0x80004005L)
+#define E_INVALIDARG	((HRESULT) 0x80070057L)
+#define SUCCEEDED(h)	(((HRESULT) (h)) >= 0)
+#define FAILED(h)		(((HRESULT) (h)) < 0)
+#define FADF_STATIC		0x2
+#define FADF_FIXEDSIZE	0x10
+#define CP_UTF8			65001
+
+struct IUnknown {
+	virtual HRESULT QueryInterface (REFIID riid, void** ppv) = 0;
+	virtual ULONG AddRef () = 0;
+	virtual ULONG Release () = 0;
+};
+typedef IUnknown* LPUNKNOWN;
+struct IEnumString;
+struct IEnumUnknown;
+struct IEnumGUID;
+typedef IEnumString* LPENUMSTRING;
+
+inline HRESULT SafeArrayAccessData (SAFEARRAY* psa, void** ppvData)
+{
+	if (psa == NULL)
+		return E_INVALIDARG;
+	psa->cLocks++;
+	*ppvData = psa->pvData;
+	return S_OK;
+}
+
+inline HRESULT SafeArrayUnaccessData (SAFEARRAY* psa)
+{
+	if (psa == NULL)
+		return E_INVALIDARG;
+	psa->cLocks--;
+	return S_OK;
+}
+
+inline size_t wcslen (const OLECHAR* s)
+{
+	size_t n = 0;
+	while (s[n] != 0)
+		n++;
+	return n;
+}
+
+// UTF-16 to UTF-8 only
+inline int WideCharToMultiByte (UINT, DWORD, const OLECHAR* in, int count, char* out, int size,
+								const char*, BOOL*)
+{
+	int n = 0;
+	if (count < 0)
+		count = (int) wcslen(in) + 1;
+	for (int i = 0; i < count; i++){
+		uint32_t c = in[i];
+		if (c >= 0xD800 && c < 0xDC00 && i + 1 < count){
+			c = 0x10000 + ((c - 0xD800) << 10) + (in[i + 1] - 0xDC00);
+			i++;
+		}
+		char b[4];
+		int length;
+		if (c < 0x80){
+			b[0] = (char) c;
+			length = 1;
+		}
+		else if (c < 0x800){
+			b[0] = (char) (0xC0 | (c >> 6));
+			b[1] = (char) (0x80 | (c & 0x3F));
+			length = 2;
+		}
+		else if (c < 0x10000){
+			b[0] = (char) (0xE0 | (c >> 12));
+			b[1] = (char) (0x80 | ((c >> 6) & 0x3F));
+			b[2] = (char) (0x80 | (c & 0x3F));
+			length = 3;
+		}
+		else {
+			b[0] = (char) (0xF0 | (c >> 18));
+			b[1] = (char) (0x80 | ((c >> 12) & 0x3F));
+			b[2] = (char) (0x80 | ((c >> 6) & 0x3F));
+			b[3] = (char) (0x80 | (c & 0x3F));
+			length = 4;
+		}
+		if (size > 0){
+			if (n + length > size)
+				return 0;
+			memcpy(out + n, b, length);
+		}
+		n += length;
+	}
+	return n;
+}
+
+#endif // _WIN_COMPAT_H
@@ -0,0 +1,404 @@
+//
+// In-process stand-in for an OPC DA server (see fake_opc_server.h).
+//
+// Only what SOCSession uses is implemented; the other methods return
+// E_NOTIMPL. Every object holds the "process" it was created in, and
+// fails its calls once that process is killed.
+//
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string.h>
+#include <vector>
+#include "opcda.h"
+#include "opcerror.h"
+#include "fake_opc_server.h"
+
+namespace
+{
+	struct Process {
+		std::atomic<bool> alive;
+		Process () : alive(true) {}
+	};
+
+	class Fake_group;
+
+	std::mutex state_mutex;		// guards everything below
+	std::shared_ptr<Process> running = std::make_shared<Process>();
+	std::set<std::wstring> rejected;
+	std::map<std::wstring, unsigned int> requests;
+	unsigned int instances = 0;
+	Fake_group* last_group = NULL;	// AddRef'ed
+
+	// ************************************************************************
+	class Fake_group : public IOPCItemMgt, public IOPCGroupStateMgt2,
+		public IConnectionPointContainer, public IConnectionPoint
+		{
+		public:
+			Fake_group (std::shared_ptr<Process> process, DWORD update_rate, BOOL active)
+				: process(process), m_cnRef(0), update_rate(update_rate), active(active),
+				keep_alive(0), next_handle(0), sink(NULL) {}
+			~Fake_group ()
+			{
+				if (sink != NULL) sink->Release();
+			}
+
+			size_t Items ()
+			{
+				std::lock_guard<std::mutex> lock(group_mutex);
+				return items.size();
+			}
+			bool Active () const { return active != FALSE; }
+			bool Advised () const { return sink != NULL; }
+
+			// IUnknown
+			HRESULT STDMETHODCALLTYPE QueryInterface (REFIID riid, LPVOID* ppv)
+			{
+				if (ppv == NULL)
+					return E_POINTER;
+				*ppv = NULL;
+				if (!process->alive)
+					return RPC_E_DISCONNECTED;
+				if (riid == IID_IUnknown || riid == IID_IOPCItemMgt)
+					*ppv = (IOPCItemMgt*) this;
+				else if (riid == IID_IOPCGroupStateMgt || riid == IID_IOPCGroupStateMgt2)
+					*ppv = (IOPCGroupStateMgt2*) this;
+				else if (riid == IID_IConnectionPointContainer)
+					*ppv = (IConnectionPointContainer*) this;
+				else if (riid == IID_IConnectionPoint)
+					*ppv = (IConnectionPoint*) this;
+				else
+					return E_NOINTERFACE;
+				AddRef();
+				return S_OK;
+			}
+			ULONG STDMETHODCALLTYPE AddRef ()
+			{
+				return InterlockedIncrement(&m_cnRef);
+			}
+			ULONG STDMETHODCALLTYPE Release ()
+			{
+				LONG count = InterlockedDecrement(&m_cnRef);
+				if (count == 0)
+					delete this;
+				return count;
+			}
+
+			// IOPCItemMgt
+			HRESULT STDMETHODCALLTYPE AddItems (DWORD dwCount, OPCITEMDEF* pItemArray,
+				OPCITEMRESULT** ppAddResults, HRESULT** ppErrors)
+			{
+				if (!process->alive)
+					return RPC_E_DISCONNECTED;
+				*ppAddResults = (OPCITEMRESULT*) CoTaskMemAlloc(dwCount * sizeof(OPCITEMRESULT));
+				*ppErrors = (HRESULT*) CoTaskMemAlloc(dwCount * sizeof(HRESULT));
+				memset(*ppAddResults, 0, dwCount * sizeof(OPCITEMRESULT));
+
+				HRESULT hr = S_OK;
+				std::lock_guard<std::mutex> state(state_mutex);
+				std::lock_guard<std::mutex> lock(group_mutex);
+				for (DWORD i = 0; i < dwCount; i++){
+					std::wstring item_id(pItemArray[i].szItemID);
+					requests[item_id]++;
+					if (rejected.count(item_id) > 0){
+						(*ppErrors)[i] = OPC_E_UNKNOWNITEMID;
+						hr = S_FALSE;
+						continue;
+					}
+					OPCHANDLE handle = ++next_handle;
+					items[handle] = item_id;
+					(*ppAddResults)[i].hServer = handle;
+					(*ppAddResults)[i].vtCanonicalDataType = pItemArray[i].vtRequestedDataType;
+					(*ppAddResults)[i].dwAccessRights = OPC_READABLE | OPC_WRITEABLE;
+					(*ppErrors)[i] = S_OK;
+				}
+				return hr;
+			}
+			HRESULT STDMETHODCALLTYPE ValidateItems (DWORD, OPCITEMDEF*, BOOL,
+				OPCITEMRESULT**, HRESULT**) { return E_NOTIMPL; }
+			HRESULT STDMETHODCALLTYPE RemoveItems (DWORD dwCount, OPCHANDLE* phServer,
+				HRESULT** ppErrors)
+			{
+				if (!process->alive)
+					return RPC_E_DISCONNECTED;
+				*ppErrors = (HRESULT*) CoTaskMemAlloc(dwCount * sizeof(HRESULT));
+				HRESULT hr = S_OK;
+				std::lock_guard<std::mutex> lock(group_mutex);
+				for (DWORD i = 0; i < dwCount; i++){
+					(*ppErrors)[i] = items.erase(phServer[i]) > 0 ? S_OK : OPC_E_INVALIDHANDLE;
+					if ((*ppErrors)[i] != S_OK) hr = S_FALSE;
+				}
+				return hr;
+			}
+			HRESULT STDMETHODCALLTYPE SetActiveState (DWORD, OPCHANDLE*, BOOL,
+				HRESULT**) { return E_NOTIMPL; }
+			HRESULT STDMETHODCALLTYPE SetClientHandles (DWORD, OPCHANDLE*, OPCHANDLE*,
+				HRESULT**) { return E_NOTIMPL; }
+			HRESULT STDMETHODCALLTYPE SetDatatypes (DWORD, OPCHANDLE*, VARTYPE*,
+				HRESULT**) { return E_NOTIMPL; }
+			HRESULT STDMETHODCALLTYPE CreateEnumerator (REFIID, LPUNKNOWN*) { return E_NOTIMPL; }
+
+			// IOPCGroupStateMgt
+			HRESULT STDMETHODCALLTYPE GetState (DWORD*, BOOL*, LPWSTR*, LONG*, FLOAT*,
+				DWORD*, OPCHANDLE*, OPCHANDLE*) { return E_NOTIMPL; }
+			HRESULT STDMETHODCALLTYPE SetState (DWORD* pRequestedUpdateRate,
+				DWORD* pRevisedUpdateRate, BOOL* pActive, LONG*, FLOAT*, DWORD*, OPCHANDLE*)
+			{
+				if (!process->alive)
+					return RPC_E_DISCONNECTED;
+				if (pRequestedUpdateRate != NULL) update_rate = *pRequestedUpdateRate;
+				if (pActive != NULL) active = *pActive;
+				*pRevisedUpdateRate = update_rate;
+				return S_OK;
+			}
+			HRESULT STDMETHODCALLTYPE SetName (LPCWSTR) { return E_NOTIMPL; }
+			HRESULT STDMETHODCALLTYPE CloneGroup (LPCWSTR, REFIID, LPUNKNOWN*) { return E_NOTIMPL; }
+
+			// IOPCGroupStateMgt2
+			HRESULT STDMETHODCALLTYPE SetKeepAlive (DWORD dwKeepAliveTime,
+				DWORD* pdwRevisedKeepAliveTime)
+			{
+				if (!process->alive)
+					return RPC_E_DISCONNECTED;
+				keep_alive = dwKeepAliveTime;
+				*pdwRevisedKeepAliveTime = keep_alive;
+				return S_OK;
+			}
+			HRESULT STDMETHODCALLTYPE GetKeepAlive (DWORD* pdwKeepAliveTime)
+			{
+				if (!process->alive)
+					return RPC_E_DISCONNECTED;
+				*pdwKeepAliveTime = keep_alive;
+				return S_OK;
+			}
+
+			// IConnectionPointContainer
+			HRESULT STDMETHODCALLTYPE EnumConnectionPoints (IEnumConnectionPoints**) { return E_NOTIMPL; }
+			HRESULT STDMETHODCALLTYPE FindConnectionPoint (REFIID riid, IConnectionPoint** ppCP)
+			{
+				*ppCP = NULL;
+				if (!process->alive)
+					return RPC_E_DISCONNECTED;
+				if (riid != IID_IOPCDataCallback)
+					return CONNECT_E_NOCONNECTION;
+				*ppCP = (IConnectionPoint*) this;
+				AddRef();
+				return S_OK;
+			}
+
+			// IConnectionPoint
+			HRESULT STDMETHODCALLTYPE GetConnectionInterface (IID* pIID)
+			{
+				*pIID = IID_IOPCDataCallback;
+				return S_OK;
+			}
+			HRESULT STDMETHODCALLTYPE GetConnectionPointContainer (IConnectionPointContainer** ppCPC)
+			{
+				*ppCPC = (IConnectionPointContainer*) this;
+				AddRef();
+				return S_OK;
+			}
+			HRESULT STDMETHODCALLTYPE Advise (IUnknown* pUnkSink, DWORD* pdwCookie)
+			{
+				*pdwCookie = 0;
+				if (!process->alive)
+					return RPC_E_DISCONNECTED;
+				if (sink != NULL)
+					return CONNECT_E_ADVISELIMIT;
+				if (pUnkSink->QueryInterface(IID_IOPCDataCallback, (void**) &sink) != S_OK)
+					return CONNECT_E_CANNOTCONNECT;
+				*pdwCookie = 1;
+				return S_OK;
+			}
+			HRESULT STDMETHODCALLTYPE Unadvise (DWORD dwCookie)
+			{
+				// A dead server keeps its reference to the sink
+				if (!process->alive)
+					return RPC_E_DISCONNECTED;
+				if (dwCookie != 1 || sink == NULL)
+					return CONNECT_E_NOCONNECTION;
+				sink->Release();
+				sink = NULL;
+				return S_OK;
+			}
+			HRESULT STDMETHODCALLTYPE EnumConnections (IEnumConnections**) { return E_NOTIMPL; }
+
+		private:
+			std::shared_ptr<Process> process;
+			LONG m_cnRef;
+			DWORD update_rate;
+			BOOL active;
+			DWORD keep_alive;
+			std::mutex group_mutex;
+			std::map<OPCHANDLE, std::wstring> items;
+			OPCHANDLE next_handle;
+			IOPCDataCallback* sink;
+		};
+
+	// ************************************************************************
+	class Fake_server : public IOPCServer
+		{
+		public:
+			Fake_server (std::shared_ptr<Process> process)
+				: process(process), m_cnRef(0), next_group(0) {}
+			~Fake_server ()
+			{
+				for (auto& group : groups)
+					group.second->Release();
+			}
+
+			// IUnknown
+			HRESULT STDMETHODCALLTYPE QueryInterface (REFIID riid, LPVOID* ppv)
+			{
+				if (ppv == NULL)
+					return E_POINTER;
+				*ppv = NULL;
+				if (!process->alive)
+					return RPC_E_DISCONNECTED;
+				if (riid != IID_IUnknown && riid != IID_IOPCServer)
+					return E_NOINTERFACE;
+				*ppv = (IOPCServer*) this;
+				AddRef();
+				return S_OK;
+			}
+			ULONG STDMETHODCALLTYPE AddRef ()
+			{
+				return InterlockedIncrement(&m_cnRef);
+			}
+			ULONG STDMETHODCALLTYPE Release ()
+			{
+				LONG count = InterlockedDecrement(&m_cnRef);
+				if (count == 0)
+					delete this;
+				return count;
+			}
+
+			// IOPCServer
+			HRESULT STDMETHODCALLTYPE AddGroup (LPCWSTR, BOOL bActive, DWORD dwRequestedUpdateRate,
+				OPCHANDLE, LONG*, FLOAT*, DWORD, OPCHANDLE* phServerGroup,
+				DWORD* pRevisedUpdateRate, REFIID riid, LPUNKNOWN* ppUnk)
+			{
+				*ppUnk = NULL;
+				if (!process->alive)
+					return RPC_E_DISCONNECTED;
+				Fake_group* group = new Fake_group(process, dwRequestedUpdateRate, bActive);
+				group->AddRef();
+				HRESULT hr = group->QueryInterface(riid, (void**) ppUnk);
+				if (FAILED(hr)){
+					group->Release();
+					return hr;
+				}
+				*phServerGroup = ++next_group;
+				*pRevisedUpdateRate = dwRequestedUpdateRate;
+				groups[*phServerGroup] = group;
+
+				std::lock_guard<std::mutex> state(state_mutex);
+				group->AddRef();
+				if (last_group != NULL) last_group->Release();
+				last_group = group;
+				return S_OK;
+			}
+			HRESULT STDMETHODCALLTYPE GetErrorString (HRESULT, LCID, LPWSTR*) { return E_NOTIMPL; }
+			HRESULT STDMETHODCALLTYPE GetGroupByName (LPCWSTR, REFIID, LPUNKNOWN*) { return E_NOTIMPL; }
+			HRESULT STDMETHODCALLTYPE GetStatus (OPCSERVERSTATUS** ppServerStatus)
+			{
+				*ppServerStatus = NULL;
+				if (!process->alive)
+					return RPC_E_DISCONNECTED;
+				static const wchar_t vendor[] = L"Fake OPC server";
+				OPCSERVERSTATUS* status = (OPCSERVERSTATUS*) CoTaskMemAlloc(sizeof(OPCSERVERSTATUS));
+				memset(status, 0, sizeof(OPCSERVERSTATUS));
+				GetSystemTimeAsFileTime(&status->ftCurrentTime);
+				status->dwServerState = OPC_STATUS_RUNNING;
+				status->dwGroupCount = (DWORD) groups.size();
+				status->szVendorInfo = (LPWSTR) CoTaskMemAlloc(sizeof(vendor));
+				memcpy(status->szVendorInfo, vendor, sizeof(vendor));
+				*ppServerStatus = status;
+				return S_OK;
+			}
+			HRESULT STDMETHODCALLTYPE RemoveGroup (OPCHANDLE hServerGroup, BOOL)
+			{
+				if (!process->alive)
+					return RPC_E_DISCONNECTED;
+				auto group = groups.find(hServerGroup);
+				if (group == groups.end())
+					return E_INVALIDARG;
+				group->second->Release();
+				groups.erase(group);
+				return S_OK;
+			}
+			HRESULT STDMETHODCALLTYPE CreateGroupEnumerator (OPCENUMSCOPE, REFIID, LPUNKNOWN*) { return E_NOTIMPL; }
+
+		private:
+			std::shared_ptr<Process> process;
+			LONG m_cnRef;
+			OPCHANDLE next_group;
+			std::map<OPCHANDLE, Fake_group*> groups;	// AddRef'ed
+		};
+}
+
+IOPCServer* Fake_opc_server::Create (wchar_t*)
+{
+	std::lock_guard<std::mutex> state(state_mutex);
+	if (!running)
+		return NULL;	// as InstantiateServer() while the server is down
+	instances++;
+	IOPCServer* server = new Fake_server(running);
+	server->AddRef();
+	return server;
+}
+
+void Fake_opc_server::Kill ()
+{
+	std::lock_guard<std::mutex> state(state_mutex);
+	if (running)
+		running->alive = false;
+	running.reset();
+}
+
+void Fake_opc_server::Restart ()
+{
+	std::lock_guard<std::mutex> state(state_mutex);
+	if (!running)
+		running = std::make_shared<Process>();
+}
+
+void Fake_opc_server::Reject (const wchar_t* item_id)
+{
+	std::lock_guard<std::mutex> state(state_mutex);
+	rejected.insert(item_id);
+}
+
+unsigned int Fake_opc_server::Instances ()
+{
+	std::lock_guard<std::mutex> state(state_mutex);
+	return instances;
+}
+
+unsigned int Fake_opc_server::Requests (const wchar_t* item_id)
+{
+	std::lock_guard<std::mutex> state(state_mutex);
+	auto found = requests.find(item_id);
+	return found != requests.end() ? found->second : 0;
+}
+
+unsigned int Fake_opc_server::GroupItems ()
+{
+	std::lock_guard<std::mutex> state(state_mutex);
+	return last_group != NULL ? (unsigned int) last_group->Items() : 0;
+}
+
+bool Fake_opc_server::GroupActive ()
+{
+	std::lock_guard<std::mutex> state(state_mutex);
+	return last_group != NULL && last_group->Active();
+}
+
+bool Fake_opc_server::Advised ()
+{
+	std::lock_guard<std::mutex> state(state_mutex);
+	return last_group != NULL && last_group->Advised();
+}
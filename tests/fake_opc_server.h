@@ -0,0 +1,38 @@
+//
+// In-process stand-in for an OPC DA server (Windows only), for the tests
+// of SOCSession.
+//
+// Create() is an Opc_server_factory: it hands out a server object with
+// IOPCServer, whose groups have IOPCItemMgt, IOPCGroupStateMgt2 (with
+// keep-alive) and IConnectionPointContainer for IOPCDataCallback.
+// Kill() stands for the server process dying: from then on every call on
+// the objects already handed out fails with RPC_E_DISCONNECTED, as calls
+// through the proxies of a dead process do, and Create() fails as
+// CoCreateInstanceEx() would, until Restart() starts a new "process".
+//
+
+#include "opcda.h"
+
+#ifndef _FAKE_OPC_SERVER_H
+#define _FAKE_OPC_SERVER_H
+
+#include <string>
+
+namespace Fake_opc_server
+{
+	IOPCServer* Create (wchar_t* server_name);
+
+	void Kill ();
+	void Restart ();
+
+	// AddItems rejects "item_id" with OPC_E_UNKNOWNITEMID
+	void Reject (const wchar_t* item_id);
+
+	unsigned int Instances ();					// servers created so far
+	unsigned int Requests (const wchar_t* item_id);	// AddItems entries asking for it
+	unsigned int GroupItems ();					// items in the last group added
+	bool GroupActive ();						// last group added is active
+	bool Advised ();							// last group added has a callback
+}
+
+#endif // _FAKE_OPC_SERVER_H
@@ -0,0 +1,171 @@
+//
+// Stand-in for the web server (see fake_web_server.h).
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "fake_web_server.h"
+
+//	Constructor
+Fake_web_server::Fake_web_server ()
+	: running(false), position_requests(0)
+{
+	for (int k = 0; k < 3; k++)
+		delays[k] = 0;
+}
+
+//	Destructor
+Fake_web_server::~Fake_web_server ()
+{
+	Stop();
+}
+
+bool Fake_web_server::Start (const char* port)
+{
+	struct addrinfo hints, *result = NULL;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_protocol = IPPROTO_TCP;
+	if (getaddrinfo("localhost", port, &hints, &result) != 0)
+		return false;
+
+	// One listener per address the client may try
+	for (struct addrinfo* ptr = result; ptr != NULL; ptr = ptr->ai_next){
+		SOCKET s = socket(ptr->ai_family, ptr->ai_socktype, ptr->ai_protocol);
+		if (s == INVALID_SOCKET)
+			continue;
+		if (bind(s, ptr->ai_addr, (int) ptr->ai_addrlen) == SOCKET_ERROR ||
+			listen(s, SOMAXCONN) == SOCKET_ERROR){
+			closesocket(s);
+			continue;
+		}
+		listeners.push_back(s);
+	}
+	freeaddrinfo(result);
+	if (listeners.empty())
+		return false;
+
+	running = true;
+	acceptor = std::thread(&Fake_web_server::AcceptLoop, this);
+	return true;
+}
+
+void Fake_web_server::Stop ()
+{
+	if (!running)
+		return;
+	running = false;
+	acceptor.join();
+	for (size_t k = 0; k < listeners.size(); k++)
+		closesocket(listeners[k]);
+	listeners.clear();
+
+	// Ends the recv() of every connection
+	for (size_t k = 0; k < connections.size(); k++)
+		shutdown(connections[k], SD_BOTH);
+	for (size_t k = 0; k < threads.size(); k++)
+		threads[k].join();
+	for (size_t k = 0; k < connections.size(); k++)
+		closesocket(connections[k]);
+	connections.clear();
+	threads.clear();
+}
+
+void Fake_web_server::SetDelay (Fake_link_kind link, unsigned int delay_ms)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	delays[link] = delay_ms;
+}
+
+std::vector<Fake_web_server::Clock::time_point> Fake_web_server::StatusTimes ()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return status_times;
+}
+
+unsigned int Fake_web_server::PositionRequests ()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return position_requests;
+}
+
+unsigned int Fake_web_server::Delay (Fake_link_kind link)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return delays[link];
+}
+
+void Fake_web_server::AcceptLoop ()
+{
+	while (running){
+		fd_set readable;
+		timeval tick = { 0, 100000 };	// checks "running" every 100 ms
+		FD_ZERO(&readable);
+		for (size_t k = 0; k < listeners.size(); k++)
+			FD_SET(listeners[k], &readable);
+		if (select(0, &readable, NULL, NULL, &tick) <= 0)
+			continue;
+
+		for (size_t k = 0; k < listeners.size(); k++){
+			if (!FD_ISSET(listeners[k], &readable))
+				continue;
+			SOCKET s = accept(listeners[k], NULL, NULL);
+			if (s == INVALID_SOCKET)
+				continue;
+			connections.push_back(s);
+			threads.push_back(std::thread(&Fake_web_server::Serve, this, s));
+		}
+	}
+}
+
+// One connection: answer each frame as the web server does, after the
+// delay of the link it turned out to be
+void Fake_web_server::Serve (SOCKET s)
+{
+	Fake_link_kind link = FAKE_LINK_UNKNOWN;
+	bool first = true;
+	char frame[512];
+	char reply[128];
+
+	for (;;){
+		int n = recv(s, frame, sizeof(frame) - 1, 0);
+		if (n <= 0)
+			return;
+		frame[n] = '\0';
+		const char* code = strchr(frame, '$');
+		if (code == NULL)
+			continue;
+		code++;
+		long seq = (strtol(frame, NULL, 10) + 1) % 1000000;
+
+		reply[0] = '\0';
+		if (strncmp(code, "33", 2) == 0){
+			if (!first){
+				link = FAKE_LINK_POSITION;
+				std::lock_guard<std::mutex> lock(mutex);
+				position_requests++;
+			}
+			snprintf(reply, sizeof(reply), "%06ld$33$1.5$10$20$30$2.5", seq);
+		}
+		else if (strncmp(code, "11", 2) == 0){
+			link = FAKE_LINK_STATUS;
+			std::lock_guard<std::mutex> lock(mutex);
+			status_times.push_back(Clock::now());
+			snprintf(reply, sizeof(reply), "%06ld$99", seq);
+		}
+		else if (strncmp(code, "44", 2) == 0){
+			link = FAKE_LINK_POSITION;
+			snprintf(reply, sizeof(reply), "%06ld$00", seq);
+		}
+		first = false;
+
+		if (reply[0] == '\0')
+			continue;
+		unsigned int delay = Delay(link);
+		if (delay > 0)
+			Sleep(delay);
+		send(s, reply, (int) strlen(reply), 0);
+	}
+}
@@ -0,0 +1,65 @@
+//
+// Stand-in for the web server (Windows only), for the tests that run the
+// client against it.
+//
+// It speaks the original protocol, one frame per recv() and no
+// subscriptions: "33" requests get a position, "11" status frames get an
+// ACK, "44" gets a refusal (so positions are polled) and "99" and "55"
+// frames get nothing. Each connection is told apart by what it carries:
+// the status link sends "11" frames, the position link "33" requests past
+// its first frame (the reconnect test, which both links send). The
+// replies on each link can be held back by a delay of its own.
+//
+
+#include <winsock2.h>
+#include <ws2tcpip.h>
+
+#ifndef _FAKE_WEB_SERVER_H
+#define _FAKE_WEB_SERVER_H
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+enum Fake_link_kind { FAKE_LINK_UNKNOWN, FAKE_LINK_STATUS, FAKE_LINK_POSITION };
+
+// **************************************************************************
+class Fake_web_server
+	{
+	public:
+		typedef std::chrono::steady_clock Clock;
+
+		Fake_web_server ();
+		~Fake_web_server ();
+
+		// Listen on localhost (IPv4 and IPv6). Returns false if it cannot.
+		bool Start (const char* port);
+		void Stop ();
+
+		// Hold the replies on "link" back by "delay_ms" ms
+		void SetDelay (Fake_link_kind link, unsigned int delay_ms);
+
+		// When each status frame arrived
+		std::vector<Clock::time_point> StatusTimes ();
+		unsigned int PositionRequests ();
+
+	private:
+		void AcceptLoop ();
+		void Serve (SOCKET s);
+		unsigned int Delay (Fake_link_kind link);
+
+		std::vector<SOCKET> listeners;
+		std::vector<SOCKET> connections;
+		std::vector<std::thread> threads;
+		std::thread acceptor;
+		std::atomic<bool> running;
+
+		std::mutex mutex;		// guards everything below
+		unsigned int delays[3];
+		std::vector<Clock::time_point> status_times;
+		unsigned int position_requests;
+	};
+
+#endif // _FAKE_WEB_SERVER_H
@@ -0,0 +1,22 @@
+// In-memory stand-in for the IStream that CreateStreamOnHGlobal returns,
+// for bench_stream_parser.cpp.
+//
+
+#ifndef _MEMORY_STREAM_H
+#define _MEMORY_STREAM_H
+
+#include <stddef.h>
+#include "opcda.h"
+
+// **************************************************************************
+struct Byte_stream
+	{
+		virtual ~Byte_stream () {}
+		virtual HRESULT Seek (size_t offset) = 0;
+		virtual HRESULT Read (void* out, size_t n) = 0;
+	};
+
+// Stream over "size" bytes at "data"; delete it when done
+Byte_stream* OpenMemoryStream (const BYTE* data, size_t size);
+
+#endif // _MEMORY_STREAM_H
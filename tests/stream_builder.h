@@ -0,0 +1,109 @@
+// Builder of OPC DA 1.0 data streams, in the layout OnDataChange receives
+// (see SOCStreamParser.h): group header, item headers, then the values.
+// Used by the stream parser test and benchmark in place of captured
+// buffers, which can also be given to them as files.
+//
+
+#ifndef _STREAM_BUILDER_H
+#define _STREAM_BUILDER_H
+
+#include <string.h>
+#include <vector>
+#include "opcda.h"
+
+// **************************************************************************
+class Stream_builder
+	{
+	public:
+		Stream_builder () {}
+
+		void AddNumber (OPCHANDLE handle, VARTYPE vt, const void* value, size_t size)
+		{
+			VARIANT v;
+			memset(&v, 0, sizeof(v));
+			v.vt = vt;
+			memcpy(&v.llVal, value, size);
+			Begin(handle);
+			Append(&v, sizeof(v));
+		}
+
+		void AddI4 (OPCHANDLE handle, LONG value) { AddNumber(handle, VT_I4, &value, sizeof(value)); }
+		void AddR8 (OPCHANDLE handle, double value) { AddNumber(handle, VT_R8, &value, sizeof(value)); }
+
+		// VARIANT, DWORD byte count, UTF-16 characters, NUL
+		void AddString (OPCHANDLE handle, const char* ascii)
+		{
+			VARIANT v;
+			memset(&v, 0, sizeof(v));
+			v.vt = VT_BSTR;
+			Begin(handle);
+			Append(&v, sizeof(v));
+			DWORD bytes = (DWORD) (strlen(ascii) * sizeof(OLECHAR));
+			Append(&bytes, sizeof(bytes));
+			for (const char* c = ascii; ; c++){
+				OLECHAR w = (OLECHAR) *c;
+				Append(&w, sizeof(w));
+				if (*c == '\0')
+					break;
+			}
+		}
+
+		// VARIANT, SAFEARRAY, elements (1-D)
+		void AddArray (OPCHANDLE handle, VARTYPE vt, const void* elements, ULONG count, ULONG element_size)
+		{
+			VARIANT v;
+			SAFEARRAY sa;
+			memset(&v, 0, sizeof(v));
+			memset(&sa, 0, sizeof(sa));
+			v.vt = VT_ARRAY | vt;
+			sa.cDims = 1;
+			sa.cbElements = element_size;
+			sa.rgsabound[0].cElements = count;
+			Begin(handle);
+			Append(&v, sizeof(v));
+			Append(&sa, sizeof(sa));
+			Append(elements, (size_t) count * element_size);
+		}
+
+		// The whole block
+		std::vector<BYTE> Build () const
+		{
+			size_t headers = sizeof(OPCGROUPHEADER) + items.size() * sizeof(OPCITEMHEADER1);
+			std::vector<BYTE> block(headers + values.size());
+			OPCGROUPHEADER group;
+			memset(&group, 0, sizeof(group));
+			group.dwSize = (DWORD) block.size();
+			group.dwItemCount = (DWORD) items.size();
+			memcpy(&block[0], &group, sizeof(group));
+			for (size_t k = 0; k < items.size(); k++){
+				OPCITEMHEADER1 item = items[k];
+				item.dwValueOffset += (DWORD) headers;
+				memcpy(&block[sizeof(group) + k * sizeof(item)], &item, sizeof(item));
+			}
+			if (!values.empty())
+				memcpy(&block[headers], &values[0], values.size());
+			return block;
+		}
+
+	private:
+		void Begin (OPCHANDLE handle)
+		{
+			OPCITEMHEADER1 item;
+			memset(&item, 0, sizeof(item));
+			item.hClient = handle;
+			item.dwValueOffset = (DWORD) values.size();	// from the values, for now
+			item.wQuality = 0xC0;
+			item.ftTimeStampItem.dwLowDateTime = handle;
+			items.push_back(item);
+		}
+
+		void Append (const void* p, size_t n)
+		{
+			values.insert(values.end(), (const BYTE*) p, (const BYTE*) p + n);
+		}
+
+		std::vector<OPCITEMHEADER1> items;
+		std::vector<BYTE> values;
+	};
+
+#endif // _STREAM_BUILDER_H
@@ -0,0 +1,127 @@
+//
+// Test of the registration of the published arrays next to a subscription
+// pattern that covers them (Windows only).
+//
+// main() registers the array items before it resolves the patterns, so
+// that "Random.*" skips Random.ArrayOfReal8 and the array keeps a handle
+// of its own. Registered the other way round, Register() fails on the
+// duplicate item ID and the array must not be taken for the item whose
+// handle its "id" still holds (get_array_msg() checks it with Find()).
+//
+// The browse index is read from a file written here in the layout of
+// SOCBrowseIndex::Save(), since the stand-in server cannot be browsed.
+//
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "SOCItemRegistry.h"
+#include "SOCBrowse.h"
+
+#define INDEX_FILE "test_item_registry.idx"
+#define INDEX_MAGIC 0x5844494F		// OPC_INDEX_MAGIC of SOCBrowse.cpp
+#define INDEX_VERSION 2				// OPC_INDEX_VERSION of SOCBrowse.cpp
+
+// Defined by the client, for the OPC DA 1.0 data advise
+UINT OPC_DATA_TIME = RegisterClipboardFormatW(L"OPCSTMFORMATDATATIME");
+
+static int failures = 0;
+
+#define CHECK(c) do { if (!(c)){ printf("FALHA linha %d: %s\n", __LINE__, #c); failures++; } } while (0)
+
+static wchar_t server_name[] = L"Fake.OPC.Server.1";
+static wchar_t id_fixed[] = L"Saw-Toothed Waves.Real4";
+static wchar_t id_array[] = L"Random.ArrayOfReal8";
+
+static void write_word (FILE* f, WORD w) { fwrite(&w, sizeof(w), 1, f); }
+static void write_dword (FILE* f, DWORD d) { fwrite(&d, sizeof(d), 1, f); }
+
+// An ID with no prefix shared with the previous one
+static void write_id (FILE* f, const std::wstring& id)
+{
+	write_word(f, 0);
+	write_word(f, (WORD) id.size());
+	fwrite(id.data(), sizeof(wchar_t), id.size(), f);
+}
+
+// Index of the "Random" branch, items sorted by ID
+static bool write_index ()
+{
+	FILE* f = fopen(INDEX_FILE, "wb");
+	if (f == NULL)
+		return false;
+	std::wstring name(server_name);
+	write_dword(f, INDEX_MAGIC);
+	write_dword(f, INDEX_VERSION);
+	write_word(f, (WORD) name.size());
+	fwrite(name.data(), sizeof(wchar_t), name.size(), f);
+	write_dword(f, 0);
+	write_dword(f, 0);
+	write_dword(f, 1);
+	write_id(f, L"Random");
+
+	struct { const wchar_t* id; VARTYPE type; } items[] = {
+		{ id_array, VT_ARRAY | VT_R8 }, { L"Random.Int4", VT_I4 }, { L"Random.Real8", VT_R8 },
+	};
+	write_dword(f, 3);
+	for (int k = 0; k < 3; k++){
+		write_word(f, items[k].type);
+		write_word(f, OPC_READABLE);
+		write_dword(f, 0);
+		write_id(f, items[k].id);
+	}
+	fclose(f);
+	return true;
+}
+
+int main ()
+{
+	CHECK(write_index());
+	SOCBrowseIndex index(server_name, INDEX_FILE);
+	CHECK(index.Load());
+	CHECK(index.Items().size() == 3);
+
+	// As main() does it: fixed items, arrays, then the patterns
+	{
+		SOCItemRegistry registry;
+		Opc_item fixed = { 0, id_fixed, VT_R4, 0 };
+		Opc_item array = { 0, id_array, VT_ARRAY | VT_R8, 0 };
+		CHECK(registry.Register(&fixed));
+		CHECK(registry.Register(&array));
+		CHECK(fixed.id == 0 && array.id == 1);
+
+		std::vector<Opc_item*> matched = registry.Subscribe(index, L"Random.*");
+		CHECK(matched.size() == 2);
+		for (size_t k = 0; k < matched.size(); k++)
+			CHECK(std::wstring(matched[k]->item_id) != id_array);
+		CHECK(registry.Find(id_array) == &array);
+		CHECK(registry.Find((OPCHANDLE) array.id) == &array);
+		CHECK(registry.Size() == 4);
+
+		// A second pass of the pattern adds nothing
+		CHECK(registry.Subscribe(index, L"Random.*").empty());
+		CHECK(registry.Size() == 4);
+	}
+
+	// The pattern first: the array is not registered, and its handle is
+	// not taken for the fixed item's
+	{
+		SOCItemRegistry registry;
+		Opc_item fixed = { 0, id_fixed, VT_R4, 0 };
+		Opc_item array = { 0, id_array, VT_ARRAY | VT_R8, 0 };
+		CHECK(registry.Register(&fixed));
+		CHECK(registry.Subscribe(index, L"Random.*").size() == 3);
+		CHECK(!registry.Register(&array));
+		CHECK(registry.Find((OPCHANDLE) array.id) != &array);
+		CHECK(registry.Find(id_array) != &array);
+	}
+
+	remove(INDEX_FILE);
+
+	if (failures > 0){
+		printf("%d falhas\n", failures);
+		return 1;
+	}
+	printf("OK\n");
+	return 0;
+}
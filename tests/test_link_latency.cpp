@@ -0,0 +1,104 @@
+//
+// Test that a slow position reply does not hold the status frames back
+// (Windows only).
+//
+// The client is run against the stand-in web server of fake_web_server.cpp,
+// which answers the position requests POSITION_DELAY ms late. Status and
+// positions travel on links of their own, so the status heartbeats must
+// keep their period (loop_web_time, with nothing changing as no OPC server
+// is needed) all the same: on a shared link each one could wait up to
+// POSITION_DELAY ms for the position exchange in flight.
+//
+// Usage: test_link_latency <client executable> [seconds]
+//
+
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include "fake_web_server.h"
+
+#pragma comment (lib, "Ws2_32.lib")
+
+#define WEB_PORT "3445"			// DEFAULT_PORT of the client
+#define HEARTBEAT 2000			// ms, loop_web_time of the client
+#define POSITION_DELAY 1500		// ms
+#define TOLERANCE 500			// ms, scheduling and start-up slack
+
+static int failures = 0;
+
+#define CHECK(c) do { if (!(c)){ printf("FALHA linha %d: %s\n", __LINE__, #c); failures++; } } while (0)
+
+int main (int argc, char** argv)
+{
+	if (argc < 2){
+		printf("Uso: test_link_latency <cliente> [segundos]\n");
+		return 1;
+	}
+	DWORD run_time = (argc > 2) ? (DWORD) atoi(argv[2]) * 1000 : 12000;
+
+	WSADATA wsaData;
+	if (WSAStartup(MAKEWORD(2,2), &wsaData) != 0){
+		printf("WSAStartup falhou\n");
+		return 1;
+	}
+	Fake_web_server server;
+	if (!server.Start(WEB_PORT)){
+		printf("Porta %s indisponivel\n", WEB_PORT);
+		return 1;
+	}
+	server.SetDelay(FAKE_LINK_POSITION, POSITION_DELAY);
+
+	// The client, with a pipe for its keyboard
+	SECURITY_ATTRIBUTES inherit = { sizeof(SECURITY_ATTRIBUTES), NULL, TRUE };
+	HANDLE keyboard_read, keyboard_write;
+	CreatePipe(&keyboard_read, &keyboard_write, &inherit, 0);
+	SetHandleInformation(keyboard_write, HANDLE_FLAG_INHERIT, 0);
+	STARTUPINFOA startup = {};
+	startup.cb = sizeof(startup);
+	startup.dwFlags = STARTF_USESTDHANDLES;
+	startup.hStdInput = keyboard_read;
+	startup.hStdOutput = GetStdHandle(STD_OUTPUT_HANDLE);
+	startup.hStdError = GetStdHandle(STD_ERROR_HANDLE);
+	PROCESS_INFORMATION client = {};
+	if (!CreateProcessA(argv[1], NULL, NULL, NULL, TRUE, 0, NULL, NULL, &startup, &client)){
+		printf("Cliente %s nao iniciou (%lu)\n", argv[1], GetLastError());
+		return 1;
+	}
+
+	Sleep(run_time);
+	DWORD written;
+	WriteFile(keyboard_write, "q\n", 2, &written, NULL);
+	if (WaitForSingleObject(client.hProcess, 10000) != WAIT_OBJECT_0){
+		printf("Cliente nao encerrou\n");
+		TerminateProcess(client.hProcess, 1);
+		failures++;
+	}
+	CloseHandle(client.hProcess);
+	CloseHandle(client.hThread);
+	CloseHandle(keyboard_read);
+	CloseHandle(keyboard_write);
+	server.Stop();
+	WSACleanup();
+
+	// The first frame goes out on connection, the rest on the heartbeat
+	std::vector<Fake_web_server::Clock::time_point> times = server.StatusTimes();
+	long long worst = 0;
+	for (size_t k = 2; k < times.size(); k++){
+		long long gap = std::chrono::duration_cast<std::chrono::milliseconds>(
+			times[k] - times[k - 1]).count();
+		if (gap > worst) worst = gap;
+	}
+	printf("%u pedidos de posicao, %zu quadros de status, maior intervalo %lld ms\n",
+		server.PositionRequests(), times.size(), worst);
+	CHECK(server.PositionRequests() >= 2);
+	CHECK(times.size() >= 4);
+	CHECK(worst <= HEARTBEAT + TOLERANCE);
+
+	if (failures > 0){
+		printf("%d falhas\n", failures);
+		return 1;
+	}
+	printf("OK\n");
+	return 0;
+}
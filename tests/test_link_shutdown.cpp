@@ -0,0 +1,181 @@
+//
+// Test of the shutdown of a web server link (Windows only).
+//
+// The reconnect thread of a link holds its mutex while it connects and
+// while it waits for the reply to its test frame, and the main thread
+// waits for it on 'q'. Both waits go through SOCSocketWait, which must
+// give up within SHUTDOWN_LIMIT ms of the stop event being set:
+//  - with the link down: a connect() to an address that never answers;
+//  - with a recv in progress: a connection on which nothing comes.
+// The other cases check that the waits still end on their own.
+//
+// Usage: test_link_shutdown [unreachable IPv4 address]
+// The default one (TEST-NET-1) is not routed; where the network refuses it
+// at once, the link down case is skipped.
+//
+
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <stdio.h>
+#include <chrono>
+#include <thread>
+#include "SOCSocketWait.h"
+
+#pragma comment (lib, "Ws2_32.lib")
+
+#define SHUTDOWN_LIMIT 100	// ms
+#define STOP_AFTER 200		// ms into the wait
+
+static int failures = 0;
+
+#define CHECK(c) do { if (!(c)){ printf("FALHA linha %d: %s\n", __LINE__, #c); failures++; } } while (0)
+
+typedef std::chrono::steady_clock Clock;
+
+// Set "stop_event" STOP_AFTER ms from now, recording when
+static std::thread stop_later (HANDLE stop_event, Clock::time_point& stopped_at)
+{
+	return std::thread([stop_event, &stopped_at]() {
+		Sleep(STOP_AFTER);
+		stopped_at = Clock::now();
+		SetEvent(stop_event);
+	});
+}
+
+static long long ms_since (Clock::time_point t)
+{
+	return std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - t).count();
+}
+
+// A connected pair of sockets over the loopback
+static bool socket_pair (SOCKET& client, SOCKET& server)
+{
+	SOCKET listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	sockaddr_in addr = {};
+	int addrlen = sizeof(addr);
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = 0;
+	client = server = INVALID_SOCKET;
+	if (listener == INVALID_SOCKET ||
+		bind(listener, (sockaddr*) &addr, sizeof(addr)) == SOCKET_ERROR ||
+		getsockname(listener, (sockaddr*) &addr, &addrlen) == SOCKET_ERROR ||
+		listen(listener, 1) == SOCKET_ERROR){
+		closesocket(listener);
+		return false;
+	}
+	client = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (connect(client, (sockaddr*) &addr, sizeof(addr)) == 0)
+		server = accept(listener, NULL, NULL);
+	closesocket(listener);
+	return server != INVALID_SOCKET;
+}
+
+static void test_connect_stopped (const char* address)
+{
+	// Link down: the server never answers the SYN
+	HANDLE stop_event = CreateEvent(NULL, TRUE, FALSE, NULL);
+	SOCSocketWait wait;
+	SOCKET s = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	sockaddr_in addr = {};
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(27015);
+	inet_pton(AF_INET, address, &addr.sin_addr);
+
+	Clock::time_point stopped_at;
+	Clock::time_point start = Clock::now();
+	std::thread stopper = stop_later(stop_event, stopped_at);
+	int error = wait.Connect(s, (sockaddr*) &addr, sizeof(addr), stop_event);
+	Clock::time_point end = Clock::now();
+	stopper.join();
+
+	if (error != WSAEINTR && end - start < std::chrono::milliseconds(STOP_AFTER)){
+		printf("connect: %s recusado de imediato (%d), caso ignorado\n", address, error);
+	}
+	else {
+		long long late = std::chrono::duration_cast<std::chrono::milliseconds>(end - stopped_at).count();
+		printf("connect: parado %lld ms apos o evento\n", late);
+		CHECK(error == WSAEINTR);
+		CHECK(late < SHUTDOWN_LIMIT);
+	}
+	closesocket(s);
+	CloseHandle(stop_event);
+}
+
+static void test_recv_stopped ()
+{
+	// Recv in progress: the server keeps quiet
+	HANDLE stop_event = CreateEvent(NULL, TRUE, FALSE, NULL);
+	SOCSocketWait wait;
+	SOCKET client, server;
+	CHECK(socket_pair(client, server));
+
+	Clock::time_point stopped_at;
+	std::thread stopper = stop_later(stop_event, stopped_at);
+	int error = wait.Readable(client, INFINITE, stop_event);
+	Clock::time_point end = Clock::now();
+	stopper.join();
+
+	long long late = std::chrono::duration_cast<std::chrono::milliseconds>(end - stopped_at).count();
+	printf("recv: parado %lld ms apos o evento\n", late);
+	CHECK(error == WSAEINTR);
+	CHECK(late < SHUTDOWN_LIMIT);
+	closesocket(client);
+	closesocket(server);
+	CloseHandle(stop_event);
+}
+
+static void test_recv_ends ()
+{
+	// Without a shutdown, the wait ends on data, on a close and on timeout,
+	// and leaves the socket blocking
+	HANDLE stop_event = CreateEvent(NULL, TRUE, FALSE, NULL);
+	SOCSocketWait wait;
+	SOCKET client, server;
+	CHECK(socket_pair(client, server));
+
+	Clock::time_point start = Clock::now();
+	CHECK(wait.Readable(client, 50, stop_event) == WSAETIMEDOUT);
+	CHECK(ms_since(start) < 50 + SHUTDOWN_LIMIT);
+
+	char buf[16];
+	CHECK(send(server, "000001$33", 9, 0) == 9);
+	CHECK(wait.Readable(client, INFINITE, stop_event) == 0);
+	CHECK(recv(client, buf, sizeof(buf), 0) == 9);
+
+	// Blocking again: a recv() with nothing there waits instead of
+	// failing with WSAEWOULDBLOCK
+	std::thread sender([server]() {
+		Sleep(50);
+		send(server, "x", 1, 0);
+	});
+	CHECK(recv(client, buf, sizeof(buf), 0) == 1);
+	sender.join();
+
+	closesocket(server);
+	CHECK(wait.Readable(client, INFINITE, stop_event) == 0);
+	CHECK(recv(client, buf, sizeof(buf), 0) == 0);
+	closesocket(client);
+	CloseHandle(stop_event);
+}
+
+int main (int argc, char** argv)
+{
+	WSADATA wsaData;
+	if (WSAStartup(MAKEWORD(2,2), &wsaData) != 0){
+		printf("WSAStartup falhou\n");
+		return 1;
+	}
+
+	test_connect_stopped(argc > 1 ? argv[1] : "192.0.2.1");
+	test_recv_stopped();
+	test_recv_ends();
+	WSACleanup();
+
+	if (failures > 0){
+		printf("%d falhas\n", failures);
+		return 1;
+	}
+	printf("OK\n");
+	return 0;
+}
@@ -0,0 +1,142 @@
+//
+// Test of the recovery of SOCSession from an OPC server restart (Windows
+// only).
+//
+// The session is opened on the stand-in server of fake_opc_server.cpp,
+// which is then killed and, DOWN_TIME ms later, restarted. Recover() must
+// rebuild the whole session on the new server (group, items, callback,
+// keep-alive, activation), without asking again for the item the first
+// one rejected, and account for it in Opc_recovery_stats. A second kill
+// checks that Recover() gives up when told to.
+//
+
+#include <stdio.h>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "SOCSession.h"
+#include "SOCItemRegistry.h"
+#include "SOCSampleRing.h"
+#include "fake_opc_server.h"
+
+#define DOWN_TIME 1200	// ms the server stays dead
+#define STOP_AFTER 300	// ms into the second recovery
+
+// Defined by the client, for the OPC DA 1.0 data advise
+UINT OPC_DATA_TIME = RegisterClipboardFormatW(L"OPCSTMFORMATDATATIME");
+
+static int failures = 0;
+
+#define CHECK(c) do { if (!(c)){ printf("FALHA linha %d: %s\n", __LINE__, #c); failures++; } } while (0)
+
+static wchar_t server_name[] = L"Fake.OPC.Server.1";
+static wchar_t id_real4[] = L"Fake.Real4";
+static wchar_t id_uint2[] = L"Fake.UInt2";
+static wchar_t id_missing[] = L"Fake.Missing";
+
+static ULONGLONG ms_since (std::chrono::steady_clock::time_point t)
+{
+	return std::chrono::duration_cast<std::chrono::milliseconds>(
+		std::chrono::steady_clock::now() - t).count();
+}
+
+int main ()
+{
+	CoInitializeEx(NULL, COINIT_MULTITHREADED);
+
+	SOCItemRegistry registry;
+	SOCSampleRing ring(1024, OPC_REGISTRY_CAPACITY, OPC_OVERFLOW_COALESCE);
+	SOCDataCallback* callback = new SOCDataCallback(&registry, &ring);
+	callback->AddRef();
+
+	Opc_item real4 = { 0, id_real4, VT_R4, 0 };
+	Opc_item uint2 = { 0, id_uint2, VT_UI2, 0 };
+	Opc_item missing = { 0, id_missing, VT_R8, 0 };
+	Opc_item* all[] = { &real4, &uint2, &missing };
+	std::vector<Opc_item*> items;
+	for (int k = 0; k < 3; k++){
+		registry.Register(all[k]);
+		items.push_back(all[k]);
+	}
+	std::vector<Opc_item*> sampled(1, &real4);
+	Fake_opc_server::Reject(id_missing);
+
+	std::mutex opc_mutex;
+	SOCSession* session = new SOCSession(server_name, items, sampled, 100, 1000,
+		callback, &opc_mutex, Fake_opc_server::Create);
+
+	// Open: the rejected item is left out
+	CHECK(session->Open());
+	CHECK(session->IsOpen());
+	CHECK(session->ServerKeepAlive());
+	CHECK(session->Responding());
+	CHECK(Fake_opc_server::GroupItems() == 2);
+	CHECK(Fake_opc_server::GroupActive());
+	CHECK(Fake_opc_server::Advised());
+	CHECK(real4.item_handle != 0 && uint2.item_handle != 0 && missing.item_handle == 0);
+	CHECK(Fake_opc_server::Requests(id_missing) == 1);
+
+	// Kill, restart DOWN_TIME ms later, recover
+	Fake_opc_server::Kill();
+	CHECK(!session->Responding());
+
+	bool keep_running = true;
+	HANDLE stop_event = CreateEvent(NULL, TRUE, FALSE, NULL);
+	std::chrono::steady_clock::time_point killed_at = std::chrono::steady_clock::now();
+	std::thread restarter([]() {
+		Sleep(DOWN_TIME);
+		Fake_opc_server::Restart();
+	});
+	CHECK(session->Recover(keep_running, stop_event));
+	ULONGLONG elapsed = ms_since(killed_at);
+	restarter.join();
+
+	Opc_recovery_stats stats = session->RecoveryStats();
+	printf("Recuperada em %llu ms (%u tentativas falhas)\n", stats.last_recovery_time,
+		stats.failed_attempts);
+	CHECK(stats.recoveries == 1);
+	CHECK(stats.failed_attempts >= 1);
+	CHECK(stats.last_recovery_time >= DOWN_TIME && stats.last_recovery_time <= elapsed);
+	CHECK(stats.max_recovery_time == stats.last_recovery_time);
+	CHECK(stats.total_recovery_time == stats.last_recovery_time);
+
+	// The new server holds the whole session again
+	CHECK(session->IsOpen());
+	CHECK(session->Responding());
+	CHECK(Fake_opc_server::Instances() == 2);
+	CHECK(Fake_opc_server::GroupItems() == 2);
+	CHECK(Fake_opc_server::GroupActive());
+	CHECK(Fake_opc_server::Advised());
+	CHECK(Fake_opc_server::Requests(id_missing) == 1);
+
+	// Killed for good: Recover() stops when keep_running turns false and
+	// stop_event is set, without counting a recovery
+	Fake_opc_server::Kill();
+	std::chrono::steady_clock::time_point stopping_at = std::chrono::steady_clock::now();
+	std::thread stopper([&keep_running, stop_event]() {
+		Sleep(STOP_AFTER);
+		keep_running = false;
+		SetEvent(stop_event);
+	});
+	CHECK(!session->Recover(keep_running, stop_event));
+	ULONGLONG stopped = ms_since(stopping_at);
+	stopper.join();
+	printf("Recuperacao interrompida em %llu ms\n", stopped);
+	CHECK(stopped < STOP_AFTER + 100);
+	CHECK(!session->IsOpen());
+	stats = session->RecoveryStats();
+	CHECK(stats.recoveries == 1);
+
+	delete session;
+	CloseHandle(stop_event);
+	callback->Release();
+	CoUninitialize();
+
+	if (failures > 0){
+		printf("%d falhas\n", failures);
+		return 1;
+	}
+	printf("OK\n");
+	return 0;
+}
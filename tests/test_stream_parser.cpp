@@ -0,0 +1,222 @@
+//
+// Test of SOCStreamParser over whole, truncated and corrupted streams.
+//
+// Every block is copied to a heap buffer of its exact size, so that a
+// read past the end shows up under a memory checker (the CMake tree
+// builds this test with AddressSanitizer where the compiler has it).
+//
+// Usage: test_stream_parser [captured blocks...]
+// Files given are parsed as raw OnDataChange blocks: they must not make
+// the parser read past them, whatever they hold.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "SOCStreamParser.h"
+#include "stream_builder.h"
+
+static int failures = 0;
+
+#define CHECK(c) do { if (!(c)){ printf("FALHA linha %d: %s\n", __LINE__, #c); failures++; } } while (0)
+
+// Parse every item of "block" cut to "size" bytes; returns the items decoded
+static DWORD parse_all (const std::vector<BYTE>& block, size_t size)
+{
+	BYTE* copy = (BYTE*) malloc(size > 0 ? size : 1);
+	if (size > 0)
+		memcpy(copy, &block[0], size);
+
+	SOCStreamParser parser(copy, size);
+	DWORD decoded = 0;
+	Opc_stream_item item;
+	for (DWORD k = 0; k < parser.Count(); k++){
+		if (!parser.Item(k, item))
+			continue;
+		decoded++;
+		// Touch what the item points to, as the sink does
+		volatile BYTE b;
+		for (DWORD i = 0; i < item.data_size; i++)
+			b = item.data[i];
+		(void) b;
+	}
+	free(copy);
+	return decoded;
+}
+
+static std::vector<BYTE> sample ()
+{
+	Stream_builder b;
+	float wave[5] = { 0.5f, 1.5f, 2.5f, 3.5f, 4.5f };
+	b.AddI4(1, 42);
+	b.AddR8(2, 3.25);
+	b.AddString(3, "posicao");
+	b.AddArray(4, VT_R4, wave, 5, sizeof(float));
+	b.AddString(5, "");
+	return b.Build();
+}
+
+static void test_whole ()
+{
+	std::vector<BYTE> block = sample();
+	SOCStreamParser parser(&block[0], block.size());
+	Opc_stream_item item;
+
+	CHECK(parser.Valid());
+	CHECK(parser.Count() == 5);
+
+	CHECK(parser.Item(0, item));
+	CHECK(item.client_handle == 1 && item.value.vt == VT_I4 && item.value.lVal == 42);
+	CHECK(item.quality == 0xC0 && item.timestamp.dwLowDateTime == 1);
+
+	CHECK(parser.Item(1, item));
+	CHECK(item.value.vt == VT_R8 && item.value.dblVal == 3.25);
+
+	CHECK(parser.Item(2, item));
+	CHECK(item.value.vt == VT_BSTR && item.data_size == 7 * sizeof(OLECHAR));
+	CHECK(item.value.bstrVal != NULL && item.value.bstrVal[0] == 'p' && item.value.bstrVal[7] == 0);
+
+	CHECK(parser.Item(3, item));
+	CHECK(item.value.vt == (VT_ARRAY | VT_R4) && item.dims == 1 && item.elements == 5);
+	CHECK(item.element_size == sizeof(float) && item.value.parray == NULL);
+	float third;
+	memcpy(&third, item.data + 2 * sizeof(float), sizeof(float));
+	CHECK(third == 2.5f);
+
+	CHECK(parser.Item(4, item));
+	CHECK(item.value.vt == VT_BSTR && item.data_size == 0 && item.value.bstrVal == NULL);
+
+	CHECK(!parser.Item(5, item));
+}
+
+// Cut at every length: a value that does not fit fails, the rest decode
+static void test_truncated ()
+{
+	std::vector<BYTE> block = sample();
+	DWORD last = 0;
+
+	for (size_t size = 0; size < block.size(); size++){
+		DWORD decoded = parse_all(block, size);
+		CHECK(decoded < 5);
+		CHECK(decoded >= last || size < sizeof(OPCGROUPHEADER) + 5 * sizeof(OPCITEMHEADER1));
+		last = decoded;
+	}
+	CHECK(parse_all(block, block.size()) == 5);
+
+	// Shorter than its own headers
+	SOCStreamParser empty(&block[0], sizeof(OPCGROUPHEADER) - 1);
+	CHECK(!empty.Valid() && empty.Count() == 0);
+	SOCStreamParser headers(&block[0], sizeof(OPCGROUPHEADER) + 4 * sizeof(OPCITEMHEADER1));
+	CHECK(!headers.Valid());
+}
+
+static void put_dword (std::vector<BYTE>& block, size_t offset, DWORD value)
+{
+	memcpy(&block[offset], &value, sizeof(value));
+}
+
+static DWORD get_dword (const std::vector<BYTE>& block, size_t offset)
+{
+	DWORD value;
+	memcpy(&value, &block[offset], sizeof(value));
+	return value;
+}
+
+// Fields that point outside of the block, or that do not add up
+static void test_corrupted ()
+{
+	std::vector<BYTE> block;
+	size_t item3 = sizeof(OPCGROUPHEADER) + 2 * sizeof(OPCITEMHEADER1);
+	size_t item4 = sizeof(OPCGROUPHEADER) + 3 * sizeof(OPCITEMHEADER1);
+	size_t offset_field = offsetof(OPCITEMHEADER1, dwValueOffset);
+
+	// Item count far beyond the headers present
+	block = sample();
+	put_dword(block, offsetof(OPCGROUPHEADER, dwItemCount), 0x10000000);
+	CHECK(parse_all(block, block.size()) == 0);
+
+	// Value offset past the end
+	block = sample();
+	put_dword(block, item3 + offset_field, 0xFFFFFFF0);
+	CHECK(parse_all(block, block.size()) == 4);
+
+	// String byte count odd, then past the end
+	block = sample();
+	size_t string_length = get_dword(block, item3 + offset_field) + sizeof(VARIANT);
+	put_dword(block, string_length, 7);
+	CHECK(parse_all(block, block.size()) == 4);
+	put_dword(block, string_length, 0xFFFFFFFE);
+	CHECK(parse_all(block, block.size()) == 4);
+
+	// String without its NUL
+	block = sample();
+	block[string_length + sizeof(DWORD) + 7 * sizeof(OLECHAR)] = 'x';
+	CHECK(parse_all(block, block.size()) == 4);
+
+	// Array larger than the block, its element count overflowing 32 bits
+	block = sample();
+	size_t array = get_dword(block, item4 + offset_field) + sizeof(VARIANT);
+	put_dword(block, array + offsetof(SAFEARRAY, rgsabound), 0x80000000);
+	CHECK(parse_all(block, block.size()) == 4);
+
+	// Array with no or oversized elements, or 3 dimensions
+	block = sample();
+	put_dword(block, array + offsetof(SAFEARRAY, cbElements), 0);
+	CHECK(parse_all(block, block.size()) == 4);
+	block = sample();
+	block[array + offsetof(SAFEARRAY, cDims)] = 3;
+	CHECK(parse_all(block, block.size()) == 4);
+
+	// dwSize smaller than the data: values past it are cut off
+	block = sample();
+	put_dword(block, offsetof(OPCGROUPHEADER, dwSize), (DWORD) (item4 + sizeof(OPCITEMHEADER1) + 1));
+	CHECK(parse_all(block, block.size()) == 0);
+
+	// Random bytes after valid headers
+	srand(1);
+	for (int round = 0; round < 2000; round++){
+		block = sample();
+		for (int k = 0; k < 8; k++)
+			block[sizeof(OPCGROUPHEADER) + rand() % (block.size() - sizeof(OPCGROUPHEADER))] = (BYTE) rand();
+		parse_all(block, block.size());
+	}
+}
+
+static void parse_file (const char* name)
+{
+	FILE* f = fopen(name, "rb");
+	if (f == NULL){
+		printf("%s: nao encontrado\n", name);
+		failures++;
+		return;
+	}
+	std::vector<BYTE> block;
+	BYTE buffer[4096];
+	size_t n;
+	while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0)
+		block.insert(block.end(), buffer, buffer + n);
+	fclose(f);
+
+	SOCStreamParser parser(block.empty() ? NULL : &block[0], block.size());
+	DWORD decoded = parse_all(block, block.size());
+	printf("%s: %zu bytes, %u itens, %u decodificados\n", name, block.size(), parser.Count(), decoded);
+	for (size_t size = 0; size < block.size(); size++)
+		parse_all(block, size);
+}
+
+int main (int argc, char** argv)
+{
+	test_whole();
+	test_truncated();
+	test_corrupted();
+	for (int k = 1; k < argc; k++)
+		parse_file(argv[k]);
+
+	if (failures > 0){
+		printf("%d falhas\n", failures);
+		return 1;
+	}
+	printf("OK\n");
+	return 0;
+}